@@ -1,42 +1,129 @@
+#include <algorithm>
+#include <cmath>
 #include <cstdint>
 #include <format>
 #include <iostream>
+#include <vector>
 
 #include <client/Bot.h>
 #include <client/IBot.h>
 #include <server/RandomUtils.h>
 
-RandomBot::RandomBot(Params p) : BotBase(std::move(p)) {}
+namespace {
+// Player one makes the even moves.
+void insertCoin(ConnectFourGame &game, std::uint32_t columnIdx) {
+    if (game.getMoveCount() % 2U == 0U) {
+        game.insertPlayer1Coin(columnIdx);
+    } else {
+        game.insertPlayer2Coin(columnIdx);
+    }
+}
 
-void RandomBot::sendMoveRequest(GameId const &gameId, std::uint32_t columnIdx) {
+// Plays the column and then random moves until the game ends. Returns 1 if the player that
+// plays the column wins, 0.5 for a draw and 0 for a loss.
+double playout(ConnectFourGame game, std::uint32_t columnIdx) {
+    std::uint32_t firstMoveIdx = game.getMoveCount();
+    for (;;) {
+        insertCoin(game, columnIdx);
+        if (game.checkIfWin(columnIdx)) {
+            return (game.getMoveCount() - 1U - firstMoveIdx) % 2U == 0U ? 1.0 : 0.0;
+        }
+        if (game.isFull()) {
+            return 0.5;
+        }
+        std::vector<std::uint32_t> availableColumns = game.getAvailableColumns();
+        columnIdx = availableColumns[getRandomInt(availableColumns.size() - 1U)];
+    }
+}
 
-    game_proto::Request request;
-    auto &moveRequest = *request.mutable_move_request();
-    moveRequest.set_game_id(gameId);
-    moveRequest.set_column_idx(columnIdx);
+struct ColumnScore {
+    double sum = 0.0;
+    double sumOfSquares = 0.0;
+    std::uint32_t count = 0U;
 
-    sendProtoMessage(request);
-}
-void RandomBot::sendFirstMoveRequest(GameId const &gameId) {
-    sendMoveRequest(gameId, getRandomInt(ConnectFourGame::ColumnCount - 1));
+    double getMean() const { return count ? sum / count : 0.0; }
+    double getStandardError() const {
+        if (count < 2U) {
+            return 1.0;
+        }
+        double mean = getMean();
+        double variance = std::max(sumOfSquares / count - mean * mean, 0.0);
+        return std::sqrt(variance / count);
+    }
+};
+} // namespace
+
+RandomBot::RandomBot(Params p) : BotBase(std::move(p)) {}
+
+std::uint32_t RandomBot::searchMove(MoveSearch const &search) {
+    auto columns = search.getAvailableColumns();
+    return columns[getRandomInt(columns.size() - 1U)];
 }
 
-void RandomBot::processAvailableMovesResponse(
-    game_proto::AvailableMovesResponse const &response) {
+MonteCarloBot::MonteCarloBot(Params p) : BotBase(std::move(p)) {}
+
+std::uint32_t MonteCarloBot::searchMove(MoveSearch const &search) {
+    auto columns = search.getAvailableColumns();
+    ConnectFourGame const &position = search.getPosition();
+
+    // A winning move needs no simulation.
+    for (std::uint32_t columnIdx : columns) {
+        ConnectFourGame next = position;
+        insertCoin(next, columnIdx);
+        if (next.checkIfWin(columnIdx)) {
+            return columnIdx;
+        }
+    }
+
+    std::vector<ColumnScore> scores(columns.size());
+    std::size_t bestIdx = 0U;
+    while (!search.shouldStop()) {
+        for (std::size_t idx = 0U; idx < columns.size(); ++idx) {
+            double result = playout(position, columns[idx]);
+            scores[idx].sum += result;
+            scores[idx].sumOfSquares += result * result;
+            ++scores[idx].count;
+        }
 
-    auto &availableMoves = response.column_idx();
-    auto selectedColumnIdx = availableMoves[getRandomInt(availableMoves.size() - 1)];
+        for (std::size_t idx = 0U; idx < scores.size(); ++idx) {
+            if (scores[idx].getMean() > scores[bestIdx].getMean()) {
+                bestIdx = idx;
+            }
+        }
+        if (scores[bestIdx].count < MinPlayoutCount) {
+            continue;
+        }
 
-    sendMoveRequest(response.game_id(), selectedColumnIdx);
+        double bestLowerBound = scores[bestIdx].getMean() -
+                                ConfidenceZScore * scores[bestIdx].getStandardError();
+        bool confident = true;
+        for (std::size_t idx = 0U; idx < scores.size() && confident; ++idx) {
+            confident = idx == bestIdx ||
+                        scores[idx].getMean() +
+                                ConfidenceZScore * scores[idx].getStandardError() <
+                            bestLowerBound;
+        }
+        if (confident) {
+            break;
+        }
+    }
+    return columns[bestIdx];
 }
 
 std::shared_ptr<IBot> makeNewBot(BotType type,
                                  std::string name,
                                  ConnectionMetadata metadata,
-                                 std::shared_ptr<Client> endpoint) {
+                                 std::shared_ptr<Client> endpoint,
+                                 BotStrand strand) {
+    BotBase::Params params{.name = std::move(name),
+                           .metadata = std::move(metadata),
+                           .endpoint = endpoint,
+                           .strand = std::move(strand)};
     if (type == BotType::Random) {
-        return std::make_shared<RandomBot>(RandomBot::Params{
-            .name = std::move(name), .metadata = std::move(metadata), .endpoint = endpoint});
+        return std::make_shared<RandomBot>(std::move(params));
+    }
+    if (type == BotType::MonteCarlo) {
+        return std::make_shared<MonteCarloBot>(std::move(params));
     }
 
     throw std::runtime_error("Unknown bot type.");
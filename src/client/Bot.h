@@ -19,31 +19,39 @@
 #include <client/Client_fwd.h>
 #include <client/IBot.h>
 
-enum class BotType : std::uint32_t { Random };
+enum class BotType : std::uint32_t { Random, MonteCarlo };
 
 std::shared_ptr<IBot> makeNewBot(BotType type,
                                  std::string name,
                                  ConnectionMetadata metadata,
-                                 std::shared_ptr<Client> endpoint);
+                                 std::shared_ptr<Client> endpoint,
+                                 BotStrand strand);
 
 class RandomBot : public BotBase {
+  public:
     using Params = BotBase::Params;
 
-    friend std::shared_ptr<IBot> makeNewBot(BotType type,
-                                            std::string name,
-                                            ConnectionMetadata metadata,
-                                            std::shared_ptr<Client> endpoint);
+    RandomBot(Params p);
+
+    std::uint32_t searchMove(MoveSearch const &search) override;
+};
 
+// Flat Monte Carlo search. Plays random games after every available column until the
+// deadline and picks the column with the best average result. Stops early on an immediate
+// win or once one column is ahead of all others with high confidence.
+class MonteCarloBot : public BotBase {
   public:
-    // Private constructor, because the class can only be constructed through the Client class.
-    RandomBot(Params p);
+    using Params = BotBase::Params;
 
-    void sendMoveRequest(GameId const &gameId, std::uint32_t columnidx) override;
+    MonteCarloBot(Params p);
 
-    void sendFirstMoveRequest(GameId const &gameId) override;
+    std::uint32_t searchMove(MoveSearch const &search) override;
 
-    void
-    processAvailableMovesResponse(game_proto::AvailableMovesResponse const &response) override;
+  private:
+    // Playouts per column before the confidence test is applied.
+    constexpr static std::uint32_t MinPlayoutCount = 64U;
+    // Standard errors that separate the best column from the others.
+    constexpr static double ConfidenceZScore = 3.0;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -3,29 +3,152 @@
 
 #include <format>
 #include <iostream>
+#include <stdexcept>
+
+#include <asio/post.hpp>
 
 #include <game.pb.h>
 
 #include <client/Client.h>
 #include <server/ConnectFourGame.h>
+#include <server/MonotonicTime.h>
 #include <server/RandomUtils.h>
 #include <server/ServerTypes.h>
 
 BotBase::BotBase(Params p)
-    : m_name(std::move(p.name)), m_metadata(std::move(p.metadata)), m_endpoint(p.endpoint) {}
+    : m_name(std::move(p.name)), m_metadata(std::move(p.metadata)), m_endpoint(p.endpoint),
+      m_strand(std::move(p.strand)), m_verbose(p.verbose),
+      m_moveTimeBudget(p.moveTimeBudget) {}
 
 void BotBase::processMessage(MessagePtr msg) {
+    std::uint64_t receiveTime = getMonotonicNanoseconds();
     game_proto::Response message;
 
     std::string const &payload = msg->get_payload();
     message.ParseFromArray(payload.data(), payload.size());
+    if (message.has_trace()) {
+        m_endpoint->getRoundTripStatistics().record(
+            message.response_case(), message.trace(), receiveTime);
+    }
+    processResponse(message);
+}
 
+void BotBase::processResponse(game_proto::Response const &message) {
     if (message.has_registration_success_response()) {
-        std::cout << std::format("{:s} registered successfully.\n", m_name);
+        if (m_verbose) {
+            std::cout << std::format("{:s} registered successfully.\n", m_name);
+        }
         sendNewGameRequest();
     } else if (message.has_new_game_response()) {
-        processNewGameResponse(*message.mutable_new_game_response());
+        processNewGameResponse(message.new_game_response());
+    } else if (message.has_available_games_response()) {
+        auto const &response = message.available_games_response();
+        auto gameIter = m_games.find(response.game_id());
+        if (gameIter != m_games.end() && gameIter->second.resuming) {
+            gameIter->second.resuming = false;
+        } else {
+            applyMove(response.game_id(), response.opponent_column_idx(), response.move_idx());
+        }
+        processAvailableMovesResponse(response);
+    } else if (message.has_game_end_response()) {
+        GameId gameId = message.game_end_response().game_id();
+        m_games.erase(gameId);
+        if (auto searchIter = m_searches.find(gameId); searchIter != m_searches.end()) {
+            searchIter->second->cancel();
+            m_searches.erase(searchIter);
+        }
+    }
+}
+
+auto BotBase::getGame(GameId gameId) const -> BotGame const * {
+    auto gameIter = m_games.find(gameId);
+    return gameIter != m_games.end() ? &gameIter->second : nullptr;
+}
+
+void BotBase::applyMove(GameId gameId,
+                        std::uint32_t columnIdx,
+                        std::optional<std::uint32_t> moveIdx) {
+    auto gameIter = m_games.find(gameId);
+    if (gameIter == m_games.end()) {
+        return;
+    }
+
+    ConnectFourGame &board = gameIter->second.board;
+    try {
+        if (moveIdx && *moveIdx != board.getMoveCount()) {
+            throw std::runtime_error(std::format(
+                "expected move {:d}, got move {:d}", board.getMoveCount(), *moveIdx));
+        }
+        // Player one makes the even moves.
+        if (board.getMoveCount() % 2U == 0U) {
+            board.insertPlayer1Coin(columnIdx);
+        } else {
+            board.insertPlayer2Coin(columnIdx);
+        }
+    } catch (std::exception const &e) {
+        std::cerr << std::format(
+            "{:s} lost track of game {:d}: {:s}.\n", m_name, gameId, e.what());
+        m_games.erase(gameIter);
+    }
+}
+
+void BotBase::sendMoveRequest(GameId const &gameId, std::uint32_t columnIdx) {
+    game_proto::Request request;
+    auto &moveRequest = *request.mutable_move_request();
+    moveRequest.set_game_id(gameId);
+    moveRequest.set_column_idx(columnIdx);
+
+    sendRequest(request);
+}
+
+void BotBase::sendFirstMoveRequest(GameId const &gameId) {
+    std::vector<std::uint32_t> columns(ConnectFourGame::ColumnCount);
+    for (std::uint32_t idx = 0U; idx < columns.size(); ++idx) {
+        columns[idx] = idx;
+    }
+    requestMove(gameId, std::move(columns), m_moveTimeBudget);
+}
+
+void BotBase::processAvailableMovesResponse(
+    game_proto::AvailableMovesResponse const &response) {
+    requestMove(response.game_id(),
+                std::vector<std::uint32_t>(response.column_idx().begin(),
+                                           response.column_idx().end()),
+                m_moveTimeBudget);
+}
+
+void BotBase::requestMove(GameId const &gameId,
+                          std::vector<std::uint32_t> availableColumns,
+                          std::chrono::steady_clock::duration budget) {
+    if (availableColumns.empty()) {
+        return;
+    }
+    BotGame const *game = getGame(gameId);
+    if (!game) {
+        // Without a position there is nothing to search.
+        return sendMoveRequest(gameId, availableColumns.front());
     }
+
+    auto search = std::make_shared<MoveSearch>(
+        game->board, std::move(availableColumns), MoveSearch::Clock::now() + budget);
+    if (auto &previous = m_searches[gameId]) {
+        previous->cancel();
+    }
+    m_searches[gameId] = search;
+
+    // Bots live as long as the client, whose destructor joins the worker pool.
+    auto work = [this, gameId, search]() {
+        std::uint32_t columnIdx = searchMove(*search);
+        asio::post(m_strand, [this, gameId, search, columnIdx]() {
+            auto searchIter = m_searches.find(gameId);
+            if (searchIter == m_searches.end() || searchIter->second != search) {
+                return;
+            }
+            m_searches.erase(searchIter);
+            sendMoveRequest(gameId, columnIdx);
+        });
+    };
+    asio::post(m_endpoint->getWorkerExecutor(), std::move(work));
 }
 
 void BotBase::sendProtoMessage(google::protobuf::Message const &message) {
@@ -37,9 +160,22 @@ void BotBase::sendProtoMessage(google::protobuf::Message const &message) {
         m_metadata.getHdl(), payload.data(), messageSize, websocketpp::frame::opcode::binary);
 }
 
+void BotBase::sendRequest(game_proto::Request &request) {
+    if (request.has_move_request()) {
+        applyMove(request.move_request().game_id(), request.move_request().column_idx());
+    }
+
+    auto &trace = *request.mutable_trace();
+    trace.set_sequence_id(m_nextSequenceId++);
+    trace.set_client_send_time(getMonotonicNanoseconds());
+    sendProtoMessage(request);
+}
+
 void BotBase::sendRegistrationRequest() {
 
-    std::cout << "Sending registration request.\n";
+    if (m_verbose) {
+        std::cout << "Sending registration request.\n";
+    }
     game_proto::Request request;
     auto &registrationRequest = *request.mutable_registration_request();
 
@@ -47,28 +183,38 @@ void BotBase::sendRegistrationRequest() {
     credentials.set_username(m_name);
     credentials.set_display_name(m_name);
 
-    sendProtoMessage(request);
+    sendRequest(request);
 }
 
 void BotBase::sendNewGameRequest() {
-    std::cout << std::format("{:s} sent new game request.\n", m_name);
+    if (m_verbose) {
+        std::cout << std::format("{:s} sent new game request.\n", m_name);
+    }
     game_proto::Request request;
     request.mutable_new_game_request();
-    sendProtoMessage(request);
+    sendRequest(request);
 }
 
 void BotBase::processNewGameResponse(game_proto::NewGameResponse const &response) {
 
     auto const &gameId = response.game_id();
-    auto [gameIter, success] = m_games.insert(gameId);
+    auto [gameIter, success] = m_games.emplace(gameId,
+                                               BotGame{.board = {},
+                                                       .isPlayer1 = response.make_first_move(),
+                                                       .resuming = response.resumed()});
     assert(success);
+    for (std::uint32_t columnIdx : response.moves()) {
+        applyMove(gameId, columnIdx, std::nullopt);
+    }
 
-    std::cout << std::format("{:s} starting a new game against {:s} with rating {:d}.\n",
-                             m_name,
-                             response.opponent_display_name(),
-                             response.opponent_rating());
+    if (m_verbose) {
+        std::cout << std::format("{:s} starting a new game against {:s} with rating {:d}.\n",
+                                 m_name,
+                                 response.opponent_display_name(),
+                                 response.opponent_rating());
+    }
 
-    if (response.make_first_move()) {
+    if (response.make_first_move() && !response.resumed()) {
         sendFirstMoveRequest(gameId);
     }
 }
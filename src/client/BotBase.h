@@ -3,13 +3,19 @@
 
 #include "IBot.h"
 
+#include <chrono>
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <optional>
 #include <string>
 #include <type_traits>
-#include <unordered_set>
+#include <unordered_map>
+#include <vector>
 
 #include <client/Client_fwd.h>
 #include <client/IBot.h>
+#include <server/ConnectFourGame.h>
 
 class BotBase : public IBot {
 
@@ -22,6 +28,11 @@ class BotBase : public IBot {
         std::string name;
         ConnectionMetadata metadata;
         std::shared_ptr<Client> endpoint;
+        BotStrand strand;
+        // Logs registration and game events to stdout.
+        bool verbose = true;
+        // Thinking time of a move search.
+        std::chrono::milliseconds moveTimeBudget{500};
     };
 
     using GameId = GameManager::GameId;
@@ -34,14 +45,58 @@ class BotBase : public IBot {
     void processNewGameResponse(game_proto::NewGameResponse const &response) override;
     void processMessage(MessagePtr msg) override;
 
+    void sendMoveRequest(GameId const &gameId, std::uint32_t columnIdx) override;
+    // Both search for the move with the bot's time budget.
+    void sendFirstMoveRequest(GameId const &gameId) override;
+    void
+    processAvailableMovesResponse(game_proto::AvailableMovesResponse const &response) override;
+    void requestMove(GameId const &gameId,
+                     std::vector<std::uint32_t> availableColumns,
+                     std::chrono::steady_clock::duration budget) override;
+
     ConnectionMetadata const &getConnectionMetadata() const override { return m_metadata; }
+    BotStrand const &getStrand() const override { return m_strand; }
     std::string const &getName() const override { return m_name; }
 
+  protected:
+    // Mirror of an active game. Own moves are applied when they are sent, opponent moves when
+    // the server reports them, so the board never has to be resent.
+    struct BotGame {
+        ConnectFourGame board;
+        bool isPlayer1 = false;
+        // Resumed after a server restart, the next available moves response carries no
+        // opponent move.
+        bool resuming = false;
+    };
+
+    // Null if the game is not active or its mirror diverged from the server. Strand only.
+    BotGame const *getGame(GameId gameId) const;
+
+    // Stamps the request with a trace before sending it, so that the response can be
+    // attributed to client, network and server time.
+    void sendRequest(game_proto::Request &request);
+
+    // Dispatches a parsed server response. Runs on the bot's strand.
+    virtual void processResponse(game_proto::Response const &message);
+
+  private:
+    // Drops the mirror if the move does not fit it. The move index is checked if given.
+    void applyMove(GameId gameId,
+                   std::uint32_t columnIdx,
+                   std::optional<std::uint32_t> moveIdx = std::nullopt);
+
   private:
     std::string m_name;
     ConnectionMetadata m_metadata;
-    std::unordered_set<GameId> m_games;
+    // Only accessed on m_strand.
+    std::unordered_map<GameId, BotGame> m_games;
     std::shared_ptr<Client> m_endpoint;
+    BotStrand m_strand;
+    bool m_verbose;
+    std::chrono::milliseconds m_moveTimeBudget;
+    // Running searches, a search that is no longer here when it returns is dropped.
+    std::unordered_map<GameId, std::shared_ptr<MoveSearch>> m_searches;
+    std::uint64_t m_nextSequenceId = 1U;
 };
 
 #endif
\ No newline at end of file
@@ -5,15 +5,24 @@
 
 #include <websocketpp/common/memory.hpp>
 
+#include <algorithm>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <span>
+#include <string_view>
 #include <thread>
+#include <vector>
+
+#include <asio/post.hpp>
 
 #include <client/Bot.h>
 #include <client/ClientTypes.h>
+#include <client/LoadGenerator.h>
 #include <server/ConnectionMetadata.h>
 
-Client::Client() {
+Client::Client(Params params)
+    : m_params(params), m_workerPool(std::max<std::size_t>(params.workerThreadCount, 1U)) {
     clear_access_channels(websocketpp::log::alevel::all);
     clear_error_channels(websocketpp::log::elevel::all);
 
@@ -28,44 +37,61 @@ Client::Client() {
     set_open_handler([this](ConnectionHdl hdl) { openHandler(hdl); });
 }
 
-void Client::failHandler(ConnectionHdl hdl) {
+Client::~Client() { m_workerPool.join(); }
+
+std::shared_ptr<IBot> Client::findBot(ConnectionHdl hdl) const {
+    std::shared_lock lock(m_botListMutex);
     auto botIter = m_botList.find(hdl);
-    if (botIter == m_botList.end()) {
+    return botIter != m_botList.end() ? botIter->second : nullptr;
+}
+
+std::size_t Client::getBotCount() const {
+    std::shared_lock lock(m_botListMutex);
+    return m_botList.size();
+}
+
+void Client::failHandler(ConnectionHdl hdl) {
+    auto bot = findBot(hdl);
+    if (!bot) {
         std::cerr << "Fail handler: bot and associated connection not found.\n";
         return;
     }
 
-    auto const &bot = botIter->second;
     auto uriPtr = bot->getConnectionMetadata().getUri();
     std::cerr << std::format("Connection to {:s} failed.\n", uriPtr->str());
 }
 
 void Client::openHandler(ConnectionHdl hdl) {
-    auto botIter = m_botList.find(hdl);
-    if (botIter == m_botList.end()) {
+    auto bot = findBot(hdl);
+    if (!bot) {
         std::cerr << "Open handler: bot and associated connection not found.\n";
         return;
     }
-    auto bot = botIter->second;
 
     std::cout << std::format("Connection for {:s} opened.\n", bot->getName());
-    bot->sendRegistrationRequest();
-    // bot->sendNewGameRequest();
+    asio::post(bot->getStrand(), [bot]() { bot->sendRegistrationRequest(); });
 }
 
 void Client::messageHandler(ConnectionHdl hdl, MessagePtr msg) {
-    auto botIter = m_botList.find(hdl);
-    if (botIter == m_botList.end()) {
+    auto bot = findBot(hdl);
+    if (!bot) {
         std::cerr << "Message handler: bot and associated connection not found.\n";
         return;
     }
 
-    auto const &bot = botIter->second;
-    bot->processMessage(std::move(msg));
+    asio::post(bot->getStrand(),
+               [bot, msg = std::move(msg)]() mutable { bot->processMessage(std::move(msg)); });
 }
 
 std::shared_ptr<IBot>
 Client::makeBot(BotType type, std::string const &name, std::string const &uri) {
+    return makeBot(uri, [this, type, &name](ConnectionMetadata metadata, BotStrand strand) {
+        return makeNewBot(
+            type, name, std::move(metadata), shared_from_this(), std::move(strand));
+    });
+}
+
+std::shared_ptr<IBot> Client::makeBot(std::string const &uri, BotFactory const &factory) {
     websocketpp::lib::error_code ec;
     ClientConnectionPtr conPtr = get_connection(uri, ec);
     if (ec) {
@@ -79,22 +105,46 @@ Client::makeBot(BotType type, std::string const &name, std::string const &uri) {
     ConnectionMetadata metadata =
         ConnectionMetadata(handle, ConnectionMetadata::Status::Connecting, uriPtr);
 
-    connect(conPtr);
-
-    std::shared_ptr<IBot> bot = makeNewBot(type, name, metadata, shared_from_this());
+    std::shared_ptr<IBot> bot = factory(metadata, asio::make_strand(get_io_service()));
 
-    m_botList.insert(std::make_pair(handle, bot));
+    {
+        std::unique_lock lock(m_botListMutex);
+        m_botList.insert(std::make_pair(handle, bot));
+    }
+    // Handlers may run on another io thread as soon as the connection is started, the bot has
+    // to be registered first.
+    connect(conPtr);
     return bot;
 }
 
-int main() {
-    auto endpoint = std::make_shared<Client>();
+void Client::runThreads() {
+    std::vector<std::jthread> ioThreads;
+    for (std::size_t i = 1U; i < m_params.ioThreadCount; ++i) {
+        ioThreads.emplace_back([this]() { run(); });
+    }
+    run();
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && std::string_view(argv[1]) == "load") {
+        auto params = LoadGenerator::parseCommandLine(std::span(argv + 2, argc - 2));
+        if (!params) {
+            LoadGenerator::printUsage();
+            return 1;
+        }
+        LoadGenerator(std::move(*params)).run();
+        return 0;
+    }
+
+    unsigned threadCount = std::max(std::thread::hardware_concurrency(), 1U);
+    auto endpoint = std::make_shared<Client>(
+        Client::Params{.ioThreadCount = threadCount, .workerThreadCount = threadCount});
 
     auto bot1 = endpoint->makeBot(BotType::Random, "Nika", "ws://localhost:6359");
 
     auto bot2 = endpoint->makeBot(BotType::Random, "Matic", "ws://localhost:6359");
 
-    auto bot3 = endpoint->makeBot(BotType::Random, "Klara", "ws://localhost:6359");
+    auto bot3 = endpoint->makeBot(BotType::MonteCarlo, "Klara", "ws://localhost:6359");
 
-    endpoint->run();
+    endpoint->runThreads();
 }
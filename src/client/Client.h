@@ -6,37 +6,81 @@
 
 #include <websocketpp/common/memory.hpp>
 
+#include <cstddef>
+#include <functional>
 #include <iostream>
 #include <memory>
+#include <shared_mutex>
 #include <thread>
 #include <type_traits>
 #include <unordered_set>
 
+#include <asio/thread_pool.hpp>
+
 #include <game.pb.h>
 #include <google/protobuf/message.h>
 
 #include <client/Bot.h>
 #include <client/ClientTypes.h>
 #include <client/IBot.h>
+#include <client/RoundTripStatistics.h>
 #include <server/ConnectionMetadata.h>
 #include <server/GameManager.h>
 
+// Runs the io service on several threads. Handlers of one bot are serialized on the bot's
+// strand, while different bots are processed in parallel. Move computation is offloaded to a
+// separate worker pool, so that it never delays I/O of other bots.
 class Client : public ClientEndpoint, public std::enable_shared_from_this<Client> {
   public:
-    Client();
+    struct Params {
+        std::size_t ioThreadCount = 1U;
+        std::size_t workerThreadCount = 1U;
+    };
+
+    // Creates a bot for a connection that is about to be started.
+    using BotFactory =
+        std::function<std::shared_ptr<IBot>(ConnectionMetadata metadata, BotStrand strand)>;
+
+    explicit Client(Params params);
+    // Waits for queued move computations.
+    ~Client();
 
+    // Safe to call from any thread.
     std::shared_ptr<IBot>
     makeBot(BotType type, std::string const &name, std::string const &port);
+    std::shared_ptr<IBot> makeBot(std::string const &uri, BotFactory const &factory);
+
+    // Runs the io service on Params::ioThreadCount threads, the calling thread included.
+    // Blocks until the endpoint is stopped.
+    void runThreads();
+
+    asio::thread_pool::executor_type getWorkerExecutor() {
+        return m_workerPool.get_executor();
+    }
+
+    std::size_t getBotCount() const;
+
+    RoundTripStatistics &getRoundTripStatistics() { return m_roundTripStatistics; }
 
   private:
     void failHandler(ConnectionHdl hdl);
     void messageHandler(ConnectionHdl hdl, MessagePtr msg);
     void openHandler(ConnectionHdl hdl);
 
+    std::shared_ptr<IBot> findBot(ConnectionHdl hdl) const;
+
   private:
     using BotList =
         std::map<ConnectionHdl, std::shared_ptr<IBot>, std::owner_less<ConnectionHdl>>;
+
+    Params m_params;
+    asio::thread_pool m_workerPool;
+
+    // Bots are added while handlers of other bots run.
+    mutable std::shared_mutex m_botListMutex;
     BotList m_botList;
+
+    RoundTripStatistics m_roundTripStatistics;
 };
 
 #endif
\ No newline at end of file
@@ -1,10 +1,16 @@
 #ifndef CLIENT_TYPES_H
 #define CLIENT_TYPES_H
 
+#include <asio/io_context.hpp>
+#include <asio/strand.hpp>
+
 #include <websocketpp/client.hpp>
 #include <websocketpp/config/asio_no_tls_client.hpp>
 
 using ClientEndpoint = websocketpp::client<websocketpp::config::asio_client>;
 using ClientConnectionPtr = ClientEndpoint::connection_ptr;
 
+// Serializes the handlers of one bot while the io service runs on several threads.
+using BotStrand = asio::strand<asio::io_context::executor_type>;
+
 #endif
\ No newline at end of file
@@ -1,14 +1,18 @@
 #ifndef IBOT_H
 #define IBOT_H
 
+#include <chrono>
+#include <cstdint>
 #include <string>
 #include <type_traits>
 #include <unordered_set>
+#include <vector>
 
 #include <game.pb.h>
 #include <google/protobuf/message.h>
 
 #include <client/ClientTypes.h>
+#include <client/MoveSearch.h>
 #include <server/ConnectionMetadata.h>
 #include <server/GameManager.h>
 
@@ -32,7 +36,19 @@ struct IBot {
     virtual void
     processAvailableMovesResponse(game_proto::AvailableMovesResponse const &response) = 0;
 
+    // Starts searching for the next move of the game on a worker thread. The move is sent
+    // when the search returns, which is shortly after the budget at the latest. The search is
+    // cancelled if the game ends first.
+    virtual void requestMove(GameId const &gameId,
+                             std::vector<std::uint32_t> availableColumns,
+                             std::chrono::steady_clock::duration budget) = 0;
+    // Anytime move selection, runs on a worker thread. Must return one of the available
+    // columns, even if the search is already stopped when it starts.
+    virtual std::uint32_t searchMove(MoveSearch const &search) = 0;
+
     virtual ConnectionMetadata const &getConnectionMetadata() const = 0;
+    // All message processing of the bot runs on this strand.
+    virtual BotStrand const &getStrand() const = 0;
 
     virtual std::string const &getName() const = 0;
 };
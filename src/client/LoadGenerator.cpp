@@ -0,0 +1,444 @@
+#include "LoadGenerator.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <format>
+#include <iostream>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#include <asio/post.hpp>
+#include <asio/steady_timer.hpp>
+
+#include <client/Bot.h>
+#include <server/ConnectFourGame.h>
+#include <server/RandomUtils.h>
+#include <server/ShardUtils.h>
+
+namespace {
+using Clock = LoadGenerator::Clock;
+
+double sampleExponential(double mean) {
+    // The uniform sample may round up to one.
+    double uniform = std::min(double(getRandomUniformFloat()), 1.0 - 1e-7);
+    return -mean * std::log(1.0 - uniform);
+}
+
+std::string_view getLatencyTypeName(LoadGenerator::LatencyType type) {
+    switch (type) {
+    case LoadGenerator::LatencyType::Connect:
+        return "connect";
+    case LoadGenerator::LatencyType::NewGame:
+        return "new_game";
+    case LoadGenerator::LatencyType::Move:
+        return "move";
+    }
+    return "unknown";
+}
+
+template <typename T>
+bool parseNumber(std::string_view text, T &value) {
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return ec == std::errc() && end == text.data() + text.size();
+}
+
+double toMilliseconds(std::chrono::microseconds duration) {
+    return double(duration.count()) / 1000.0;
+}
+} // namespace
+
+// Plays one game at a time with random moves. All members are only accessed on the strand.
+class LoadBot : public RandomBot {
+  public:
+    LoadBot(Params params,
+            LoadGenerator &generator,
+            std::size_t botIdx,
+            Clock::time_point connectTime)
+        : RandomBot(std::move(params)), m_generator(generator), m_botIdx(botIdx),
+          m_connectTime(connectTime) {}
+
+    void requestNewGame(Clock::time_point intendedTime) {
+        m_newGameTime = intendedTime;
+        sendNewGameRequest();
+    }
+
+    void sendFirstMoveRequest(GameId const &gameId) override {
+        std::vector<std::uint32_t> columns(ConnectFourGame::ColumnCount);
+        for (std::uint32_t idx = 0U; idx < columns.size(); ++idx) {
+            columns[idx] = idx;
+        }
+        scheduleMove(gameId, std::move(columns));
+    }
+
+    void processAvailableMovesResponse(
+        game_proto::AvailableMovesResponse const &response) override {
+        scheduleMove(response.game_id(),
+                     std::vector<std::uint32_t>(response.column_idx().begin(),
+                                                response.column_idx().end()));
+    }
+
+  protected:
+    void processResponse(game_proto::Response const &message) override {
+        auto now = Clock::now();
+
+        if (message.has_registration_success_response()) {
+            m_generator.recordLatency(LoadGenerator::LatencyType::Connect,
+                                      now - m_connectTime);
+            m_generator.botRegistered(m_botIdx);
+            return;
+        }
+
+        if (message.has_new_game_response()) {
+            if (m_newGameTime) {
+                m_generator.recordLatency(LoadGenerator::LatencyType::NewGame,
+                                          now - *m_newGameTime);
+                m_newGameTime.reset();
+            }
+        } else if (message.has_available_games_response()) {
+            recordMoveLatency(message.available_games_response().game_id(), now);
+        } else if (message.has_game_end_response()) {
+            // Both players are notified, the first one observes the last move.
+            recordMoveLatency(message.game_end_response().game_id(), now);
+            m_generator.recordGameEnd();
+        } else if (message.has_error()) {
+            m_generator.recordError();
+            // A failed new game request would otherwise keep the bot busy forever.
+            if (m_newGameTime) {
+                m_newGameTime.reset();
+                m_generator.botIdle(m_botIdx);
+            }
+            return;
+        }
+
+        RandomBot::processResponse(message);
+
+        if (message.has_game_end_response()) {
+            m_generator.botIdle(m_botIdx);
+        }
+    }
+
+  private:
+    void recordMoveLatency(GameId gameId, Clock::time_point now) {
+        if (auto intendedTime = m_generator.takeScheduledMove(gameId)) {
+            m_generator.recordLatency(LoadGenerator::LatencyType::Move, now - *intendedTime);
+        }
+    }
+
+    void scheduleMove(GameId gameId, std::vector<std::uint32_t> columns) {
+        auto thinkTime = m_generator.sampleThinkTime();
+        auto intendedTime = Clock::now() + thinkTime;
+
+        auto timer = std::make_shared<asio::steady_timer>(getStrand(), thinkTime);
+        timer->async_wait([this, timer, gameId, intendedTime, columns = std::move(columns)](
+                              std::error_code const &ec) {
+            if (ec || columns.empty()) {
+                return;
+            }
+            // Registered before sending, the opponent may be notified before this returns.
+            m_generator.moveScheduled(gameId, intendedTime);
+            sendMoveRequest(gameId, columns[getRandomInt(columns.size() - 1U)]);
+        });
+    }
+
+  private:
+    LoadGenerator &m_generator;
+    std::size_t m_botIdx;
+    Clock::time_point m_connectTime;
+    // Intended send time of the pending new game request.
+    std::optional<Clock::time_point> m_newGameTime;
+};
+
+LoadGenerator::LoadGenerator(Params params)
+    : m_params(std::move(params)), m_client(std::make_shared<Client>(m_params.client)),
+      m_bots(m_params.botCount) {}
+
+LoadGenerator::~LoadGenerator() = default;
+
+void LoadGenerator::printUsage() {
+    std::cerr << "Usage: client load [options]\n"
+                 "  --uri=<uri>                     server uri, ws://localhost:6359\n"
+                 "  --bots=<count>                  connected bots, 100\n"
+                 "  --ramp-rate=<per second>        new connections per second, 100\n"
+                 "  --games-per-second=<rate>       open-loop game arrival rate, 10\n"
+                 "  --think-time-ms=<ms>            mean delay before each move, 100\n"
+                 "  --think-distribution=<name>     constant, uniform or exponential\n"
+                 "  --duration-s=<seconds>          measurement phase, 60\n"
+                 "  --drain-timeout-s=<seconds>     wait for running games, 10\n"
+                 "  --io-threads=<count>            default: hardware concurrency\n"
+                 "  --worker-threads=<count>        default: hardware concurrency\n";
+}
+
+auto LoadGenerator::parseCommandLine(std::span<char *const> args) -> std::optional<Params> {
+    Params params;
+    std::size_t threadCount = std::max(std::thread::hardware_concurrency(), 1U);
+    params.client = Client::Params{.ioThreadCount = threadCount,
+                                   .workerThreadCount = threadCount};
+
+    for (std::string_view arg : args) {
+        auto separator = arg.find('=');
+        if (!arg.starts_with("--") || separator == std::string_view::npos) {
+            std::cerr << std::format("Invalid argument {:s}.\n", arg);
+            return std::nullopt;
+        }
+        std::string_view name = arg.substr(2U, separator - 2U);
+        std::string_view value = arg.substr(separator + 1U);
+
+        bool valid = true;
+        std::int64_t number = 0;
+        if (name == "uri") {
+            params.uri = value;
+        } else if (name == "bots") {
+            valid = parseNumber(value, params.botCount);
+        } else if (name == "ramp-rate") {
+            valid = parseNumber(value, params.rampRate);
+        } else if (name == "games-per-second") {
+            valid = parseNumber(value, params.gamesPerSecond);
+        } else if (name == "think-time-ms") {
+            valid = parseNumber(value, number) && number >= 0;
+            params.thinkTime = std::chrono::milliseconds(number);
+        } else if (name == "think-distribution") {
+            if (value == "constant") {
+                params.thinkTimeDistribution = ThinkTimeDistribution::Constant;
+            } else if (value == "uniform") {
+                params.thinkTimeDistribution = ThinkTimeDistribution::Uniform;
+            } else if (value == "exponential") {
+                params.thinkTimeDistribution = ThinkTimeDistribution::Exponential;
+            } else {
+                valid = false;
+            }
+        } else if (name == "duration-s") {
+            valid = parseNumber(value, number) && number > 0;
+            params.duration = std::chrono::seconds(number);
+        } else if (name == "drain-timeout-s") {
+            valid = parseNumber(value, number) && number >= 0;
+            params.drainTimeout = std::chrono::seconds(number);
+        } else if (name == "io-threads") {
+            valid = parseNumber(value, params.client.ioThreadCount);
+        } else if (name == "worker-threads") {
+            valid = parseNumber(value, params.client.workerThreadCount);
+        } else {
+            std::cerr << std::format("Unknown option {:s}.\n", name);
+            return std::nullopt;
+        }
+
+        if (!valid) {
+            std::cerr << std::format("Invalid value {:s} of option {:s}.\n", value, name);
+            return std::nullopt;
+        }
+    }
+
+    if (params.botCount < 2U || params.rampRate <= 0.0 || params.gamesPerSecond <= 0.0 ||
+        params.client.ioThreadCount == 0U || params.client.workerThreadCount == 0U) {
+        std::cerr << "At least two bots, positive rates and thread counts are required.\n";
+        return std::nullopt;
+    }
+    return params;
+}
+
+void LoadGenerator::run() {
+    std::jthread ioThread([this]() { m_client->runThreads(); });
+
+    auto rampStart = Clock::now();
+    for (std::size_t botIdx = 0U; botIdx < m_params.botCount; ++botIdx) {
+        auto intendedTime =
+            rampStart + std::chrono::duration_cast<Clock::duration>(
+                            std::chrono::duration<double>(double(botIdx) / m_params.rampRate));
+        std::this_thread::sleep_until(intendedTime);
+        connectBot(botIdx, intendedTime);
+    }
+    std::cout << std::format("Started {:d} connections, {:d} bots registered.\n",
+                             m_params.botCount,
+                             m_registeredBotCount.load());
+
+    // Every game takes two new game requests.
+    double meanInterval = 1.0 / (2.0 * m_params.gamesPerSecond);
+    auto start = Clock::now();
+    auto end = start + m_params.duration;
+    for (auto intendedTime = start;;) {
+        intendedTime += std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(sampleExponential(meanInterval)));
+        if (intendedTime >= end) {
+            break;
+        }
+        // When the generator falls behind, requests keep their intended time.
+        std::this_thread::sleep_until(intendedTime);
+        enqueueNewGameRequest(intendedTime);
+    }
+    std::this_thread::sleep_until(end);
+
+    {
+        std::lock_guard<std::mutex> lock(m_dispatchMutex);
+        m_unsentRequestCount = m_backlog.size();
+        m_backlog.clear();
+    }
+    if (!waitForIdleBots(m_params.drainTimeout)) {
+        std::cout << "Drain timeout passed with games still running.\n";
+    }
+    auto measuredDuration = Clock::now() - start;
+
+    m_client->stop();
+    ioThread.join();
+
+    printReport(measuredDuration);
+}
+
+void LoadGenerator::connectBot(std::size_t botIdx, Clock::time_point intendedTime) {
+    // Unique per run, so that previous runs' players are not reused.
+    static auto const runId = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                  std::chrono::system_clock::now().time_since_epoch())
+                                  .count();
+
+    m_client->makeBot(m_params.uri, [&](ConnectionMetadata metadata, BotStrand strand) {
+        auto bot = std::make_shared<LoadBot>(
+            BotBase::Params{.name = std::format("load_{:x}_{:d}", runId, botIdx),
+                            .metadata = std::move(metadata),
+                            .endpoint = m_client,
+                            .strand = std::move(strand),
+                            .verbose = false},
+            *this,
+            botIdx,
+            intendedTime);
+        m_bots[botIdx] = bot;
+        return bot;
+    });
+}
+
+void LoadGenerator::enqueueNewGameRequest(Clock::time_point intendedTime) {
+    std::lock_guard<std::mutex> lock(m_dispatchMutex);
+    ++m_requestCount;
+    m_backlog.push_back(intendedTime);
+    dispatchNewGameRequests();
+}
+
+void LoadGenerator::dispatchNewGameRequests() {
+    while (!m_backlog.empty() && !m_idleBots.empty()) {
+        std::shared_ptr<LoadBot> const &bot = m_bots[m_idleBots.front()];
+        m_idleBots.pop_front();
+        Clock::time_point intendedTime = m_backlog.front();
+        m_backlog.pop_front();
+        ++m_busyBotCount;
+
+        asio::post(bot->getStrand(),
+                   [bot, intendedTime]() { bot->requestNewGame(intendedTime); });
+    }
+}
+
+bool LoadGenerator::waitForIdleBots(Clock::duration timeout) {
+    auto deadline = Clock::now() + timeout;
+    while (Clock::now() < deadline) {
+        {
+            std::lock_guard<std::mutex> lock(m_dispatchMutex);
+            if (m_busyBotCount == 0U) {
+                return true;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return false;
+}
+
+void LoadGenerator::botRegistered(std::size_t botIdx) {
+    m_registeredBotCount.fetch_add(1U, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(m_dispatchMutex);
+    m_idleBots.push_back(botIdx);
+    dispatchNewGameRequests();
+}
+
+void LoadGenerator::botIdle(std::size_t botIdx) {
+    std::lock_guard<std::mutex> lock(m_dispatchMutex);
+    --m_busyBotCount;
+    m_idleBots.push_back(botIdx);
+    dispatchNewGameRequests();
+}
+
+void LoadGenerator::recordLatency(LatencyType type, Clock::duration latency) {
+    m_latencies[std::size_t(type)].record(latency);
+}
+
+void LoadGenerator::recordError() { m_errorCount.fetch_add(1U, std::memory_order_relaxed); }
+
+void LoadGenerator::recordGameEnd() {
+    m_gameEndCount.fetch_add(1U, std::memory_order_relaxed);
+}
+
+void LoadGenerator::moveScheduled(GameId gameId, Clock::time_point intendedTime) {
+    auto &shard = m_moveShards[getShardIndex(gameId, MoveShardCount)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.scheduledMoves[gameId] = intendedTime;
+}
+
+auto LoadGenerator::takeScheduledMove(GameId gameId) -> std::optional<Clock::time_point> {
+    auto &shard = m_moveShards[getShardIndex(gameId, MoveShardCount)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto iter = shard.scheduledMoves.find(gameId);
+    if (iter == shard.scheduledMoves.end()) {
+        return std::nullopt;
+    }
+    Clock::time_point intendedTime = iter->second;
+    shard.scheduledMoves.erase(iter);
+    return intendedTime;
+}
+
+Clock::duration LoadGenerator::sampleThinkTime() const {
+    double mean = std::chrono::duration<double>(m_params.thinkTime).count();
+    double seconds = mean;
+    switch (m_params.thinkTimeDistribution) {
+    case ThinkTimeDistribution::Constant:
+        break;
+    case ThinkTimeDistribution::Uniform:
+        seconds = 2.0 * mean * double(getRandomUniformFloat());
+        break;
+    case ThinkTimeDistribution::Exponential:
+        seconds = sampleExponential(mean);
+        break;
+    }
+    return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+}
+
+void LoadGenerator::printReport(Clock::duration measuredDuration) const {
+    double seconds = std::chrono::duration<double>(measuredDuration).count();
+    // Both players of a game are driven by this generator.
+    double gameCount = double(m_gameEndCount.load()) / 2.0;
+
+    std::cout << std::format("Measured {:.1f} s.\n", seconds);
+    std::cout << std::format("Bots registered: {:d} of {:d}.\n",
+                             m_registeredBotCount.load(),
+                             m_params.botCount);
+    std::cout << std::format("New game requests: {:d} scheduled, {:d} never sent because no "
+                             "bot was idle.\n",
+                             m_requestCount,
+                             m_unsentRequestCount);
+    std::cout << std::format("Games finished: {:.0f}, {:.2f} games/s (target {:.2f}).\n",
+                             gameCount,
+                             gameCount / seconds,
+                             m_params.gamesPerSecond);
+    std::cout << std::format("Error responses: {:d}.\n\n", m_errorCount.load());
+
+    std::cout << std::format("{:<10s}{:>10s}{:>10s}{:>10s}{:>10s}{:>10s}{:>10s}{:>10s}\n",
+                             "latency",
+                             "count",
+                             "mean ms",
+                             "p50",
+                             "p90",
+                             "p99",
+                             "p99.9",
+                             "max");
+    for (std::size_t idx = 0U; idx < LatencyTypeCount; ++idx) {
+        LatencyHistogram const &histogram = m_latencies[idx];
+        std::cout << std::format(
+            "{:<10s}{:>10d}{:>10.3f}{:>10.3f}{:>10.3f}{:>10.3f}{:>10.3f}{:>10.3f}\n",
+            getLatencyTypeName(LatencyType(idx)),
+            histogram.getCount(),
+            toMilliseconds(histogram.getMean()),
+            toMilliseconds(histogram.getPercentile(50.0)),
+            toMilliseconds(histogram.getPercentile(90.0)),
+            toMilliseconds(histogram.getPercentile(99.0)),
+            toMilliseconds(histogram.getPercentile(99.9)),
+            toMilliseconds(histogram.getMax()));
+    }
+
+    std::cout << "\n";
+    m_client->getRoundTripStatistics().print(std::cout);
+}
@@ -0,0 +1,128 @@
+#ifndef LOAD_GENERATOR_H
+#define LOAD_GENERATOR_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <client/Client.h>
+#include <server/LatencyHistogram.h>
+#include <server/GameManager.h>
+
+class LoadBot;
+
+// Capacity test driver. Connects bots at a fixed ramp rate and then issues new game requests
+// open-loop: arrival times are drawn from a Poisson process independent of server responses,
+// and latencies are measured from the intended send time, so a slow server can not hide its
+// latency by slowing the generator down (coordinated omission).
+class LoadGenerator {
+  public:
+    enum class ThinkTimeDistribution : std::uint8_t { Constant, Uniform, Exponential };
+
+    struct Params {
+        std::string uri = "ws://localhost:6359";
+        std::size_t botCount = 100U;
+        // New connections per second.
+        double rampRate = 100.0;
+        double gamesPerSecond = 10.0;
+        // Delay before each move, uniform samples lie in [0, 2 * mean].
+        std::chrono::milliseconds thinkTime{100};
+        ThinkTimeDistribution thinkTimeDistribution = ThinkTimeDistribution::Exponential;
+        // Measurement phase, it starts once all bots are connected.
+        std::chrono::seconds duration{60};
+        // Time given to running games once no new games are requested.
+        std::chrono::seconds drainTimeout{10};
+        Client::Params client;
+    };
+
+    enum class LatencyType : std::uint8_t {
+        // From the scheduled connection time to the registration response.
+        Connect,
+        // From the scheduled request time to the new game response, including matchmaking.
+        NewGame,
+        // From the scheduled move time to the notification of the opponent.
+        Move,
+    };
+    constexpr static std::size_t LatencyTypeCount = 3U;
+
+    using GameId = GameManager::GameId;
+    using Clock = std::chrono::steady_clock;
+
+    explicit LoadGenerator(Params params);
+    ~LoadGenerator();
+
+    LoadGenerator(LoadGenerator const &) = delete;
+    LoadGenerator &operator=(LoadGenerator const &) = delete;
+
+    // Parses "--name=value" options. Prints the error and returns nullopt on invalid input.
+    static std::optional<Params> parseCommandLine(std::span<char *const> args);
+    static void printUsage();
+
+    // Runs the whole test and prints the report. Blocks until it is finished.
+    void run();
+
+    // Called by the bots, from their strands.
+    void recordLatency(LatencyType type, Clock::duration latency);
+    void recordError();
+    void recordGameEnd();
+    void botRegistered(std::size_t botIdx);
+    // The bot finished its game or its new game request failed.
+    void botIdle(std::size_t botIdx);
+    void moveScheduled(GameId gameId, Clock::time_point intendedTime);
+    std::optional<Clock::time_point> takeScheduledMove(GameId gameId);
+    Clock::duration sampleThinkTime() const;
+
+  private:
+    void connectBot(std::size_t botIdx, Clock::time_point intendedTime);
+    void enqueueNewGameRequest(Clock::time_point intendedTime);
+    // Hands backlogged requests to idle bots. Expects m_dispatchMutex to be held.
+    void dispatchNewGameRequests();
+    // Returns false if bots are still busy when the timeout passes.
+    bool waitForIdleBots(std::chrono::steady_clock::duration timeout);
+    void printReport(Clock::duration measuredDuration) const;
+
+  private:
+    constexpr static std::size_t MoveShardCount = 32U;
+
+    // Moves of a game are scheduled by one bot and observed by its opponent.
+    struct alignas(64) MoveShard {
+        std::mutex mutex;
+        std::unordered_map<GameId, Clock::time_point> scheduledMoves;
+    };
+
+    Params m_params;
+    std::shared_ptr<Client> m_client;
+
+    // Written before the connection of the bot is started.
+    std::vector<std::shared_ptr<LoadBot>> m_bots;
+
+    std::mutex m_dispatchMutex;
+    std::deque<std::size_t> m_idleBots;
+    // Intended send times of requests that wait for an idle bot.
+    std::deque<Clock::time_point> m_backlog;
+    // Bots waiting for a game or playing one.
+    std::size_t m_busyBotCount = 0U;
+    std::uint64_t m_requestCount = 0U;
+    // Requests still in the backlog when the measurement phase ended.
+    std::uint64_t m_unsentRequestCount = 0U;
+
+    std::array<MoveShard, MoveShardCount> m_moveShards;
+
+    std::array<LatencyHistogram, LatencyTypeCount> m_latencies;
+    std::atomic<std::uint64_t> m_errorCount = 0U;
+    std::atomic<std::uint64_t> m_gameEndCount = 0U;
+    std::atomic<std::uint64_t> m_registeredBotCount = 0U;
+};
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef MOVE_SEARCH_H
+#define MOVE_SEARCH_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include <server/ConnectFourGame.h>
+
+// A move computation requested by a bot. The position is a snapshot, so the search can run
+// on a worker thread while the bot keeps processing messages. Searches are anytime: they poll
+// shouldStop() between iterations and return the best move found so far.
+class MoveSearch {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    MoveSearch(ConnectFourGame position,
+               std::vector<std::uint32_t> availableColumns,
+               Clock::time_point deadline)
+        : m_position(std::move(position)), m_availableColumns(std::move(availableColumns)),
+          m_deadline(deadline) {}
+
+    ConnectFourGame const &getPosition() const { return m_position; }
+    // Never empty.
+    std::span<std::uint32_t const> getAvailableColumns() const { return m_availableColumns; }
+    Clock::time_point getDeadline() const { return m_deadline; }
+
+    bool isPlayer1ToMove() const { return m_position.getMoveCount() % 2U == 0U; }
+
+    // True once the deadline has passed or the game has ended.
+    bool shouldStop() const { return isCancelled() || Clock::now() >= m_deadline; }
+
+    // Safe to call from any thread.
+    void cancel() { m_cancelled.store(true, std::memory_order_relaxed); }
+    bool isCancelled() const { return m_cancelled.load(std::memory_order_relaxed); }
+
+  private:
+    ConnectFourGame m_position;
+    std::vector<std::uint32_t> m_availableColumns;
+    Clock::time_point m_deadline;
+    std::atomic<bool> m_cancelled = false;
+};
+
+#endif
@@ -0,0 +1,77 @@
+#include "RoundTripStatistics.h"
+
+#include <chrono>
+#include <format>
+#include <string>
+
+#include <google/protobuf/descriptor.h>
+
+namespace {
+std::chrono::nanoseconds getInterval(std::uint64_t from, std::uint64_t to) {
+    // Missing or reordered timestamps are reported as zero.
+    return std::chrono::nanoseconds(to > from ? to - from : 0U);
+}
+
+double toMilliseconds(std::chrono::microseconds duration) {
+    return double(duration.count()) / 1000.0;
+}
+
+std::string getResponseTypeName(std::size_t type) {
+    auto const *field = game_proto::Response::descriptor()->FindFieldByNumber(int(type));
+    return field ? field->name() : std::format("response_{:d}", type);
+}
+} // namespace
+
+void RoundTripStatistics::record(game_proto::Response::ResponseCase type,
+                                 game_proto::Trace const &trace,
+                                 std::uint64_t receiveTime) {
+    auto idx = std::size_t(type);
+    if (idx >= MaxResponseTypeCount) {
+        return;
+    }
+    Histograms &histograms = m_histograms[idx];
+
+    auto roundTrip = getInterval(trace.client_send_time(), receiveTime);
+    auto serverTotal = getInterval(trace.server_receive_time(), trace.server_send_time());
+    histograms.roundTrip.record(roundTrip);
+    histograms.serverQueue.record(
+        getInterval(trace.server_receive_time(), trace.server_dequeue_time()));
+    histograms.serverHandling.record(
+        getInterval(trace.server_dequeue_time(), trace.server_send_time()));
+    histograms.networkAndClient.record(roundTrip > serverTotal ? roundTrip - serverTotal
+                                                               : std::chrono::nanoseconds(0));
+}
+
+void RoundTripStatistics::print(std::ostream &out) const {
+    out << std::format("{:<30s}{:<16s}{:>10s}{:>10s}{:>10s}{:>10s}{:>10s}\n",
+                       "round trip (ms)",
+                       "part",
+                       "count",
+                       "p50",
+                       "p99",
+                       "p99.9",
+                       "max");
+
+    auto printRow = [&out](std::string const &type, char const *part, auto const &histogram) {
+        out << std::format("{:<30s}{:<16s}{:>10d}{:>10.3f}{:>10.3f}{:>10.3f}{:>10.3f}\n",
+                           type,
+                           part,
+                           histogram.getCount(),
+                           toMilliseconds(histogram.getPercentile(50.0)),
+                           toMilliseconds(histogram.getPercentile(99.0)),
+                           toMilliseconds(histogram.getPercentile(99.9)),
+                           toMilliseconds(histogram.getMax()));
+    };
+
+    for (std::size_t idx = 0U; idx < MaxResponseTypeCount; ++idx) {
+        Histograms const &histograms = m_histograms[idx];
+        if (histograms.roundTrip.getCount() == 0U) {
+            continue;
+        }
+        std::string type = getResponseTypeName(idx);
+        printRow(type, "total", histograms.roundTrip);
+        printRow(type, "server queue", histograms.serverQueue);
+        printRow(type, "server handling", histograms.serverHandling);
+        printRow(type, "network, client", histograms.networkAndClient);
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef ROUND_TRIP_STATISTICS_H
+#define ROUND_TRIP_STATISTICS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+#include <game.pb.h>
+
+#include <server/LatencyHistogram.h>
+
+// Round trip times of traced requests, keyed by the type of the response that echoed the
+// trace. Every round trip is split into server side queueing, server side handling and the
+// remainder, which is network and client time. Safe to record from any thread.
+class RoundTripStatistics {
+  public:
+    // Receive time is the client's monotonic time at which the response arrived.
+    void record(game_proto::Response::ResponseCase type,
+                game_proto::Trace const &trace,
+                std::uint64_t receiveTime);
+
+    void print(std::ostream &out) const;
+
+  private:
+    struct Histograms {
+        LatencyHistogram roundTrip;
+        LatencyHistogram serverQueue;
+        LatencyHistogram serverHandling;
+        LatencyHistogram networkAndClient;
+    };
+
+    // Larger than the number of response types.
+    constexpr static std::size_t MaxResponseTypeCount = 16U;
+
+    std::array<Histograms, MaxResponseTypeCount> m_histograms;
+};
+
+#endif
@@ -0,0 +1,166 @@
+#include "AdmissionControl.h"
+
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <utility>
+
+#include <game.pb.h>
+#include <server/MonotonicTime.h>
+#include <server/ShardUtils.h>
+
+std::uint64_t TokenBucket::getTolerance(RateLimit const &limit) {
+    return std::uint64_t(double(getInterval(limit)) * std::max(limit.burst - 1.0, 0.0));
+}
+
+bool TokenBucket::canAcquire(RateLimit const &limit, std::uint64_t now) const {
+    if (limit.requestsPerSecond <= 0.0) {
+        return true;
+    }
+    std::uint64_t start = std::max(m_fullTime.load(std::memory_order_relaxed), now);
+    return start - now <= getTolerance(limit);
+}
+
+bool TokenBucket::tryAcquire(RateLimit const &limit, std::uint64_t now) {
+    if (limit.requestsPerSecond <= 0.0) {
+        return true;
+    }
+    std::uint64_t interval = getInterval(limit);
+    std::uint64_t tolerance = getTolerance(limit);
+
+    std::uint64_t fullTime = m_fullTime.load(std::memory_order_relaxed);
+    while (true) {
+        std::uint64_t start = std::max(fullTime, now);
+        if (start - now > tolerance) {
+            return false;
+        }
+        if (m_fullTime.compare_exchange_weak(
+                fullTime, start + interval, std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+}
+
+AdmissionControl::AdmissionControl(Params params) : m_params(std::move(params)) {}
+
+auto AdmissionControl::getShard(ConnectionId id) -> Shard & {
+    return m_shards[getShardIndex(std::hash<ConnectionId>{}(id), ShardCount)];
+}
+
+auto AdmissionControl::admit(ConnectionId id, std::string_view payload) -> Decision {
+    std::uint64_t now = getMonotonicNanoseconds();
+    std::size_t requestType = std::min(peekRequestType(payload), MaxRequestTypeCount - 1U);
+
+    Shard &shard = getShard(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    ConnectionLimits &limits = shard.connections[id];
+
+    // Connection limits come first, so that a flooding client does not drain the global
+    // bucket. They are only charged once the request passed all limits, so that a rejected
+    // request spends no token of the connection. The buckets of a connection are only used
+    // under the shard lock.
+    TokenBucket &typeBucket = limits.requestTypes[requestType];
+    RateLimit const &typeLimit = m_params.requestTypes[requestType];
+    if (!typeBucket.canAcquire(typeLimit, now) ||
+        !limits.connection.canAcquire(m_params.connection, now)) {
+        return reject(limits, Decision::RateLimited);
+    }
+    if (Decision decision = admitGlobally(now); decision != Decision::Admitted) {
+        return reject(limits, decision);
+    }
+
+    typeBucket.tryAcquire(typeLimit, now);
+    limits.connection.tryAcquire(m_params.connection, now);
+    limits.lastRejection = Decision::Admitted;
+    return Decision::Admitted;
+}
+
+auto AdmissionControl::admitGlobally(std::uint64_t now) -> Decision {
+    if (!m_global.tryAcquire(m_params.global, now)) {
+        return Decision::Overloaded;
+    }
+    std::size_t queued = m_queuedRequests.fetch_add(1U, std::memory_order_relaxed);
+    if (m_params.maxQueuedRequests != 0U && queued >= m_params.maxQueuedRequests) {
+        release();
+        return Decision::Overloaded;
+    }
+    return Decision::Admitted;
+}
+
+auto AdmissionControl::reject(ConnectionLimits &limits, Decision decision) -> Decision {
+    if (std::exchange(limits.lastRejection, decision) == decision) {
+        return Decision::RejectedSilently;
+    }
+    return decision;
+}
+
+void AdmissionControl::removeConnection(ConnectionId id) {
+    Shard &shard = getShard(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.connections.erase(id);
+}
+
+std::size_t AdmissionControl::peekRequestType(std::string_view payload) {
+    // Field numbers of the request oneof, looked up once.
+    static std::array<bool, MaxRequestTypeCount> const requestFields = []() {
+        std::array<bool, MaxRequestTypeCount> fields{};
+        auto const *oneof = game_proto::Request::descriptor()->FindOneofByName("Request");
+        for (int i = 0; oneof && i < oneof->field_count(); ++i) {
+            auto number = std::size_t(oneof->field(i)->number());
+            if (number < fields.size()) {
+                fields[number] = true;
+            }
+        }
+        return fields;
+    }();
+
+    std::size_t offset = 0U;
+    auto readVarint = [&payload, &offset](std::uint64_t &value) {
+        value = 0U;
+        for (unsigned shift = 0U; shift < 64U && offset < payload.size(); shift += 7U) {
+            auto byte = std::uint8_t(payload[offset++]);
+            value |= std::uint64_t(byte & 0x7FU) << shift;
+            if (!(byte & 0x80U)) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    std::size_t requestType = 0U;
+    while (offset < payload.size()) {
+        // Field key varint, the field number are the bits above the three wire type bits.
+        std::uint64_t key = 0U;
+        if (!readVarint(key)) {
+            return 0U;
+        }
+        std::uint64_t fieldNumber = key >> 3U;
+        std::uint64_t value = 0U;
+        switch (key & 0x7U) {
+        case 0U:
+            if (!readVarint(value)) {
+                return 0U;
+            }
+            break;
+        case 1U:
+            offset += 8U;
+            break;
+        case 2U:
+            if (!readVarint(value) || value > payload.size() - offset) {
+                return 0U;
+            }
+            offset += std::size_t(value);
+            if (fieldNumber < requestFields.size() && requestFields[fieldNumber]) {
+                requestType = std::size_t(fieldNumber);
+            }
+            break;
+        case 5U:
+            offset += 4U;
+            break;
+        default:
+            // Groups are not used by the protocol.
+            return 0U;
+        }
+    }
+    return offset == payload.size() ? requestType : 0U;
+}
@@ -0,0 +1,110 @@
+#ifndef ADMISSION_CONTROL_H
+#define ADMISSION_CONTROL_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+
+#include <server/ConnectionId.h>
+
+struct RateLimit {
+    // Zero disables the limit.
+    double requestsPerSecond = 0.0;
+    // Requests accepted at once after an idle period.
+    double burst = 1.0;
+};
+
+// Lock-free token bucket, implemented as a generic cell rate algorithm: instead of a token
+// count it stores the time at which the bucket is full again, so that refilling needs no
+// background work and a request is a single compare and swap.
+class TokenBucket {
+  public:
+    bool tryAcquire(RateLimit const &limit, std::uint64_t now);
+    // Whether tryAcquire would succeed now, without taking a token.
+    bool canAcquire(RateLimit const &limit, std::uint64_t now) const;
+
+  private:
+    static std::uint64_t getInterval(RateLimit const &limit) {
+        return std::uint64_t(1e9 / limit.requestsPerSecond);
+    }
+    static std::uint64_t getTolerance(RateLimit const &limit);
+
+
+    std::atomic<std::uint64_t> m_fullTime = 0U;
+};
+
+// Decides on the I/O thread whether a request is handed to the thread pool, before any work
+// is queued for it. Requests are limited per connection, per connection and request type and
+// globally, and are shed once too many are queued. Safe to call from any thread.
+class AdmissionControl {
+  public:
+    // Larger than the highest request type (field number of the request).
+    constexpr static std::size_t MaxRequestTypeCount = 16U;
+
+    struct Params {
+        RateLimit global = {};
+        RateLimit connection = {.requestsPerSecond = 50.0, .burst = 100.0};
+        // Additional limits of single request types of a connection, indexed by the field
+        // number of the request.
+        std::array<RateLimit, MaxRequestTypeCount> requestTypes = {};
+        // Admitted requests that are queued or being handled. Zero disables load shedding.
+        std::size_t maxQueuedRequests = 100000U;
+    };
+
+    enum class Decision : std::uint8_t {
+        Admitted,
+        // Rejected by a limit of the connection.
+        RateLimited,
+        // Rejected by the global limit or the queue depth.
+        Overloaded,
+        // The client is only told about the first rejection of a run with the same reason,
+        // so that a flood does not produce a reply flood.
+        RejectedSilently,
+    };
+
+    explicit AdmissionControl(Params params);
+
+    Decision admit(ConnectionId id, std::string_view payload);
+    // Must be called once for every admitted request when its handler finishes.
+    void release() { m_queuedRequests.fetch_sub(1U, std::memory_order_relaxed); }
+
+    void removeConnection(ConnectionId id);
+
+    // Request type is the field number of the request in the oneof of game_proto::Request.
+    // All top level fields are scanned, since fields may come in any order, and the last
+    // request wins like in the parser. Returns zero if there is none or the payload is
+    // malformed.
+    static std::size_t peekRequestType(std::string_view payload);
+
+  private:
+    static constexpr std::size_t ShardCount = 32U;
+
+    struct ConnectionLimits {
+        TokenBucket connection;
+        std::array<TokenBucket, MaxRequestTypeCount> requestTypes;
+        // Reason of the current run of rejections, Admitted if there is none.
+        Decision lastRejection = Decision::Admitted;
+    };
+
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        std::unordered_map<ConnectionId, ConnectionLimits> connections;
+    };
+
+    Shard &getShard(ConnectionId id);
+    // Global limits of a request that is within the limits of its connection.
+    Decision admitGlobally(std::uint64_t now);
+    static Decision reject(ConnectionLimits &limits, Decision decision);
+
+  private:
+    Params m_params;
+    TokenBucket m_global;
+    std::atomic<std::size_t> m_queuedRequests = 0U;
+    std::array<Shard, ShardCount> m_shards;
+};
+
+#endif
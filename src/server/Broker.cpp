@@ -0,0 +1,251 @@
+#include "Broker.h"
+
+#include <exception>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <asio/co_spawn.hpp>
+#include <asio/detached.hpp>
+#include <asio/steady_timer.hpp>
+#include <asio/use_awaitable.hpp>
+
+#include <game.pb.h>
+#include <server/RandomUtils.h>
+
+namespace {
+constexpr std::string_view UnixScheme = "unix://";
+
+asio::basic_socket_acceptor<ClusterLink::Protocol> makeAcceptor(asio::io_context &context,
+                                                                std::string_view endpoint) {
+    auto parsed = ClusterLink::parseEndpoint(endpoint);
+    if (endpoint.starts_with(UnixScheme)) {
+        // Left behind by a previous broker, binding fails while it exists.
+        std::error_code ec;
+        std::filesystem::remove(endpoint.substr(UnixScheme.size()), ec);
+    }
+    return asio::basic_socket_acceptor<ClusterLink::Protocol>(context, parsed);
+}
+} // namespace
+
+Broker::Broker(Params params)
+    : m_params(std::move(params)), m_acceptor(makeAcceptor(m_context, m_params.endpoint)),
+      m_matchmakingQueue(m_params.matchmaking) {}
+
+void Broker::run() {
+    asio::co_spawn(m_context, acceptLoop(), asio::detached);
+    asio::co_spawn(m_context, runMatchmakingLoop(), asio::detached);
+    std::cout << std::format("Broker is listening on {:s}.\n", m_params.endpoint);
+    m_context.run();
+}
+
+void Broker::stop() { m_context.stop(); }
+
+asio::awaitable<void> Broker::acceptLoop() {
+    while (true) {
+        ClusterLink::Protocol::socket socket(m_context);
+        try {
+            socket = co_await m_acceptor.async_accept(asio::use_awaitable);
+        } catch (std::exception const &e) {
+            std::cerr << std::format("Failed to accept shard with error: {:s}.\n", e.what());
+            continue;
+        }
+
+        auto link = std::make_shared<ClusterLink>(std::move(socket));
+        // Handlers run on the broker thread. The link is captured weakly, it owns them.
+        std::weak_ptr<ClusterLink> weakLink = link;
+        link->start(
+            [this, weakLink](cluster_proto::ClusterMessage const &message) {
+                if (auto link = weakLink.lock()) {
+                    onMessage(link, message);
+                }
+            },
+            [this, weakLink]() {
+                if (auto link = weakLink.lock()) {
+                    onLinkClosed(link);
+                }
+            });
+    }
+}
+
+asio::awaitable<void> Broker::runMatchmakingLoop() {
+    asio::steady_timer timer(m_context);
+    while (true) {
+        timer.expires_after(m_matchmakingQueue.getPassInterval());
+        co_await timer.async_wait(asio::use_awaitable);
+        for (auto [player1, player2] : m_matchmakingQueue.pairQueuedPlayers()) {
+            createGame(player1, player2);
+        }
+    }
+}
+
+void Broker::onMessage(LinkPtr const &link, cluster_proto::ClusterMessage const &message) {
+    if (message.has_hello()) {
+        return onHello(link, message.hello());
+    }
+
+    auto origin = m_linkShards.find(link.get());
+    if (origin == m_linkShards.end()) {
+        std::cerr << "Dropped cluster message of a shard that did not say hello.\n";
+        return;
+    }
+
+    if (message.has_match_request()) {
+        onMatchRequest(message.match_request());
+    } else if (message.has_forward_request()) {
+        auto const &request = message.forward_request();
+        if (!sendToShard(request.shard(), message)) {
+            sendError(request.connection(), "Server of the game is not available.");
+        }
+    } else if (message.has_forward_response()) {
+        // Clients of a shard that is gone are gone as well.
+        sendToShard(message.forward_response().shard(), message);
+    } else if (message.has_connection_closed()) {
+        onConnectionClosed(origin->second, message.connection_closed());
+    }
+}
+
+void Broker::onHello(LinkPtr const &link, cluster_proto::Hello const &hello) {
+    ShardIndex shard = hello.shard();
+    if (shard >= MaxShardCount || m_shards.contains(shard) ||
+        m_linkShards.contains(link.get())) {
+        std::cerr << std::format("Rejected shard {:d}, it is invalid or already connected.\n",
+                                 shard);
+        return link->close();
+    }
+
+    m_shards.emplace(shard, link);
+    m_linkShards.emplace(link.get(), shard);
+    m_ring.addShard(shard);
+    std::cout << std::format("Shard {:d} connected.\n", shard);
+}
+
+void Broker::onLinkClosed(LinkPtr const &link) {
+    auto iter = m_linkShards.find(link.get());
+    if (iter == m_linkShards.end()) {
+        return;
+    }
+    ShardIndex shard = iter->second;
+    m_linkShards.erase(iter);
+    m_shards.erase(shard);
+    // Only the games of the shard move, new games of the other shards stay where they are.
+    m_ring.removeShard(shard);
+
+    std::vector<PlayerId> orphans;
+    for (auto const &[player, clusterPlayer] : m_waitingPlayers) {
+        if (getConnectionShard(clusterPlayer.connection()) == shard) {
+            orphans.push_back(player);
+        }
+    }
+    for (PlayerId player : orphans) {
+        m_matchmakingQueue.remove(player);
+        removeWaitingPlayer(player);
+    }
+    std::cout << std::format("Shard {:d} disconnected.\n", shard);
+}
+
+void Broker::onMatchRequest(cluster_proto::MatchRequest const &request) {
+    auto const &clusterPlayer = request.player();
+    if (m_waitingConnections.contains(clusterPlayer.connection())) {
+        return sendError(clusterPlayer.connection(), "Player is already waiting for a game.");
+    }
+
+    PlayerId player = m_nextPlayerId++;
+    m_waitingPlayers.emplace(player, clusterPlayer);
+    m_waitingConnections.emplace(clusterPlayer.connection(), player);
+
+    if (m_params.matchmaking.mode == MatchmakingQueue::Mode::Batched) {
+        // Player will be paired in the next matchmaking pass.
+        m_matchmakingQueue.enqueue(player, clusterPlayer.rating());
+        return;
+    }
+    PlayerId opponent = m_matchmakingQueue.matchOrEnqueue(player, clusterPlayer.rating());
+    if (opponent != InvalidPlayerId) {
+        createGame(player, opponent);
+    }
+}
+
+void Broker::onConnectionClosed(ShardIndex origin,
+                                cluster_proto::ConnectionClosed const &closed) {
+    auto waiting = m_waitingConnections.find(closed.connection());
+    if (waiting != m_waitingConnections.end()) {
+        PlayerId player = waiting->second;
+        m_matchmakingQueue.remove(player);
+        removeWaitingPlayer(player);
+    }
+
+    // Any other shard may own a game of the client.
+    cluster_proto::ClusterMessage message;
+    *message.mutable_connection_closed() = closed;
+    for (auto const &[shard, link] : m_shards) {
+        if (shard != origin) {
+            link->send(message);
+        }
+    }
+}
+
+void Broker::createGame(PlayerId player1, PlayerId player2) {
+    // Choose first move player. First player always starts.
+    if (getRandomBool()) {
+        std::swap(player1, player2);
+    }
+
+    cluster_proto::ClusterMessage message;
+    auto &createGame = *message.mutable_create_game();
+    *createGame.mutable_player1() = takeWaitingPlayer(player1);
+    *createGame.mutable_player2() = takeWaitingPlayer(player2);
+
+    auto owner = m_ring.getShard(m_nextMatchId++);
+    if (!owner || !sendToShard(*owner, message)) {
+        std::string const error = "No game server is available.";
+        sendError(createGame.player1().connection(), error);
+        sendError(createGame.player2().connection(), error);
+    }
+}
+
+void Broker::removeWaitingPlayer(PlayerId player) {
+    auto iter = m_waitingPlayers.find(player);
+    if (iter == m_waitingPlayers.end()) {
+        return;
+    }
+    m_waitingConnections.erase(iter->second.connection());
+    m_waitingPlayers.erase(iter);
+}
+
+cluster_proto::ClusterPlayer Broker::takeWaitingPlayer(PlayerId player) {
+    auto iter = m_waitingPlayers.find(player);
+    // Moving the message out clears it, the connection is erased first.
+    m_waitingConnections.erase(iter->second.connection());
+    cluster_proto::ClusterPlayer clusterPlayer = std::move(iter->second);
+    m_waitingPlayers.erase(iter);
+    return clusterPlayer;
+}
+
+bool Broker::sendToShard(ShardIndex shard, cluster_proto::ClusterMessage const &message) {
+    auto iter = m_shards.find(shard);
+    if (iter == m_shards.end()) {
+        return false;
+    }
+    iter->second->send(message);
+    return true;
+}
+
+void Broker::sendError(ConnectionId connection, std::string const &error) {
+    auto shard = getConnectionShard(connection);
+    if (!shard) {
+        return;
+    }
+
+    game_proto::Response response;
+    response.mutable_error()->set_msg(error);
+
+    cluster_proto::ClusterMessage message;
+    auto &forward = *message.mutable_forward_response();
+    forward.set_shard(*shard);
+    forward.set_connection(getLocalConnection(connection));
+    forward.set_payload(response.SerializeAsString());
+    sendToShard(*shard, message);
+}
@@ -0,0 +1,86 @@
+#ifndef BROKER_H
+#define BROKER_H
+
+#ifndef ASIO_STANDALONE
+#define ASIO_STANDALONE
+#endif
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <asio/awaitable.hpp>
+#include <asio/basic_socket_acceptor.hpp>
+#include <asio/io_context.hpp>
+
+#include <cluster.pb.h>
+#include <server/ClusterLink.h>
+#include <server/ClusterTypes.h>
+#include <server/ConsistentHashRing.h>
+#include <server/MatchmakingQueue.h>
+
+// Shared matchmaking of a cluster of game servers. Shards connect to the broker, which pairs
+// their waiting players, places every new game on a shard by consistent hashing and relays
+// requests and responses between the shards of a game and the shards of its players.
+// Everything runs on a single thread, the broker only moves small messages.
+class Broker {
+  public:
+    struct Params {
+        // "tcp://<address>:<port>" or "unix://<path>".
+        std::string endpoint = "tcp://127.0.0.1:7000";
+        MatchmakingQueue::Params matchmaking = {};
+    };
+
+    // Throws if the endpoint cannot be bound.
+    explicit Broker(Params params);
+
+    // Blocks until stop is called.
+    void run();
+    // Safe to call from any thread.
+    void stop();
+
+  private:
+    using LinkPtr = std::shared_ptr<ClusterLink>;
+
+    asio::awaitable<void> acceptLoop();
+    asio::awaitable<void> runMatchmakingLoop();
+
+    void onMessage(LinkPtr const &link, cluster_proto::ClusterMessage const &message);
+    void onLinkClosed(LinkPtr const &link);
+
+    void onHello(LinkPtr const &link, cluster_proto::Hello const &hello);
+    void onMatchRequest(cluster_proto::MatchRequest const &request);
+    void onConnectionClosed(ShardIndex origin, cluster_proto::ConnectionClosed const &closed);
+
+    // Removes both players from the waiting players and sends the game to its owner.
+    void createGame(PlayerId player1, PlayerId player2);
+    void removeWaitingPlayer(PlayerId player);
+    // The player must be waiting.
+    cluster_proto::ClusterPlayer takeWaitingPlayer(PlayerId player);
+
+    // Returns false if the shard is not connected.
+    bool sendToShard(ShardIndex shard, cluster_proto::ClusterMessage const &message);
+    // Error response to a client, sent through the client's shard.
+    void sendError(ConnectionId connection, std::string const &error);
+
+  private:
+    Params m_params;
+    asio::io_context m_context;
+    asio::basic_socket_acceptor<ClusterLink::Protocol> m_acceptor;
+
+    // Connected shards. Only shards on the ring own new games.
+    std::unordered_map<ShardIndex, LinkPtr> m_shards;
+    std::unordered_map<ClusterLink const *, ShardIndex> m_linkShards;
+    ConsistentHashRing m_ring;
+    // Key of the next game on the ring.
+    std::uint64_t m_nextMatchId = 0U;
+
+    // Waiting players have broker local ids, they are only known by their connection.
+    MatchmakingQueue m_matchmakingQueue;
+    std::unordered_map<PlayerId, cluster_proto::ClusterPlayer> m_waitingPlayers;
+    std::unordered_map<ConnectionId, PlayerId> m_waitingConnections;
+    PlayerId m_nextPlayerId = 0U;
+};
+
+#endif
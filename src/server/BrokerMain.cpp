@@ -0,0 +1,40 @@
+#include <exception>
+#include <format>
+#include <iostream>
+#include <string_view>
+
+#include <server/Broker.h>
+
+namespace {
+void printUsage() {
+    std::cerr << "Usage:\n"
+                 "  game_broker [--listen=<endpoint>] [--batched]\n"
+                 "The endpoint is tcp://<address>:<port> or unix://<path>, by default\n"
+                 "tcp://127.0.0.1:7000. --batched pairs waiting players periodically.\n";
+}
+} // namespace
+
+int main(int argc, char **argv) {
+    Broker::Params params;
+    constexpr std::string_view ListenOption = "--listen=";
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg.starts_with(ListenOption)) {
+            params.endpoint = arg.substr(ListenOption.size());
+        } else if (arg == "--batched") {
+            params.matchmaking.mode = MatchmakingQueue::Mode::Batched;
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+
+    try {
+        Broker broker(params);
+        broker.run();
+    } catch (std::exception const &e) {
+        std::cerr << std::format("Broker failed with error: {:s}.\n", e.what());
+        return 1;
+    }
+    return 0;
+}
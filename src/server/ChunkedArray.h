@@ -0,0 +1,75 @@
+#ifndef CHUNKED_ARRAY_H
+#define CHUNKED_ARRAY_H
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+
+// Growable array whose elements never move. Elements live in fixed size chunks that are
+// allocated on demand and only freed on destruction, so an element can be read without a
+// lock once the thread that wrote it has published its index.
+template <typename T, std::size_t ChunkSize = 1U << 16U, std::size_t MaxChunkCount = 1U << 12U>
+class ChunkedArray {
+  public:
+    static constexpr std::size_t MaxSize = ChunkSize * MaxChunkCount;
+
+    ChunkedArray() = default;
+    ChunkedArray(ChunkedArray const &) = delete;
+    ChunkedArray &operator=(ChunkedArray const &) = delete;
+
+    ~ChunkedArray() {
+        for (auto &chunk : m_chunks) {
+            delete[] chunk.load(std::memory_order_relaxed);
+        }
+    }
+
+    // Makes sure that memory for the element at idx is allocated.
+    void ensureAllocated(std::size_t idx) {
+        assert(idx < MaxSize);
+        auto &chunk = m_chunks[idx / ChunkSize];
+        if (chunk.load(std::memory_order_acquire)) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(m_allocationMutex);
+        if (!chunk.load(std::memory_order_relaxed)) {
+            chunk.store(new T[ChunkSize](), std::memory_order_release);
+        }
+    }
+
+    // Allocates all chunks needed for the first size elements up front.
+    void reserve(std::size_t size) {
+        assert(size <= MaxSize);
+        for (std::size_t idx = 0; idx < size; idx += ChunkSize) {
+            ensureAllocated(idx);
+        }
+    }
+
+    bool isAllocated(std::size_t idx) const {
+        return idx < MaxSize &&
+               m_chunks[idx / ChunkSize].load(std::memory_order_acquire) != nullptr;
+    }
+
+    T &operator[](std::size_t idx) {
+        assert(idx < MaxSize);
+        T *chunk = m_chunks[idx / ChunkSize].load(std::memory_order_acquire);
+        assert(chunk);
+        return chunk[idx % ChunkSize];
+    }
+
+    T const &operator[](std::size_t idx) const {
+        assert(idx < MaxSize);
+        T const *chunk = m_chunks[idx / ChunkSize].load(std::memory_order_acquire);
+        assert(chunk);
+        return chunk[idx % ChunkSize];
+    }
+
+  private:
+    std::mutex m_allocationMutex;
+    std::array<std::atomic<T *>, MaxChunkCount> m_chunks{};
+};
+
+#endif
@@ -0,0 +1,153 @@
+#include "ClusterLink.h"
+
+#include <array>
+#include <charconv>
+#include <exception>
+#include <format>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+#include <asio/co_spawn.hpp>
+#include <asio/detached.hpp>
+#include <asio/ip/tcp.hpp>
+#include <asio/local/stream_protocol.hpp>
+#include <asio/post.hpp>
+#include <asio/read.hpp>
+#include <asio/use_awaitable.hpp>
+#include <asio/write.hpp>
+
+namespace {
+constexpr std::string_view TcpScheme = "tcp://";
+constexpr std::string_view UnixScheme = "unix://";
+constexpr std::size_t HeaderSize = 4U;
+} // namespace
+
+auto ClusterLink::parseEndpoint(std::string_view endpoint) -> Protocol::endpoint {
+    if (endpoint.starts_with(UnixScheme)) {
+        return asio::local::stream_protocol::endpoint(
+            std::string(endpoint.substr(UnixScheme.size())));
+    }
+    if (endpoint.starts_with(TcpScheme)) {
+        std::string_view hostPort = endpoint.substr(TcpScheme.size());
+        auto separator = hostPort.rfind(':');
+        std::uint16_t port = 0U;
+        if (separator != std::string_view::npos) {
+            std::string_view portText = hostPort.substr(separator + 1U);
+            char const *last = portText.data() + portText.size();
+            auto [end, ec] = std::from_chars(portText.data(), last, port);
+            if (ec == std::errc() && end == last) {
+                std::string host(hostPort.substr(0U, separator));
+                auto address =
+                    asio::ip::make_address(host == "localhost" ? "127.0.0.1" : host);
+                return asio::ip::tcp::endpoint(address, port);
+            }
+        }
+    }
+    throw std::invalid_argument(std::format("Invalid cluster endpoint {:s}.", endpoint));
+}
+
+std::shared_ptr<ClusterLink> ClusterLink::connect(asio::io_context &context,
+                                                  std::string_view endpoint) {
+    Protocol::socket socket(context);
+    socket.connect(parseEndpoint(endpoint));
+    return std::make_shared<ClusterLink>(std::move(socket));
+}
+
+void ClusterLink::start(MessageHandler onMessage, CloseHandler onClose) {
+    asio::co_spawn(m_socket.get_executor(),
+                   readLoop(shared_from_this(), std::move(onMessage), std::move(onClose)),
+                   asio::detached);
+}
+
+void ClusterLink::send(cluster_proto::ClusterMessage const &message) {
+    auto size = std::uint32_t(message.ByteSizeLong());
+    bool startWriter = false;
+    {
+        std::lock_guard<std::mutex> lock(m_sendMutex);
+        for (std::size_t i = 0U; i < HeaderSize; ++i) {
+            m_pending.push_back(static_cast<char>(size >> (8U * i)));
+        }
+        message.AppendToString(&m_pending);
+        startWriter = !std::exchange(m_writing, true);
+    }
+    // Spawned outside of the lock, the writer may start right away on this thread.
+    if (startWriter) {
+        asio::co_spawn(m_socket.get_executor(), writeLoop(shared_from_this()), asio::detached);
+    }
+}
+
+void ClusterLink::close() {
+    asio::post(m_socket.get_executor(), [self = shared_from_this()]() {
+        std::error_code ec;
+        self->m_socket.shutdown(Protocol::socket::shutdown_both, ec);
+        self->m_socket.close(ec);
+    });
+}
+
+asio::awaitable<void> ClusterLink::readLoop(std::shared_ptr<ClusterLink> self,
+                                            MessageHandler onMessage,
+                                            CloseHandler onClose) {
+    try {
+        std::array<unsigned char, HeaderSize> header{};
+        std::string body;
+        cluster_proto::ClusterMessage message;
+        while (true) {
+            co_await asio::async_read(m_socket, asio::buffer(header), asio::use_awaitable);
+            std::uint32_t size = 0U;
+            for (std::size_t i = 0U; i < HeaderSize; ++i) {
+                size |= std::uint32_t(header[i]) << (8U * i);
+            }
+            if (size > MaxMessageSize) {
+                throw std::runtime_error("Cluster message is too large.");
+            }
+
+            body.resize(size);
+            co_await asio::async_read(m_socket, asio::buffer(body), asio::use_awaitable);
+            if (!message.ParseFromString(body)) {
+                throw std::runtime_error("Failed to parse cluster message.");
+            }
+            // A throwing handler only loses its own message, not the link.
+            try {
+                onMessage(message);
+            } catch (std::exception const &e) {
+                std::cerr << std::format("Cluster message handler failed: {:s}.\n", e.what());
+            }
+        }
+    } catch (std::exception const &e) {
+        std::cerr << std::format("Cluster link closed: {:s}.\n", e.what());
+    }
+
+    std::error_code ec;
+    m_socket.close(ec);
+    onClose();
+}
+
+asio::awaitable<void> ClusterLink::writeLoop(std::shared_ptr<ClusterLink> self) {
+    std::string buffer;
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(m_sendMutex);
+            buffer.clear();
+            buffer.swap(m_pending);
+            if (buffer.empty()) {
+                m_writing = false;
+                co_return;
+            }
+        }
+
+        bool failed = false;
+        try {
+            co_await asio::async_write(m_socket, asio::buffer(buffer), asio::use_awaitable);
+        } catch (std::exception const &) {
+            // The read loop reports the closed link.
+            failed = true;
+        }
+        if (failed) {
+            std::lock_guard<std::mutex> lock(m_sendMutex);
+            m_pending.clear();
+            m_writing = false;
+            co_return;
+        }
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef CLUSTER_LINK_H
+#define CLUSTER_LINK_H
+
+#ifndef ASIO_STANDALONE
+#define ASIO_STANDALONE
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include <asio/awaitable.hpp>
+#include <asio/generic/stream_protocol.hpp>
+#include <asio/io_context.hpp>
+
+#include <cluster.pb.h>
+
+// Stream of size prefixed cluster messages between a shard and the broker, over TCP or a
+// Unix socket. Messages sent from any thread are batched into as few writes as possible.
+class ClusterLink : public std::enable_shared_from_this<ClusterLink> {
+  public:
+    using Protocol = asio::generic::stream_protocol;
+    using MessageHandler = std::function<void(cluster_proto::ClusterMessage const &message)>;
+    using CloseHandler = std::function<void()>;
+
+    // Larger messages are treated as a corrupt stream.
+    static constexpr std::size_t MaxMessageSize = std::size_t(16U) << 20U;
+
+    // Accepts "tcp://<address>:<port>" and "unix://<path>". Throws on an invalid endpoint.
+    static Protocol::endpoint parseEndpoint(std::string_view endpoint);
+    // Throws if the connection fails.
+    static std::shared_ptr<ClusterLink> connect(asio::io_context &context,
+                                                std::string_view endpoint);
+
+    explicit ClusterLink(Protocol::socket socket) : m_socket(std::move(socket)) {}
+
+    // Handlers run on the socket's executor. The link stays alive until it is closed, the
+    // close handler is called once.
+    void start(MessageHandler onMessage, CloseHandler onClose);
+    // Safe to call from any thread. Messages are sent in the order of the calls.
+    void send(cluster_proto::ClusterMessage const &message);
+    void close();
+
+  private:
+    // The loops keep the link alive, the owner passed in is stored in the coroutine frame
+    // before the loop first runs.
+    asio::awaitable<void> readLoop(std::shared_ptr<ClusterLink> self,
+                                   MessageHandler onMessage,
+                                   CloseHandler onClose);
+    asio::awaitable<void> writeLoop(std::shared_ptr<ClusterLink> self);
+
+  private:
+    Protocol::socket m_socket;
+
+    std::mutex m_sendMutex;
+    // Encoded messages that wait for the running write.
+    std::string m_pending;
+    bool m_writing = false;
+};
+
+#endif
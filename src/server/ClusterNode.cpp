@@ -0,0 +1,240 @@
+#include "ClusterNode.h"
+
+#include <algorithm>
+#include <exception>
+#include <format>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <asio/co_spawn.hpp>
+#include <asio/detached.hpp>
+#include <asio/post.hpp>
+#include <asio/steady_timer.hpp>
+#include <asio/use_awaitable.hpp>
+
+#include <game.pb.h>
+#include <server/AdmissionControl.h>
+#include <server/MonotonicTime.h>
+
+ClusterNode::ClusterNode(Params params, std::unique_ptr<ITransport> transport)
+    : m_params(std::move(params)), m_transport(std::move(transport)),
+      m_workGuard(m_context.get_executor()) {
+    if (m_params.shard >= MaxShardCount) {
+        throw std::invalid_argument(
+            std::format("Shard index must be less than {:d}.", MaxShardCount));
+    }
+
+    m_initialLink = ClusterLink::connect(m_context, m_params.brokerEndpoint);
+    cluster_proto::ClusterMessage hello;
+    hello.mutable_hello()->set_shard(m_params.shard);
+    m_initialLink->send(hello);
+
+    m_brokerThread = std::jthread([this]() {
+        // A throwing handler only loses its own work.
+        while (true) {
+            try {
+                m_context.run();
+                return;
+            } catch (std::exception const &e) {
+                std::cerr << std::format("Broker handler failed with error: {:s}.\n",
+                                         e.what());
+            }
+        }
+    });
+}
+
+ClusterNode::~ClusterNode() { disconnect(); }
+
+void ClusterNode::disconnect() {
+    if (!m_brokerThread.joinable()) {
+        return;
+    }
+    m_context.stop();
+    m_brokerThread.join();
+}
+
+void ClusterNode::setListener(ITransport::Listener *listener) {
+    m_listener = listener;
+    m_transport->setListener(this);
+    asio::post(m_context, [this]() { startLink(std::move(m_initialLink)); });
+}
+
+void ClusterNode::startLink(std::shared_ptr<ClusterLink> link) {
+    link->start(
+        [this](cluster_proto::ClusterMessage const &message) { onBrokerMessage(message); },
+        [this]() { onBrokerLost(); });
+    std::lock_guard<std::mutex> lock(m_linkMutex);
+    m_link = std::move(link);
+}
+
+void ClusterNode::onBrokerLost() {
+    {
+        std::lock_guard<std::mutex> lock(m_linkMutex);
+        m_link.reset();
+    }
+    // The broker dropped the shard's waiting players, the logic matches new requests locally
+    // until the link is back.
+    std::cerr << std::format("Shard {:d} lost the connection to the broker, reconnecting.\n",
+                             m_params.shard);
+    asio::co_spawn(m_context, reconnect(), asio::detached);
+}
+
+asio::awaitable<void> ClusterNode::reconnect() {
+    asio::steady_timer timer(m_context);
+    std::chrono::milliseconds delay = MinReconnectDelay;
+    while (true) {
+        timer.expires_after(delay);
+        co_await timer.async_wait(asio::use_awaitable);
+
+        std::shared_ptr<ClusterLink> link;
+        try {
+            // Blocks the broker thread, which has nothing else to do without a link.
+            link = ClusterLink::connect(m_context, m_params.brokerEndpoint);
+        } catch (std::exception const &) {
+            delay = std::min(delay * 2, MaxReconnectDelay);
+            continue;
+        }
+
+        cluster_proto::ClusterMessage hello;
+        hello.mutable_hello()->set_shard(m_params.shard);
+        link->send(hello);
+        startLink(std::move(link));
+        std::cout << std::format("Shard {:d} reconnected to the broker.\n", m_params.shard);
+        co_return;
+    }
+}
+
+bool ClusterNode::sendToBroker(cluster_proto::ClusterMessage const &message) {
+    std::shared_ptr<ClusterLink> link;
+    {
+        std::lock_guard<std::mutex> lock(m_linkMutex);
+        link = m_link;
+    }
+    if (!link) {
+        return false;
+    }
+    link->send(message);
+    return true;
+}
+
+void ClusterNode::sendError(ConnectionId id, std::string const &error) {
+    game_proto::Response response;
+    response.mutable_error()->set_msg(error);
+    try {
+        m_transport->sendMessage(id, response.SerializeAsString());
+    } catch (std::exception const &) {
+        // Client disconnected meanwhile.
+    }
+}
+
+bool ClusterNode::requestMatch(cluster_proto::ClusterPlayer const &player) {
+    cluster_proto::ClusterMessage message;
+    *message.mutable_match_request()->mutable_player() = player;
+    return sendToBroker(message);
+}
+
+void ClusterNode::sendMessage(ConnectionId id, std::string_view payload) {
+    auto shard = getConnectionShard(id);
+    if (!shard || *shard == m_params.shard) {
+        return m_transport->sendMessage(getLocalConnection(id), payload);
+    }
+
+    cluster_proto::ClusterMessage message;
+    auto &forward = *message.mutable_forward_response();
+    forward.set_shard(*shard);
+    forward.set_connection(getLocalConnection(id));
+    forward.set_payload(payload.data(), payload.size());
+    // Clients of other shards are unreachable while the broker is not connected.
+    sendToBroker(message);
+}
+
+void ClusterNode::broadcastMessage(std::span<ConnectionId const> ids,
+                                   std::string_view payload) {
+    std::vector<ConnectionId> local;
+    local.reserve(ids.size());
+    for (ConnectionId id : ids) {
+        auto shard = getConnectionShard(id);
+        if (!shard || *shard == m_params.shard) {
+            local.push_back(getLocalConnection(id));
+        } else {
+            sendMessage(id, payload);
+        }
+    }
+    m_transport->broadcastMessage(local, payload);
+}
+
+void ClusterNode::onMessage(ConnectionId id, std::string payload, std::uint64_t receiveTime) {
+    auto owner = getOwnerShard(payload);
+    if (!owner || *owner == m_params.shard) {
+        return m_listener->onMessage(id, std::move(payload), receiveTime);
+    }
+
+    // Owner checks and answers the request, the broker reports an owner that is gone.
+    cluster_proto::ClusterMessage message;
+    auto &forward = *message.mutable_forward_request();
+    forward.set_shard(*owner);
+    forward.set_connection(makeClusterConnection(m_params.shard, id));
+    forward.set_payload(std::move(payload));
+    if (!sendToBroker(message)) {
+        sendError(id, "Server of the game is not available.");
+    }
+}
+
+void ClusterNode::onConnectionClosed(ConnectionId id) {
+    m_listener->onConnectionClosed(id);
+
+    // Other shards end the games and subscriptions of the client.
+    cluster_proto::ClusterMessage message;
+    message.mutable_connection_closed()->set_connection(
+        makeClusterConnection(m_params.shard, id));
+    sendToBroker(message);
+}
+
+void ClusterNode::onBrokerMessage(cluster_proto::ClusterMessage const &message) {
+    if (message.has_forward_request()) {
+        auto const &request = message.forward_request();
+        m_listener->onMessage(
+            request.connection(), request.payload(), getMonotonicNanoseconds());
+    } else if (message.has_forward_response()) {
+        auto const &response = message.forward_response();
+        try {
+            m_transport->sendMessage(response.connection(), response.payload());
+        } catch (std::exception const &) {
+            // Client disconnected while the response was relayed.
+        }
+    } else if (message.has_connection_closed()) {
+        m_listener->onConnectionClosed(message.connection_closed().connection());
+    } else if (message.has_create_game() && m_onGameCreated) {
+        m_onGameCreated(message.create_game());
+    }
+}
+
+std::optional<ShardIndex> ClusterNode::getOwnerShard(std::string_view payload) {
+    auto type = AdmissionControl::peekRequestType(payload);
+    if (type != game_proto::Request::kMoveRequest &&
+        type != game_proto::Request::kMessageRequest &&
+        type != game_proto::Request::kSpectateRequest &&
+        type != game_proto::Request::kStopSpectatingRequest) {
+        return std::nullopt;
+    }
+
+    // Only requests of a game are decoded twice, they are small.
+    game_proto::Request request;
+    if (!request.ParseFromArray(payload.data(), int(payload.size()))) {
+        return std::nullopt;
+    }
+    switch (request.Request_case()) {
+    case game_proto::Request::kMoveRequest:
+        return getGameShard(request.move_request().game_id());
+    case game_proto::Request::kMessageRequest:
+        return getGameShard(request.message_request().game_id());
+    case game_proto::Request::kSpectateRequest:
+        return getGameShard(request.spectate_request().game_id());
+    case game_proto::Request::kStopSpectatingRequest:
+        return getGameShard(request.stop_spectating_request().game_id());
+    default:
+        return std::nullopt;
+    }
+}
@@ -0,0 +1,106 @@
+#ifndef CLUSTER_NODE_H
+#define CLUSTER_NODE_H
+
+#ifndef ASIO_STANDALONE
+#define ASIO_STANDALONE
+#endif
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include <asio/awaitable.hpp>
+#include <asio/executor_work_guard.hpp>
+#include <asio/io_context.hpp>
+
+#include <cluster.pb.h>
+#include <server/ClusterLink.h>
+#include <server/ClusterTypes.h>
+#include <server/ITransport.h>
+
+// Router of a game server that runs as one shard of a cluster. Wraps the transport of the
+// shard's own clients: requests for games owned by other shards are forwarded to the owner
+// through the broker, and the listener receives the requests that other shards forward
+// here, with connection ids tagged with the client's shard. Responses to tagged connections
+// go back the same way, so clients never notice which shard hosts their game. A lost broker
+// connection is re-established in the background.
+class ClusterNode : public ITransport, private ITransport::Listener {
+  public:
+    struct Params {
+        // "tcp://<address>:<port>" or "unix://<path>" of the broker.
+        std::string brokerEndpoint = "tcp://127.0.0.1:7000";
+        // Unique in the cluster, less than MaxShardCount.
+        ShardIndex shard = 0U;
+    };
+
+    // Called on the broker thread, so it should hand the work off quickly.
+    using GameCreatedHandler = std::function<void(cluster_proto::CreateGame const &game)>;
+
+    // Connects to the broker. Throws if the broker is not reachable.
+    ClusterNode(Params params, std::unique_ptr<ITransport> transport);
+    ~ClusterNode() override;
+
+    ShardIndex getShard() const { return m_params.shard; }
+
+    // Must be set before the listener.
+    void setGameCreatedHandler(GameCreatedHandler handler) {
+        m_onGameCreated = std::move(handler);
+    }
+    // Queues the player in the matchmaking of the broker. Returns false while the broker is
+    // not connected. Safe to call from any thread.
+    bool requestMatch(cluster_proto::ClusterPlayer const &player);
+    // Stops the broker thread, no handler is called afterwards.
+    void disconnect();
+
+    // Broker traffic is delivered once the listener is set.
+    void setListener(ITransport::Listener *listener) override;
+    void sendMessage(ConnectionId id, std::string_view payload) override;
+    // Local connections share one frame, clients of other shards get a forward each.
+    void broadcastMessage(std::span<ConnectionId const> ids,
+                          std::string_view payload) override;
+    void run() override { m_transport->run(); }
+    void stop() override { m_transport->stop(); }
+
+  private:
+    // Traffic of the shard's own clients.
+    void onMessage(ConnectionId id, std::string payload, std::uint64_t receiveTime) override;
+    void onConnectionClosed(ConnectionId id) override;
+
+    void onBrokerMessage(cluster_proto::ClusterMessage const &message);
+    // Runs on the broker thread.
+    void startLink(std::shared_ptr<ClusterLink> link);
+    void onBrokerLost();
+    asio::awaitable<void> reconnect();
+    // Returns false while the broker is not connected.
+    bool sendToBroker(cluster_proto::ClusterMessage const &message);
+    void sendError(ConnectionId id, std::string const &error);
+
+    // Shard that owns the game of a game request, nullopt for other requests.
+    static std::optional<ShardIndex> getOwnerShard(std::string_view payload);
+
+  private:
+    Params m_params;
+    std::unique_ptr<ITransport> m_transport;
+    ITransport::Listener *m_listener = nullptr;
+    GameCreatedHandler m_onGameCreated;
+
+    static constexpr std::chrono::milliseconds MinReconnectDelay{100};
+    static constexpr std::chrono::milliseconds MaxReconnectDelay{5000};
+
+    asio::io_context m_context;
+    asio::executor_work_guard<asio::io_context::executor_type> m_workGuard;
+    // Replaced on the broker thread, empty while the broker is not connected.
+    std::mutex m_linkMutex;
+    std::shared_ptr<ClusterLink> m_link;
+    // Link of the constructor, started once the listener is set.
+    std::shared_ptr<ClusterLink> m_initialLink;
+    std::jthread m_brokerThread;
+};
+
+#endif
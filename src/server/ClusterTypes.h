@@ -0,0 +1,39 @@
+#ifndef CLUSTER_TYPES_H
+#define CLUSTER_TYPES_H
+
+#include <cstdint>
+#include <optional>
+
+#include <server/ConnectionId.h>
+#include <server/GameManager.h>
+
+// Index of a game server process in a cluster. The shard tag of its game ids is the index
+// plus one.
+using ShardIndex = std::uint32_t;
+inline constexpr ShardIndex MaxShardCount = GameManager::MaxShardTag;
+
+// Connections are only unique within a shard, so connections of clients of other shards
+// carry the index of their shard, plus one, in the upper byte.
+inline constexpr std::uint32_t ConnectionShardShift = 56U;
+
+inline ConnectionId makeClusterConnection(ShardIndex shard, ConnectionId connection) {
+    return (ConnectionId(shard + 1U) << ConnectionShardShift) | connection;
+}
+
+// Returns nullopt for connections that are not tagged with a shard.
+inline std::optional<ShardIndex> getConnectionShard(ConnectionId connection) {
+    auto tag = ShardIndex(connection >> ConnectionShardShift);
+    return tag != 0U ? std::optional<ShardIndex>(tag - 1U) : std::nullopt;
+}
+
+inline ConnectionId getLocalConnection(ConnectionId connection) {
+    return connection & ((ConnectionId(1U) << ConnectionShardShift) - 1U);
+}
+
+// Returns nullopt for games of a server that runs on its own.
+inline std::optional<ShardIndex> getGameShard(GameManager::GameId game) {
+    std::uint32_t tag = GameManager::getShardTag(game);
+    return tag != 0U ? std::optional<ShardIndex>(tag - 1U) : std::nullopt;
+}
+
+#endif
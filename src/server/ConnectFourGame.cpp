@@ -37,6 +37,7 @@ void ConnectFourGame::insertCoin(std::uint32_t columnIdx, CoinValue coin) {
     m_columnOccupancy[columnIdx]++;
     m_board[getFlatIndex(rowIdx, columnIdx)] = coin;
     m_moveCount++;
+    m_moves.push(columnIdx);
 }
 
 void ConnectFourGame::insertPlayer1Coin(std::uint32_t columnIdx) {
@@ -50,7 +51,9 @@ void ConnectFourGame::insertPlayer2Coin(std::uint32_t columnIdx) {
 bool ConnectFourGame::checkIfFourInColumn(std::uint32_t columnIdx) const {
     assert(columnIdx < ColumnCount);
 
-    std::uint32_t rowIdx = m_columnOccupancy[columnIdx];
+    // The last coin of the column, the column can not be empty after a move.
+    assert(m_columnOccupancy[columnIdx] > 0);
+    std::uint32_t rowIdx = m_columnOccupancy[columnIdx] - 1;
     assert(rowIdx < RowCount);
 
     if (rowIdx < WinningCoinStreak - 1) {
@@ -97,17 +100,13 @@ bool ConnectFourGame::checkIfFourInRow(std::uint32_t columnIdx) const {
     }
 
     // Check left neighbours
-    for (std::uint32_t c = columnIdx - 1;; --c) {
+    for (std::uint32_t c = columnIdx; c-- > 0;) {
         std::uint32_t flatIdx = getFlatIndex(rowIdx, c);
 
         if (m_board[flatIdx] != refCoin) {
             break;
         }
         countInRow++;
-
-        if (c == 0) {
-            break;
-        }
     }
     return countInRow >= WinningCoinStreak;
 }
@@ -3,12 +3,14 @@
 
 #include <array>
 #include <cassert>
+#include <chrono>
 #include <cstdint>
 #include <format>
 #include <mutex>
 #include <span>
 #include <stdexcept>
 
+#include <server/MoveSequence.h>
 #include <server/Player.h>
 
 enum class CoinValue : std::uint8_t {
@@ -49,6 +51,7 @@ class ConnectFourGame {
     std::vector<std::uint32_t> getAvailableColumns() const;
 
     std::uint32_t getMoveCount() const { return m_moveCount; }
+    MoveSequence const &getMoves() const { return m_moves; }
     bool isFull() const { return m_moveCount == FlatBoardSize; }
 
     void setStatus(Status status) { m_status = status; }
@@ -68,26 +71,63 @@ class ConnectFourGame {
     std::array<std::uint32_t, ColumnCount> m_columnOccupancy{};
     Status m_status = Status::NotStarted;
     std::uint32_t m_moveCount = 0U;
+    MoveSequence m_moves;
+};
+
+static_assert(MoveSequence::ColumnCount == ConnectFourGame::ColumnCount);
+static_assert(MoveSequence::MaxMoveCount == ConnectFourGame::FlatBoardSize);
+
+// Participant of a game. The connection is kept next to the id, so that responses can be
+// sent without a player table lookup.
+struct GamePlayer {
+    PlayerId id = InvalidPlayerId;
+    ConnectionId connection = 0U;
+};
+
+// Clock limits of a game. A player loses on time when either of them runs out.
+struct TimeControl {
+    // Longest time a player may think about a single move.
+    std::chrono::milliseconds moveTime = std::chrono::seconds(30);
+    // Thinking time of a player over the whole game.
+    std::chrono::milliseconds gameTime = std::chrono::minutes(5);
+    // Resolution of the clocks.
+    std::chrono::milliseconds tick = std::chrono::milliseconds(10);
 };
 
 struct GameInstance {
     // Player one always starts the game.
-    IPlayer *player1;
-    IPlayer *player2;
+    GamePlayer player1;
+    GamePlayer player2;
 
     ConnectFourGame game;
-
-    void insertCoin(std::uint32_t columnIdx, IPlayer *p) {
-        if (p == player1) {
+    std::chrono::system_clock::time_point startTime{};
+
+    // Remaining thinking time of player one and two. Only the clock of the player to move
+    // is running, since turnStart.
+    std::array<std::chrono::steady_clock::duration, 2> remainingTime{};
+    std::chrono::steady_clock::time_point turnStart{};
+    // Timing wheel timer that fires when the player to move runs out of time.
+    std::uint64_t deadlineTimer = 0U;
+    // Recovered from the journal and waiting for its players to log in again. Nobody can
+    // move until both are back, the game is cancelled if they do not return in time.
+    bool recovered = false;
+
+    bool isPlayer1ToMove() const { return game.getMoveCount() % 2U == 0U; }
+    GamePlayer const &getPlayerToMove() const { return isPlayer1ToMove() ? player1 : player2; }
+
+    void insertCoin(std::uint32_t columnIdx, PlayerId p) {
+        if (p == player1.id) {
             return game.insertPlayer1Coin(columnIdx);
-        } else if (p == player2) {
+        } else if (p == player2.id) {
             return game.insertPlayer2Coin(columnIdx);
         }
         assert(false);
     }
-};
 
-using GameHdl = GameInstance *;
-using GamePtr = std::shared_ptr<GameInstance>;
+    GamePlayer const &getOpponent(PlayerId p) const {
+        assert(p == player1.id || p == player2.id);
+        return p == player1.id ? player2 : player1;
+    }
+};
 
 #endif
\ No newline at end of file
@@ -0,0 +1,9 @@
+#ifndef CONNECTION_ID_H
+#define CONNECTION_ID_H
+
+#include <cstddef>
+
+// Identifies a client connection across transports. Zero is never a valid connection.
+using ConnectionId = std::size_t;
+
+#endif
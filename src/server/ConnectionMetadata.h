@@ -11,12 +11,12 @@
 #include <websocketpp/endpoint.hpp>
 #include <websocketpp/uri.hpp>
 
+#include <server/ConnectionId.h>
 #include <server/ServerTypes.h>
 
 using ConnectionHdl = websocketpp::connection_hdl;
 using ConnectionPtr = ServerType::connection_ptr;
 
-using ConnectionId = std::size_t;
 inline ConnectionId getConnectionId(ConnectionPtr ptr) { return ConnectionId(ptr.get()); }
 
 using HandlePointerPair = std::pair<ConnectionHdl, ConnectionPtr>;
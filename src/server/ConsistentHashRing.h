@@ -0,0 +1,59 @@
+#ifndef CONSISTENT_HASH_RING_H
+#define CONSISTENT_HASH_RING_H
+
+#include <cstdint>
+#include <map>
+#include <optional>
+
+// Maps keys to shards. Every shard owns many points on a hash ring and a key belongs to the
+// shard of the next point, so keys are spread evenly and adding or removing a shard only
+// moves the keys of that shard. Not thread safe.
+class ConsistentHashRing {
+  public:
+    using ShardIndex = std::uint32_t;
+
+    static constexpr std::uint32_t VirtualNodeCount = 64U;
+
+    void addShard(ShardIndex shard) {
+        for (std::uint32_t node = 0U; node < VirtualNodeCount; ++node) {
+            m_points.emplace(hash((std::uint64_t(shard) << 32U) | node), shard);
+        }
+    }
+
+    void removeShard(ShardIndex shard) {
+        for (std::uint32_t node = 0U; node < VirtualNodeCount; ++node) {
+            auto iter = m_points.find(hash((std::uint64_t(shard) << 32U) | node));
+            if (iter != m_points.end() && iter->second == shard) {
+                m_points.erase(iter);
+            }
+        }
+    }
+
+    // Returns nullopt if the ring is empty.
+    std::optional<ShardIndex> getShard(std::uint64_t key) const {
+        if (m_points.empty()) {
+            return std::nullopt;
+        }
+        // Salted, so that small keys do not land on the points of small shard indices.
+        auto iter = m_points.lower_bound(hash(key ^ KeySalt));
+        return iter != m_points.end() ? iter->second : m_points.begin()->second;
+    }
+
+    bool empty() const { return m_points.empty(); }
+
+  private:
+    static constexpr std::uint64_t KeySalt = 0x5851f42d4c957f2dULL;
+
+    // SplitMix64 finalizer, consecutive keys and node ids land far apart.
+    static std::uint64_t hash(std::uint64_t value) {
+        value += 0x9e3779b97f4a7c15ULL;
+        value = (value ^ (value >> 30U)) * 0xbf58476d1ce4e5b9ULL;
+        value = (value ^ (value >> 27U)) * 0x94d049bb133111ebULL;
+        return value ^ (value >> 31U);
+    }
+
+  private:
+    std::map<std::uint64_t, ShardIndex> m_points;
+};
+
+#endif
@@ -5,6 +5,7 @@
 #include <iostream>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 #include <server/Database.h>
 
@@ -25,40 +26,99 @@ void checkAndFreeSqlErrorMsg(char *errMsg) {
         throw std::runtime_error(errorString);
     }
 }
+
+std::int64_t toUnixMilliseconds(std::chrono::system_clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch())
+        .count();
+}
+
+std::chrono::system_clock::time_point fromUnixMilliseconds(std::int64_t milliseconds) {
+    return std::chrono::system_clock::time_point(
+        std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            std::chrono::milliseconds(milliseconds)));
+}
+
+// Only valid until the statement is stepped again.
+std::string_view getColumnView(sqlite3_stmt *statement, int column) {
+    auto const *text = reinterpret_cast<char const *>(sqlite3_column_text(statement, column));
+    return text ? std::string_view(text, sqlite3_column_bytes(statement, column))
+                : std::string_view();
+}
+
+std::string getColumnText(sqlite3_stmt *statement, int column) {
+    return std::string(getColumnView(statement, column));
+}
+
+// Quotes a string literal for direct use in a statement.
+std::string quoteSqlString(std::string_view str) {
+    std::string quoted = "'";
+    for (char c : str) {
+        quoted += c;
+        if (c == '\'') {
+            quoted += '\'';
+        }
+    }
+    quoted += '\'';
+    return quoted;
+}
+
+constexpr int BusyTimeoutMilliseconds = 5000;
 } // namespace
 
 Database::Database(std::filesystem::path const &playerDatabasePath,
-                   std::filesystem::path const &gamesDatabasePath) {
-    sqlite3_open(":memory:", &m_db);
+                   std::filesystem::path const &gamesDatabasePath,
+                   std::size_t statementCacheSize) {
+    if (sqlite3_open(":memory:", &m_db) != SQLITE_OK) {
+        std::string error = sqlite3_errmsg(m_db);
+        sqlite3_close(m_db);
+        throw std::runtime_error(std::format("Failed to open database: {:s}", error));
+    }
 
-    char *errMsg = nullptr;
-    std::string attachPlayers = std::format(
-        "ATTACH DATABASE {:s} AS {:s};", playerDatabasePath.string(), PlayersDatabaseName);
-    sqlite3_exec(m_db, attachPlayers.c_str(), nullptr, nullptr, &errMsg);
-    checkAndFreeSqlErrorMsg(errMsg);
+    try {
+        // Other connections of a pool may hold the write lock for a moment.
+        checkSqlStatus(sqlite3_busy_timeout(m_db, BusyTimeoutMilliseconds));
 
-    std::string attachGames = std::format(
-        "ATTACH DATABASE {:s} AS {:s};", gamesDatabasePath.string(), GamesDatabaseName);
-    sqlite3_exec(m_db, attachPlayers.c_str(), nullptr, nullptr, &errMsg);
-    checkAndFreeSqlErrorMsg(errMsg);
+        attachDatabase(playerDatabasePath, PlayersDatabaseName);
+        attachDatabase(gamesDatabasePath, GamesDatabaseName);
 
-    sqlite3_exec(m_db, attachGames.c_str(), nullptr, nullptr, &errMsg);
-    checkAndFreeSqlErrorMsg(errMsg);
-
-    createGamesTable();
-    createPlayersTable();
+        createGamesTable();
+        createPlayersTable();
+    } catch (...) {
+        sqlite3_close(m_db);
+        throw;
+    }
+    m_statements.emplace(m_db, statementCacheSize);
 }
 
 Database::~Database() {
+    // All statements have to be finalized before the connection can be closed.
+    m_statements.reset();
     if (m_db) {
         sqlite3_close(m_db);
     }
 }
 
+void Database::execute(std::string const &statement) {
+    char *errMsg = nullptr;
+    int status = sqlite3_exec(m_db, statement.c_str(), nullptr, nullptr, &errMsg);
+    checkAndFreeSqlErrorMsg(errMsg);
+    checkSqlStatus(status);
+}
+
+void Database::attachDatabase(std::filesystem::path const &path, std::string_view name) {
+    execute(std::format(
+        "ATTACH DATABASE {:s} AS {:s};", quoteSqlString(path.string()), name));
+
+    // Writers append to the log instead of rewriting pages, readers are not blocked and a
+    // commit only needs an fsync when the log is checkpointed.
+    execute(std::format("PRAGMA {:s}.journal_mode = WAL;", name));
+    execute(std::format("PRAGMA {:s}.synchronous = NORMAL;", name));
+}
+
 void Database::createPlayersTable() {
 
-    static std::string createStatement =
-        std::format("CREATE TABLE IF NOT EXISTS {:s}.players ("
+    std::string createStatement =
+        std::format("CREATE TABLE IF NOT EXISTS {:s}.{:s} ("
                     "  username TEXT NOT NULL, "
                     "  display_name TEXT NOT NULL, "
                     "  rating INTEGER DEFAULT 1500, "
@@ -66,79 +126,196 @@ void Database::createPlayersTable() {
                     "  losses INTEGER DEFAULT 0, "
                     "  draws INTEGER DEFAULT 0, "
                     "  PRIMARY KEY(username, display_name));",
-                    PlayersDatabaseName);
-    sqlite3_exec(m_db, createStatement.c_str(), nullptr, nullptr, nullptr);
-}
-
-sqlite3_stmt *Database::prepareSimpleStatement(std::string const &statement) {
-    sqlite3_stmt *ppStmt;
-    int status =
-        sqlite3_prepare_v2(m_db,                      /* Database handle */
-                           /*zSql=*/statement.data(), /* SQL statement, UTF-8 encoded */
-                           statement.size(),          /* Maximum length of zSql in bytes. */
-                           &ppStmt,                   /* OUT: Statement handle */
-                           nullptr /* OUT: Pointer to unused portion of zSql */
-        );
-    if (status != SQLITE_OK) {
-        throw std::runtime_error("Failed to prepare sql statement.");
-    }
-    return ppStmt;
+                    PlayersDatabaseName,
+                    PlayersTable);
+    execute(createStatement);
+
+    // Serves the leaderboard without sorting the whole table.
+    execute(std::format("CREATE INDEX IF NOT EXISTS {:s}.{:s}_rating ON {:s}(rating DESC);",
+                        PlayersDatabaseName,
+                        PlayersTable,
+                        PlayersTable));
 }
 
-void Database::insertPlayer(IPlayer const *player) {
+void Database::insertPlayer(std::string_view username, std::string_view displayName) {
+    static std::string const sql =
+        std::format("INSERT OR IGNORE INTO {:s}.{:s} VALUES (?1, ?2, 1500, 0, 0, 0);",
+                    PlayersDatabaseName,
+                    PlayersTable);
+    auto statement = m_statements->acquire(sql);
 
-    auto username = player->getUsername();
-    auto displayName = player->getDisplayName();
+    checkSqlStatus(
+        sqlite3_bind_text(statement, 1, username.data(), username.size(), SQLITE_TRANSIENT));
+    checkSqlStatus(sqlite3_bind_text(
+        statement, 2, displayName.data(), displayName.size(), SQLITE_TRANSIENT));
+
+    checkSqlStatus(sqlite3_step(statement));
+}
+
+std::size_t Database::getPlayerCount() {
+    static std::string const sql =
+        std::format("SELECT COUNT(*) FROM {:s}.{:s};", PlayersDatabaseName, PlayersTable);
+    auto statement = m_statements->acquire(sql);
+    std::size_t count = 0U;
+    if (sqlite3_step(statement) == SQLITE_ROW) {
+        count = std::size_t(sqlite3_column_int64(statement, 0));
+    }
+    return count;
+}
 
-    // Multi-thread. In this mode, SQLite can be safely used by multiple threads provided that
-    // no single database connection nor any object derived from database connection, such as a
-    // prepared statement, is used in two or more threads at the same time.
-    // We prepare thread local objects here.
-    thread_local std::string insertStatement = std::format(
-        "INSERT INTO {:s}.players VALUES (?1, ?2, 1500, 0, 0, 0);", PlayersDatabaseName);
-    thread_local sqlite3_stmt *preparedStatement = prepareSimpleStatement(insertStatement);
-    checkSqlStatus(sqlite3_reset(preparedStatement));
+std::optional<RatedPlayerRecord> Database::findPlayer(std::string_view username,
+                                                      std::string_view displayName) {
+    static std::string const sql =
+        std::format("SELECT rating FROM {:s}.{:s} WHERE username = ?1 AND display_name = ?2;",
+                    PlayersDatabaseName,
+                    PlayersTable);
+    auto statement = m_statements->acquire(sql);
 
     checkSqlStatus(
-        sqlite3_bind_text(preparedStatement, 1, username.data(), username.size(), nullptr));
+        sqlite3_bind_text(statement, 1, username.data(), username.size(), SQLITE_STATIC));
     checkSqlStatus(sqlite3_bind_text(
-        preparedStatement, 2, displayName.data(), displayName.size(), nullptr));
+        statement, 2, displayName.data(), displayName.size(), SQLITE_STATIC));
 
-    checkSqlStatus(sqlite3_step(preparedStatement));
+    int status = sqlite3_step(statement);
+    if (status != SQLITE_ROW) {
+        checkSqlStatus(status);
+        return std::nullopt;
+    }
+    return RatedPlayerRecord{
+        .username = std::string(username),
+        .displayName = std::string(displayName),
+        .rating = std::uint32_t(sqlite3_column_int(statement, 0)),
+    };
 }
 
-void Database::createGamesTable() {
-
-    static std::string createStatement =
-        std::format("CREATE TABLE IF NOT EXISTS {:s}.games ("
-                    "  player INTEGER FOREIGN KEY REFERENCES {:s}(rowid), "
-                    "  opponent INTEGER FOREIGN KEY REFERENCES {:s}(rowid), "
-                    "  winner INTEGER FOREIGN KEY REFERENCES {:s}(rowid), ",
-                    GamesDatabaseName,
+std::vector<RatedPlayerRecord> Database::getTopPlayers(std::size_t limit) {
+    static std::string const sql =
+        std::format("SELECT username, display_name, rating FROM {:s}.{:s} "
+                    "ORDER BY rating DESC LIMIT ?1;",
                     PlayersDatabaseName,
+                    PlayersTable);
+    auto statement = m_statements->acquire(sql);
+    checkSqlStatus(sqlite3_bind_int64(statement, 1, std::int64_t(limit)));
+
+    std::vector<RatedPlayerRecord> players;
+    int status;
+    while ((status = sqlite3_step(statement)) == SQLITE_ROW) {
+        players.push_back(RatedPlayerRecord{
+            .username = getColumnText(statement, 0),
+            .displayName = getColumnText(statement, 1),
+            .rating = std::uint32_t(sqlite3_column_int(statement, 2)),
+        });
+    }
+    checkSqlStatus(status);
+    return players;
+}
+
+void Database::forEachPlayer(
+    std::function<void(std::string_view username,
+                       std::string_view displayName,
+                       std::uint32_t rating)> const &callback) {
+    static std::string const sql =
+        std::format("SELECT username, display_name, rating FROM {:s}.{:s};",
                     PlayersDatabaseName,
-                    PlayersDatabaseName);
+                    PlayersTable);
+    auto statement = m_statements->acquire(sql);
 
-    char *errMsg = nullptr;
-    checkSqlStatus(sqlite3_exec(m_db, createStatement.c_str(), nullptr, nullptr, &errMsg));
-    checkAndFreeSqlErrorMsg(errMsg);
+    int status;
+    while ((status = sqlite3_step(statement)) == SQLITE_ROW) {
+        callback(getColumnView(statement, 0),
+                 getColumnView(statement, 1),
+                 std::uint32_t(sqlite3_column_int(statement, 2)));
+    }
+    checkSqlStatus(status);
 }
 
-void Database::insertGame(GameInstance const *game) {
+void Database::createGamesTable() {
 
-    // TODO: Add proper database querry for rowids of player and opponent.
-    std::int64_t playerRowId = 1;
-    std::int64_t opponentRowId = 1;
-    std::int64_t winnerRowId = 1;
+    // Players are referenced by their credentials, foreign keys can not cross attached
+    // databases. Moves are a MoveSequence bit stream, times are unix milliseconds.
+    std::string createStatement =
+        std::format("CREATE TABLE IF NOT EXISTS {:s}.{:s} ("
+                    "  player1_username TEXT NOT NULL, "
+                    "  player1_display_name TEXT NOT NULL, "
+                    "  player2_username TEXT NOT NULL, "
+                    "  player2_display_name TEXT NOT NULL, "
+                    "  result INTEGER NOT NULL, "
+                    "  move_count INTEGER NOT NULL, "
+                    "  moves BLOB NOT NULL, "
+                    "  start_time INTEGER NOT NULL, "
+                    "  end_time INTEGER NOT NULL);",
+                    GamesDatabaseName,
+                    GamesTable);
+    execute(createStatement);
+}
 
-    thread_local std::string insertStatement =
-        std::format("INSERT INTO {:s}.games VALUES (?1, ?2, ?3);", GamesDatabaseName);
-    thread_local sqlite3_stmt *preparedStatement = prepareSimpleStatement(insertStatement);
-    checkSqlStatus(sqlite3_reset(preparedStatement));
+void Database::insertGame(GameRecord const &game) {
+    static std::string const sql = std::format(
+        "INSERT INTO {:s}.{:s} VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9);",
+        GamesDatabaseName,
+        GamesTable);
+    auto statement = m_statements->acquire(sql);
+    sqlite3_stmt *preparedStatement = statement;
 
-    checkSqlStatus(sqlite3_bind_int(preparedStatement, 1, playerRowId));
-    checkSqlStatus(sqlite3_bind_int(preparedStatement, 2, opponentRowId));
-    checkSqlStatus(sqlite3_bind_int(preparedStatement, 3, winnerRowId));
+    auto bindText = [preparedStatement](int idx, std::string const &text) {
+        checkSqlStatus(sqlite3_bind_text(
+            preparedStatement, idx, text.data(), text.size(), SQLITE_TRANSIENT));
+    };
+    bindText(1, game.player1Username);
+    bindText(2, game.player1DisplayName);
+    bindText(3, game.player2Username);
+    bindText(4, game.player2DisplayName);
+    checkSqlStatus(sqlite3_bind_int(preparedStatement, 5, static_cast<int>(game.result)));
+    checkSqlStatus(sqlite3_bind_int(preparedStatement, 6, game.moves.size()));
+    std::vector<std::uint8_t> moves = game.moves.toBytes();
+    // A null pointer would bind NULL instead of an empty blob.
+    checkSqlStatus(moves.empty() ? sqlite3_bind_zeroblob(preparedStatement, 7, 0)
+                                 : sqlite3_bind_blob(preparedStatement,
+                                                     7,
+                                                     moves.data(),
+                                                     moves.size(),
+                                                     SQLITE_TRANSIENT));
+    checkSqlStatus(
+        sqlite3_bind_int64(preparedStatement, 8, toUnixMilliseconds(game.startTime)));
+    checkSqlStatus(
+        sqlite3_bind_int64(preparedStatement, 9, toUnixMilliseconds(game.endTime)));
 
     checkSqlStatus(sqlite3_step(preparedStatement));
 }
+
+void Database::forEachGame(std::function<void(GameRecord const &)> const &callback) {
+    static std::string const sql =
+        std::format("SELECT * FROM {:s}.{:s} ORDER BY rowid;", GamesDatabaseName, GamesTable);
+    auto statement = m_statements->acquire(sql);
+
+    int status;
+    while ((status = sqlite3_step(statement)) == SQLITE_ROW) {
+        auto const *blob =
+            static_cast<std::uint8_t const *>(sqlite3_column_blob(statement, 6));
+        auto moves = MoveSequence::fromBytes(
+            std::span(blob, std::size_t(sqlite3_column_bytes(statement, 6))),
+            std::uint32_t(sqlite3_column_int(statement, 5)));
+        if (!moves) {
+            std::cerr << "Skipping game with corrupt move sequence.\n";
+            continue;
+        }
+
+        callback(GameRecord{
+            .player1Username = getColumnText(statement, 0),
+            .player1DisplayName = getColumnText(statement, 1),
+            .player2Username = getColumnText(statement, 2),
+            .player2DisplayName = getColumnText(statement, 3),
+            .result = static_cast<GameResult>(sqlite3_column_int(statement, 4)),
+            .moves = *moves,
+            .startTime = fromUnixMilliseconds(sqlite3_column_int64(statement, 7)),
+            .endTime = fromUnixMilliseconds(sqlite3_column_int64(statement, 8)),
+        });
+    }
+    checkSqlStatus(status);
+}
+
+void Database::beginTransaction() { execute("BEGIN TRANSACTION;"); }
+
+void Database::commitTransaction() { execute("COMMIT TRANSACTION;"); }
+
+void Database::rollbackTransaction() { execute("ROLLBACK TRANSACTION;"); }
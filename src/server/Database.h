@@ -3,21 +3,83 @@
 
 #include <sqlite3.h>
 
+#include <chrono>
+#include <cstdint>
 #include <filesystem>
 #include <format>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
 
 #include <server/ConnectFourGame.h>
+#include <server/MoveSequence.h>
 #include <server/Player.h>
+#include <server/StatementCache.h>
 
+enum class GameResult : std::uint8_t { Player1Win = 0, Player2Win = 1, Draw = 2 };
+
+struct PlayerRecord {
+    std::string username;
+    std::string displayName;
+};
+
+struct RatedPlayerRecord {
+    std::string username;
+    std::string displayName;
+    std::uint32_t rating = 0U;
+};
+
+struct GameRecord {
+    std::string player1Username;
+    std::string player1DisplayName;
+    std::string player2Username;
+    std::string player2DisplayName;
+    GameResult result = GameResult::Draw;
+    // Replays the whole game.
+    MoveSequence moves;
+    std::chrono::system_clock::time_point startTime{};
+    std::chrono::system_clock::time_point endTime{};
+};
+
+// Connection to the players and games databases. Not thread safe, a Database object and its
+// prepared statements must only be used by one thread at a time. Use a DatabasePool to run
+// queries from several threads in parallel.
 class Database {
   public:
+    constexpr static std::size_t DefaultStatementCacheSize = 32U;
+
     Database(std::filesystem::path const &playerDatabasePath,
-             std::filesystem::path const &gamesDatabasePath);
+             std::filesystem::path const &gamesDatabasePath,
+             std::size_t statementCacheSize = DefaultStatementCacheSize);
 
     ~Database();
 
-    void insertPlayer(IPlayer const *player);
-    void insertGame(GameInstance const *game);
+    Database(Database const &) = delete;
+    Database &operator=(Database const &) = delete;
+
+    // Players that already exist are ignored.
+    void insertPlayer(std::string_view username, std::string_view displayName);
+    void insertGame(GameRecord const &game);
+    std::size_t getPlayerCount();
+    std::optional<RatedPlayerRecord> findPlayer(std::string_view username,
+                                                std::string_view displayName);
+    // Highest rated players first.
+    std::vector<RatedPlayerRecord> getTopPlayers(std::size_t limit);
+    // Streams all stored players with a single scan. Names are only valid during the call.
+    void forEachPlayer(
+        std::function<void(std::string_view username,
+                           std::string_view displayName,
+                           std::uint32_t rating)> const &callback);
+    // Streams all stored games in insertion order. Rows with a corrupt move sequence are
+    // skipped.
+    void forEachGame(std::function<void(GameRecord const &)> const &callback);
+
+    // Without an explicit transaction, every insert is committed on its own.
+    void beginTransaction();
+    void commitTransaction();
+    void rollbackTransaction();
 
   private:
     constexpr static std::string_view PlayersDatabaseName = "players_db";
@@ -25,13 +87,17 @@ class Database {
     constexpr static std::string_view PlayersTable = "players";
     constexpr static std::string_view GamesTable = "games";
 
+    void execute(std::string const &statement);
+    void attachDatabase(std::filesystem::path const &path, std::string_view name);
+
     void createPlayersTable();
     void createGamesTable();
 
-    sqlite3_stmt *prepareSimpleStatement(std::string const &statement);
-
   private:
     sqlite3 *m_db = nullptr;
+
+    // Created once m_db is open and destroyed before it is closed.
+    std::optional<StatementCache> m_statements;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,58 @@
+#include "DatabasePool.h"
+
+#include <utility>
+
+DatabasePool::Lease::~Lease() {
+    if (m_database) {
+        m_pool->release(std::move(m_database));
+    }
+}
+
+DatabasePool::DatabasePool(Params params) : m_params(std::move(params)) {
+    m_idleConnections.reserve(m_params.maxConnections);
+}
+
+auto DatabasePool::acquire() -> Lease {
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_connectionReleased.wait(lock, [this]() {
+            return !m_idleConnections.empty() ||
+                   m_openConnectionCount < m_params.maxConnections;
+        });
+
+        if (!m_idleConnections.empty()) {
+            std::unique_ptr<Database> database = std::move(m_idleConnections.back());
+            m_idleConnections.pop_back();
+            return Lease(this, std::move(database));
+        }
+        // The slot is reserved, the connection is opened without holding the lock.
+        ++m_openConnectionCount;
+    }
+
+    try {
+        return Lease(this,
+                     std::make_unique<Database>(m_params.playersDatabasePath,
+                                                m_params.gamesDatabasePath,
+                                                m_params.statementCacheSize));
+    } catch (...) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            --m_openConnectionCount;
+        }
+        m_connectionReleased.notify_one();
+        throw;
+    }
+}
+
+void DatabasePool::release(std::unique_ptr<Database> database) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_idleConnections.push_back(std::move(database));
+    }
+    m_connectionReleased.notify_one();
+}
+
+std::size_t DatabasePool::getOpenConnectionCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_openConnectionCount;
+}
@@ -0,0 +1,71 @@
+#ifndef DATABASE_POOL_H
+#define DATABASE_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <server/Database.h>
+
+// Pool of database connections, each with its own prepared statement cache. A thread checks
+// a connection out for a unit of work and owns it exclusively until the lease is dropped, so
+// read queries on different threads run in parallel. Connections are opened on demand.
+class DatabasePool {
+  public:
+    struct Params {
+        std::filesystem::path playersDatabasePath = "players.db";
+        std::filesystem::path gamesDatabasePath = "games.db";
+        // Usually the number of worker threads.
+        std::size_t maxConnections = 4U;
+        std::size_t statementCacheSize = Database::DefaultStatementCacheSize;
+    };
+
+    // Returns the connection to the pool on destruction.
+    class Lease {
+      public:
+        Lease(Lease &&other) noexcept = default;
+        Lease &operator=(Lease &&) = delete;
+        ~Lease();
+
+        Database &operator*() const { return *m_database; }
+        Database *operator->() const { return m_database.get(); }
+
+      private:
+        friend class DatabasePool;
+        Lease(DatabasePool *pool, std::unique_ptr<Database> database)
+            : m_pool(pool), m_database(std::move(database)) {}
+
+        DatabasePool *m_pool;
+        std::unique_ptr<Database> m_database;
+    };
+
+    explicit DatabasePool(Params params);
+    // All leases must have been returned. Finalizes the statements and closes the connections.
+    ~DatabasePool() = default;
+
+    DatabasePool(DatabasePool const &) = delete;
+    DatabasePool &operator=(DatabasePool const &) = delete;
+
+    // Blocks while all connections are checked out. Throws if a new connection can not be
+    // opened.
+    Lease acquire();
+
+    std::size_t getOpenConnectionCount() const;
+
+  private:
+    void release(std::unique_ptr<Database> database);
+
+  private:
+    Params m_params;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_connectionReleased;
+    std::vector<std::unique_ptr<Database>> m_idleConnections;
+    // Idle and checked out connections.
+    std::size_t m_openConnectionCount = 0U;
+};
+
+#endif
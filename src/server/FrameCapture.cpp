@@ -0,0 +1,162 @@
+#include "FrameCapture.h"
+
+#include <array>
+#include <format>
+#include <stdexcept>
+#include <utility>
+
+#include <server/MonotonicTime.h>
+
+namespace {
+constexpr std::array<char, 4> CaptureMagic{'C', '4', 'F', 'C'};
+constexpr std::uint8_t CaptureVersion = 1U;
+
+void appendVarint(std::string &out, std::uint64_t value) {
+    while (value >= 0x80U) {
+        out.push_back(static_cast<char>(value | 0x80U));
+        value >>= 7U;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+// Returns nullopt only at a clean end of the capture.
+std::optional<std::uint8_t> readByte(std::istream &in) {
+    int value = in.get();
+    if (value == std::istream::traits_type::eof()) {
+        return std::nullopt;
+    }
+    return std::uint8_t(value);
+}
+
+std::uint64_t readVarint(std::istream &in) {
+    std::uint64_t value = 0U;
+    for (std::uint32_t shift = 0; shift < 64U; shift += 7U) {
+        auto byte = readByte(in);
+        if (!byte) {
+            throw std::runtime_error("Unexpected end of frame capture.");
+        }
+        value |= std::uint64_t(*byte & 0x7FU) << shift;
+        if (!(*byte & 0x80U)) {
+            return value;
+        }
+    }
+    throw std::runtime_error("Corrupt varint in frame capture.");
+}
+} // namespace
+
+FrameRecorder::FrameRecorder(Params params)
+    : m_params(std::move(params)), m_out(m_params.path, std::ios::binary | std::ios::trunc),
+      m_startTime(getMonotonicNanoseconds()), m_lastTime(m_startTime) {
+    if (!m_out) {
+        throw std::runtime_error(
+            std::format("Failed to create frame capture {:s}.", m_params.path.string()));
+    }
+    m_out.write(CaptureMagic.data(), CaptureMagic.size());
+    m_out.put(static_cast<char>(CaptureVersion));
+
+    m_writerThread = std::jthread([this](std::stop_token stopToken) { run(stopToken); });
+}
+
+FrameRecorder::~FrameRecorder() {
+    m_writerThread.request_stop();
+    m_flushCondition.notify_all();
+    m_writerThread.join();
+    flush();
+}
+
+void FrameRecorder::recordFrame(ConnectionId connection, std::string_view payload) {
+    append(CapturedRecordType::Frame, connection, payload);
+}
+
+void FrameRecorder::recordClose(ConnectionId connection) {
+    append(CapturedRecordType::Close, connection, {});
+}
+
+void FrameRecorder::append(CapturedRecordType type,
+                           ConnectionId connection,
+                           std::string_view payload) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Taken under the lock, so that deltas are never negative.
+    std::uint64_t now = getMonotonicNanoseconds();
+    auto [iter, inserted] = m_connectionIds.try_emplace(connection, m_nextConnectionId);
+    if (inserted) {
+        ++m_nextConnectionId;
+    }
+
+    m_buffer.push_back(static_cast<char>(type));
+    appendVarint(m_buffer, iter->second);
+    appendVarint(m_buffer, now - m_lastTime);
+    m_lastTime = now;
+
+    if (type == CapturedRecordType::Frame) {
+        appendVarint(m_buffer, payload.size());
+        m_buffer.append(payload);
+    } else {
+        // A later connection may get the same pointer based id.
+        m_connectionIds.erase(iter);
+    }
+}
+
+void FrameRecorder::run(std::stop_token stopToken) {
+    while (!stopToken.stop_requested()) {
+        {
+            std::unique_lock<std::mutex> lock(m_flushMutex);
+            m_flushCondition.wait_for(
+                lock, stopToken, m_params.flushInterval, []() { return false; });
+        }
+        flush();
+    }
+}
+
+void FrameRecorder::flush() {
+    std::string buffer;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        buffer.swap(m_buffer);
+    }
+    if (buffer.empty()) {
+        return;
+    }
+    m_out.write(buffer.data(), std::streamsize(buffer.size()));
+    m_out.flush();
+}
+
+FrameCaptureReader::FrameCaptureReader(std::istream &in) : m_in(in) {
+    std::array<char, 4> magic{};
+    if (!m_in.read(magic.data(), magic.size()) || magic != CaptureMagic) {
+        throw std::runtime_error("Not a frame capture.");
+    }
+    auto version = readByte(m_in);
+    if (!version || *version != CaptureVersion) {
+        throw std::runtime_error("Unsupported frame capture version.");
+    }
+}
+
+std::optional<CapturedRecord> FrameCaptureReader::read() {
+    auto type = readByte(m_in);
+    if (!type) {
+        return std::nullopt;
+    }
+
+    CapturedRecord record;
+    record.type = CapturedRecordType(*type);
+    if (record.type != CapturedRecordType::Frame && record.type != CapturedRecordType::Close) {
+        throw std::runtime_error("Corrupt record type in frame capture.");
+    }
+    record.connection = std::uint32_t(readVarint(m_in));
+    m_time += std::chrono::nanoseconds(readVarint(m_in));
+    record.time = m_time;
+
+    if (record.type == CapturedRecordType::Frame) {
+        std::uint64_t const size = readVarint(m_in);
+        if (size > MaxFrameSize) {
+            throw std::runtime_error("Corrupt frame size in frame capture.");
+        }
+        record.payload.resize(std::size_t(size));
+        if (!m_in.read(record.payload.data(), std::streamsize(record.payload.size()))) {
+            throw std::runtime_error("Unexpected end of frame capture.");
+        }
+    }
+    return record;
+}
@@ -0,0 +1,96 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <istream>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+#include <server/ConnectionMetadata.h>
+
+// Capture of inbound websocket traffic, replayed as a reproducible benchmark. After a "C4FC"
+// magic and a version, every record is
+//   u8 type | varint connection | varint time delta (ns) | varint size | payload
+// The payload is only present in frame records. Connections are numbered from one in order
+// of their first frame, times are deltas to the previous record.
+enum class CapturedRecordType : std::uint8_t { Frame = 1, Close = 2 };
+
+struct CapturedRecord {
+    CapturedRecordType type = CapturedRecordType::Frame;
+    std::uint32_t connection = 0U;
+    // Since the start of the capture.
+    std::chrono::nanoseconds time{};
+    std::string payload;
+};
+
+// Records are buffered in memory and written by a background thread, so the I/O thread only
+// pays for a copy of the payload.
+class FrameRecorder {
+  public:
+    struct Params {
+        std::filesystem::path path = "frames.c4fc";
+        std::chrono::milliseconds flushInterval{100};
+    };
+
+    // Throws if the capture file can not be created.
+    explicit FrameRecorder(Params params);
+    // Writes all buffered records.
+    ~FrameRecorder();
+
+    FrameRecorder(FrameRecorder const &) = delete;
+    FrameRecorder &operator=(FrameRecorder const &) = delete;
+
+    // Safe to call from any thread.
+    void recordFrame(ConnectionId connection, std::string_view payload);
+    void recordClose(ConnectionId connection);
+
+  private:
+    void append(CapturedRecordType type, ConnectionId connection, std::string_view payload);
+    void run(std::stop_token stopToken);
+    // Writer thread only, or after it has stopped.
+    void flush();
+
+  private:
+    Params m_params;
+    std::ofstream m_out;
+
+    std::mutex m_mutex;
+    std::string m_buffer;
+    std::unordered_map<ConnectionId, std::uint32_t> m_connectionIds;
+    std::uint32_t m_nextConnectionId = 1U;
+    std::uint64_t m_startTime;
+    std::uint64_t m_lastTime;
+
+    std::mutex m_flushMutex;
+    std::condition_variable_any m_flushCondition;
+    // Declared last, so that it is stopped before the buffer goes away.
+    std::jthread m_writerThread;
+};
+
+class FrameCaptureReader {
+  public:
+    // Larger frames are treated as a corrupt capture, websocketpp rejects them by default.
+    static constexpr std::size_t MaxFrameSize = std::size_t(32U) << 20U;
+
+    // Throws if the capture header is invalid.
+    explicit FrameCaptureReader(std::istream &in);
+
+    // Returns nullopt at the end of the capture. Throws on a corrupt record.
+    std::optional<CapturedRecord> read();
+
+  private:
+    std::istream &m_in;
+    std::chrono::nanoseconds m_time{};
+};
+
+#endif
@@ -0,0 +1,163 @@
+#include "GameArchive.h"
+
+#include <array>
+#include <chrono>
+#include <stdexcept>
+#include <string_view>
+#include <tuple>
+
+namespace {
+constexpr std::array<char, 4> ArchiveMagic{'C', '4', 'G', 'A'};
+constexpr std::uint8_t ArchiveVersion = 1U;
+
+void writeByte(std::ostream &out, std::uint8_t value) { out.put(static_cast<char>(value)); }
+
+void writeVarint(std::ostream &out, std::uint64_t value) {
+    while (value >= 0x80U) {
+        writeByte(out, std::uint8_t(value | 0x80U));
+        value >>= 7U;
+    }
+    writeByte(out, std::uint8_t(value));
+}
+
+void writeString(std::ostream &out, std::string const &str) {
+    if (str.size() > 0xFFU) {
+        throw std::invalid_argument("Archived names can not be longer than 255 bytes.");
+    }
+    writeByte(out, std::uint8_t(str.size()));
+    out.write(str.data(), std::streamsize(str.size()));
+}
+
+std::uint8_t readByte(std::istream &in) {
+    int value = in.get();
+    if (value == std::istream::traits_type::eof()) {
+        throw std::runtime_error("Unexpected end of game archive.");
+    }
+    return std::uint8_t(value);
+}
+
+std::uint64_t readVarint(std::istream &in) {
+    std::uint64_t value = 0U;
+    for (std::uint32_t shift = 0; shift < 64U; shift += 7U) {
+        std::uint8_t byte = readByte(in);
+        value |= std::uint64_t(byte & 0x7FU) << shift;
+        if (!(byte & 0x80U)) {
+            return value;
+        }
+    }
+    throw std::runtime_error("Corrupt varint in game archive.");
+}
+
+std::string readString(std::istream &in) {
+    std::string str(readByte(in), '\0');
+    if (!in.read(str.data(), std::streamsize(str.size()))) {
+        throw std::runtime_error("Unexpected end of game archive.");
+    }
+    return str;
+}
+
+std::uint64_t toUnixMilliseconds(std::chrono::system_clock::time_point time) {
+    return std::uint64_t(
+        std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch())
+            .count());
+}
+} // namespace
+
+GameArchiveWriter::GameArchiveWriter(std::ostream &out) : m_out(out) {
+    m_out.write(ArchiveMagic.data(), ArchiveMagic.size());
+    writeByte(m_out, ArchiveVersion);
+}
+
+void GameArchiveWriter::writePlayer(std::string const &username,
+                                    std::string const &displayName) {
+    std::string key = username;
+    key += '\0';
+    key += displayName;
+
+    auto [iter, inserted] = m_playerIds.try_emplace(std::move(key), m_playerIds.size());
+    if (!inserted) {
+        writeVarint(m_out, iter->second + 1U);
+        return;
+    }
+    writeVarint(m_out, 0U);
+    writeString(m_out, username);
+    writeString(m_out, displayName);
+}
+
+void GameArchiveWriter::write(GameRecord const &game) {
+    writeByte(m_out, std::uint8_t(game.moves.size()));
+    writeByte(m_out, static_cast<std::uint8_t>(game.result));
+
+    std::uint64_t startTime = toUnixMilliseconds(game.startTime);
+    std::uint64_t endTime = toUnixMilliseconds(game.endTime);
+    writeVarint(m_out, startTime);
+    writeVarint(m_out, endTime > startTime ? endTime - startTime : 0U);
+
+    writePlayer(game.player1Username, game.player1DisplayName);
+    writePlayer(game.player2Username, game.player2DisplayName);
+
+    auto moves = game.moves.toBytes();
+    m_out.write(reinterpret_cast<char const *>(moves.data()), std::streamsize(moves.size()));
+    if (!m_out) {
+        throw std::runtime_error("Failed to write game archive.");
+    }
+}
+
+GameArchiveReader::GameArchiveReader(std::istream &in) : m_in(in) {
+    std::array<char, ArchiveMagic.size()> magic{};
+    m_in.read(magic.data(), magic.size());
+    if (!m_in || magic != ArchiveMagic) {
+        throw std::runtime_error("Not a game archive.");
+    }
+    if (readByte(m_in) != ArchiveVersion) {
+        throw std::runtime_error("Unsupported game archive version.");
+    }
+}
+
+auto GameArchiveReader::readPlayer() -> std::pair<std::string, std::string> const & {
+    std::uint64_t reference = readVarint(m_in);
+    if (reference == 0U) {
+        std::string username = readString(m_in);
+        std::string displayName = readString(m_in);
+        return m_players.emplace_back(std::move(username), std::move(displayName));
+    }
+    if (reference > m_players.size()) {
+        throw std::runtime_error("Corrupt player reference in game archive.");
+    }
+    return m_players[reference - 1U];
+}
+
+std::optional<GameRecord> GameArchiveReader::read() {
+    if (m_in.peek() == std::istream::traits_type::eof()) {
+        return std::nullopt;
+    }
+
+    std::uint8_t moveCount = readByte(m_in);
+    std::uint8_t result = readByte(m_in);
+    if (result > static_cast<std::uint8_t>(GameResult::Draw)) {
+        throw std::runtime_error("Corrupt game result in game archive.");
+    }
+
+    auto startTime = std::chrono::system_clock::time_point(
+        std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            std::chrono::milliseconds(readVarint(m_in))));
+    auto endTime = startTime + std::chrono::milliseconds(readVarint(m_in));
+
+    GameRecord game;
+    game.result = static_cast<GameResult>(result);
+    game.startTime = startTime;
+    game.endTime = endTime;
+    std::tie(game.player1Username, game.player1DisplayName) = readPlayer();
+    std::tie(game.player2Username, game.player2DisplayName) = readPlayer();
+
+    std::vector<std::uint8_t> moves(MoveSequence::getByteCount(moveCount));
+    if (!m_in.read(reinterpret_cast<char *>(moves.data()), std::streamsize(moves.size()))) {
+        throw std::runtime_error("Unexpected end of game archive.");
+    }
+    auto sequence = MoveSequence::fromBytes(moves, moveCount);
+    if (!sequence) {
+        throw std::runtime_error("Corrupt move sequence in game archive.");
+    }
+    game.moves = *sequence;
+    return game;
+}
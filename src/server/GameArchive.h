@@ -0,0 +1,53 @@
+#ifndef GAME_ARCHIVE_H
+#define GAME_ARCHIVE_H
+
+#include <cstdint>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <server/Database.h>
+
+// Compact binary archive of finished games, meant for bulk export, import and offline
+// analysis. After a "C4GA" magic and a version, every game is stored as
+//   u8 move count | u8 result | varint start time (unix ms) | varint duration (ms) |
+//   player one | player two | MoveSequence bytes
+// A player is a varint reference to an earlier player in the archive (index + 1) or 0
+// followed by the length prefixed username and display name of a new player, so names are
+// stored once per archive.
+class GameArchiveWriter {
+  public:
+    explicit GameArchiveWriter(std::ostream &out);
+
+    void write(GameRecord const &game);
+
+  private:
+    void writePlayer(std::string const &username, std::string const &displayName);
+
+  private:
+    std::ostream &m_out;
+    // Keyed by username and display name separated by a zero byte.
+    std::unordered_map<std::string, std::uint64_t> m_playerIds;
+};
+
+class GameArchiveReader {
+  public:
+    // Throws if the archive header is invalid.
+    explicit GameArchiveReader(std::istream &in);
+
+    // Returns nullopt at the end of the archive. Throws on a corrupt record.
+    std::optional<GameRecord> read();
+
+  private:
+    std::pair<std::string, std::string> const &readPlayer();
+
+  private:
+    std::istream &m_in;
+    std::vector<std::pair<std::string, std::string>> m_players;
+};
+
+#endif
@@ -0,0 +1,87 @@
+#include <cstring>
+#include <exception>
+#include <format>
+#include <fstream>
+#include <iostream>
+
+#include <server/Database.h>
+#include <server/GameArchive.h>
+
+namespace {
+// Games imported per transaction.
+constexpr std::size_t ImportBatchSize = 10000U;
+
+void printUsage() {
+    std::cerr << "Usage:\n"
+                 "  game_archive export <players.db> <games.db> <archive>\n"
+                 "  game_archive import <archive> <players.db> <games.db>\n";
+}
+
+std::size_t exportGames(Database &database, std::ostream &out) {
+    GameArchiveWriter writer(out);
+    std::size_t count = 0U;
+    database.forEachGame([&](GameRecord const &game) {
+        writer.write(game);
+        ++count;
+    });
+    return count;
+}
+
+std::size_t importGames(Database &database, std::istream &in) {
+    GameArchiveReader reader(in);
+    std::size_t count = 0U;
+
+    database.beginTransaction();
+    try {
+        while (auto game = reader.read()) {
+            database.insertPlayer(game->player1Username, game->player1DisplayName);
+            database.insertPlayer(game->player2Username, game->player2DisplayName);
+            database.insertGame(*game);
+
+            if (++count % ImportBatchSize == 0U) {
+                database.commitTransaction();
+                database.beginTransaction();
+            }
+        }
+        database.commitTransaction();
+    } catch (...) {
+        database.rollbackTransaction();
+        throw;
+    }
+    return count;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc != 5) {
+        printUsage();
+        return 1;
+    }
+
+    try {
+        if (std::strcmp(argv[1], "export") == 0) {
+            Database database(argv[2], argv[3]);
+            std::ofstream out(argv[4], std::ios::binary);
+            if (!out) {
+                std::cerr << std::format("Failed to open {:s}.\n", argv[4]);
+                return 1;
+            }
+            std::cout << std::format("Exported {:d} games.\n", exportGames(database, out));
+        } else if (std::strcmp(argv[1], "import") == 0) {
+            std::ifstream in(argv[2], std::ios::binary);
+            if (!in) {
+                std::cerr << std::format("Failed to open {:s}.\n", argv[2]);
+                return 1;
+            }
+            Database database(argv[3], argv[4]);
+            std::cout << std::format("Imported {:d} games.\n", importGames(database, in));
+        } else {
+            printUsage();
+            return 1;
+        }
+    } catch (std::exception const &e) {
+        std::cerr << std::format("Failed with error: {:s}\n", e.what());
+        return 1;
+    }
+    return 0;
+}
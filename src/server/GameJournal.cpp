@@ -0,0 +1,508 @@
+#include "GameJournal.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <format>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <system_error>
+
+namespace {
+constexpr std::string_view SegmentPrefix = "journal-";
+constexpr std::string_view SegmentExtension = ".log";
+
+std::array<std::uint32_t, 256> makeCrcTable() {
+    std::array<std::uint32_t, 256> table{};
+    for (std::uint32_t i = 0; i < table.size(); ++i) {
+        std::uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc & 1U) ? (crc >> 1U) ^ 0xEDB88320U : crc >> 1U;
+        }
+        table[i] = crc;
+    }
+    return table;
+}
+
+// CRC-32 (IEEE 802.3).
+std::uint32_t updateCrc(std::uint32_t crc, std::span<std::byte const> data) {
+    static std::array<std::uint32_t, 256> const table = makeCrcTable();
+    for (std::byte byte : data) {
+        crc = table[(crc ^ std::uint32_t(byte)) & 0xFFU] ^ (crc >> 8U);
+    }
+    return crc;
+}
+
+// Payloads are written in host byte order.
+class PayloadWriter {
+  public:
+    template <typename T>
+    void write(T value) {
+        auto const *bytes = reinterpret_cast<std::byte const *>(&value);
+        m_data.insert(m_data.end(), bytes, bytes + sizeof(T));
+    }
+
+    void writeString(std::string_view str) {
+        std::size_t size = std::min<std::size_t>(str.size(), 0xFFU);
+        write(std::uint8_t(size));
+        auto const *bytes = reinterpret_cast<std::byte const *>(str.data());
+        m_data.insert(m_data.end(), bytes, bytes + size);
+    }
+
+    std::span<std::byte const> getData() const { return m_data; }
+
+  private:
+    std::vector<std::byte> m_data;
+};
+
+class PayloadReader {
+  public:
+    explicit PayloadReader(std::span<std::byte const> data) : m_data(data) {}
+
+    template <typename T>
+    bool read(T &value) {
+        if (m_data.size() < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(&value, m_data.data(), sizeof(T));
+        m_data = m_data.subspan(sizeof(T));
+        return true;
+    }
+
+    bool readString(std::string &str) {
+        std::uint8_t size = 0U;
+        if (!read(size) || m_data.size() < size) {
+            return false;
+        }
+        str.assign(reinterpret_cast<char const *>(m_data.data()), size);
+        m_data = m_data.subspan(size);
+        return true;
+    }
+
+  private:
+    std::span<std::byte const> m_data;
+};
+
+std::int64_t toUnixMilliseconds(std::chrono::system_clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch())
+        .count();
+}
+
+[[noreturn]] void throwSystemError(std::string const &what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+} // namespace
+
+GameJournal::GameJournal(Params params) : m_params(std::move(params)) {
+    std::size_t maxRecordSize =
+        sizeof(RecordHeader) + std::numeric_limits<std::uint16_t>::max();
+    if (m_params.segmentSize < maxRecordSize) {
+        throw std::invalid_argument("Journal segments must fit the largest record.");
+    }
+    std::filesystem::create_directories(m_params.directory);
+
+    std::unordered_map<GameId, RecoveredGame> games;
+    m_recoveredSegments = listSegments();
+    for (std::uint64_t sequence : m_recoveredSegments) {
+        recoverSegment(sequence, games);
+    }
+    for (auto &[id, game] : games) {
+        m_recoveredGames.push_back(std::move(game));
+    }
+    std::ranges::sort(m_recoveredGames, {}, &RecoveredGame::startTime);
+
+    std::uint64_t sequence =
+        m_recoveredSegments.empty() ? 0U : m_recoveredSegments.back() + 1U;
+    m_segment = openSegment(sequence);
+    m_oldestSegment = sequence;
+
+    PayloadWriter checkpoint;
+    checkpoint.write(toUnixMilliseconds(std::chrono::system_clock::now()));
+    append(RecordType::Checkpoint, checkpoint.getData());
+
+    m_syncThread =
+        std::jthread([this](std::stop_token stopToken) { runSyncThread(stopToken); });
+}
+
+GameJournal::~GameJournal() {
+    m_syncThread.request_stop();
+    m_syncCondition.notify_all();
+    if (m_syncThread.joinable()) {
+        m_syncThread.join();
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    syncLocked(true);
+    closeSegment(m_segment);
+    for (Segment &retired : m_retiredSegments) {
+        ::msync(retired.data, retired.size, MS_SYNC);
+        closeSegment(retired);
+    }
+    // Left empty, recovery finds no records in it.
+    if (m_spareSegment) {
+        closeSegment(*m_spareSegment);
+    }
+}
+
+std::filesystem::path GameJournal::getSegmentPath(std::uint64_t sequence) const {
+    return m_params.directory /
+           std::format("{:s}{:020d}{:s}", SegmentPrefix, sequence, SegmentExtension);
+}
+
+std::vector<std::uint64_t> GameJournal::listSegments() const {
+    std::vector<std::uint64_t> sequences;
+    for (auto const &entry : std::filesystem::directory_iterator(m_params.directory)) {
+        std::string name = entry.path().filename().string();
+        if (!name.starts_with(SegmentPrefix) || !name.ends_with(SegmentExtension)) {
+            continue;
+        }
+        std::size_t numberSize = name.size() - SegmentPrefix.size() - SegmentExtension.size();
+        std::string number = name.substr(SegmentPrefix.size(), numberSize);
+        try {
+            sequences.push_back(std::stoull(number));
+        } catch (std::exception const &) {
+            std::cerr << std::format("Ignoring unexpected journal file {:s}.\n", name);
+        }
+    }
+    std::ranges::sort(sequences);
+    return sequences;
+}
+
+void GameJournal::recoverSegment(std::uint64_t sequence,
+                                 std::unordered_map<GameId, RecoveredGame> &games) const {
+    auto path = getSegmentPath(sequence);
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throwSystemError(std::format("Failed to open journal segment {:s}", path.string()));
+    }
+    struct stat fileStat {};
+    if (::fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+        ::close(fd);
+        return;
+    }
+    auto size = std::size_t(fileStat.st_size);
+    void *mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        throwSystemError(std::format("Failed to map journal segment {:s}", path.string()));
+    }
+
+    std::span<std::byte const> data(static_cast<std::byte const *>(mapping), size);
+    std::size_t offset = 0U;
+    while (offset + sizeof(RecordHeader) <= data.size()) {
+        RecordHeader header{};
+        std::memcpy(&header, data.data() + offset, sizeof(header));
+        if (header.payloadSize == 0U ||
+            offset + sizeof(header) + header.payloadSize > data.size()) {
+            break;
+        }
+
+        auto checked = data.subspan(offset + sizeof(header.crc),
+                                    sizeof(header) - sizeof(header.crc) + header.payloadSize);
+        if (updateCrc(0xFFFFFFFFU, checked) != header.crc) {
+            // Torn write, nothing after it was completed.
+            std::cerr << std::format("Journal segment {:d} is truncated at offset {:d}.\n",
+                                     sequence,
+                                     offset);
+            break;
+        }
+
+        PayloadReader reader(data.subspan(offset + sizeof(header), header.payloadSize));
+        offset += sizeof(header) + header.payloadSize;
+
+        if (header.type == RecordType::Checkpoint) {
+            games.clear();
+            continue;
+        }
+
+        GameId game = 0U;
+        if (!reader.read(game)) {
+            continue;
+        }
+        switch (header.type) {
+        case RecordType::GameCreated: {
+            RecoveredGame recovered;
+            std::int64_t startTime = 0;
+            if (reader.read(startTime) && reader.readString(recovered.player1Username) &&
+                reader.readString(recovered.player1DisplayName) &&
+                reader.readString(recovered.player2Username) &&
+                reader.readString(recovered.player2DisplayName)) {
+                recovered.startTime = std::chrono::system_clock::time_point(
+                    std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                        std::chrono::milliseconds(startTime)));
+                games[game] = std::move(recovered);
+            }
+            break;
+        }
+        case RecordType::Move: {
+            std::uint8_t column = 0U;
+            auto iter = games.find(game);
+            if (iter != games.end() && reader.read(column) &&
+                column < MoveSequence::ColumnCount &&
+                iter->second.moves.size() < MoveSequence::MaxMoveCount) {
+                iter->second.moves.push(column);
+            }
+            break;
+        }
+        case RecordType::GameEnd:
+            games.erase(game);
+            break;
+        default:
+            break;
+        }
+    }
+    ::munmap(mapping, size);
+}
+
+auto GameJournal::openSegment(std::uint64_t sequence) -> Segment {
+    auto path = getSegmentPath(sequence);
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throwSystemError(std::format("Failed to create journal segment {:s}", path.string()));
+    }
+
+    // Allocated up front, so that appends never extend the file.
+    int status = ::posix_fallocate(fd, 0, off_t(m_params.segmentSize));
+    if (status != 0) {
+        ::close(fd);
+        errno = status;
+        throwSystemError(
+            std::format("Failed to allocate journal segment {:s}", path.string()));
+    }
+
+    void *mapping =
+        ::mmap(nullptr, m_params.segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        ::close(fd);
+        throwSystemError(std::format("Failed to map journal segment {:s}", path.string()));
+    }
+    return Segment{.sequence = sequence,
+                   .fd = fd,
+                   .data = static_cast<std::byte *>(mapping),
+                   .size = m_params.segmentSize};
+}
+
+void GameJournal::closeSegment(Segment &segment) {
+    if (segment.data) {
+        ::munmap(segment.data, segment.size);
+    }
+    if (segment.fd >= 0) {
+        ::close(segment.fd);
+    }
+    segment = Segment{};
+}
+
+void GameJournal::append(RecordType type, std::span<std::byte const> payload) {
+    RecordHeader header{.crc = 0U,
+                        .payloadSize = std::uint16_t(payload.size()),
+                        .type = type,
+                        .reserved = 0U};
+    auto const *headerBytes = reinterpret_cast<std::byte const *>(&header);
+    std::uint32_t crc = updateCrc(
+        0xFFFFFFFFU,
+        std::span(headerBytes + sizeof(header.crc), sizeof(header) - sizeof(header.crc)));
+    header.crc = updateCrc(crc, payload);
+
+    std::size_t recordSize = sizeof(header) + payload.size();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_offset + recordSize > m_segment.size && !rollSegmentLocked(lock, recordSize)) {
+        std::cerr << std::format("Dropped journal record of type {:d}.\n", int(type));
+        return;
+    }
+
+    // Payload first, so that a record whose header is visible is complete.
+    std::byte *record = m_segment.data + m_offset;
+    std::memcpy(record + sizeof(header), payload.data(), payload.size());
+    std::memcpy(record, &header, sizeof(header));
+    m_offset += recordSize;
+
+    if (type == RecordType::GameCreated) {
+        GameId game = 0U;
+        std::memcpy(&game, payload.data(), sizeof(game));
+        m_gameSegments[game] = m_segment.sequence;
+    } else if (type == RecordType::GameEnd) {
+        GameId game = 0U;
+        std::memcpy(&game, payload.data(), sizeof(game));
+        m_gameSegments.erase(game);
+    }
+}
+
+bool GameJournal::rollSegmentLocked(std::unique_lock<std::mutex> &lock,
+                                    std::size_t recordSize) {
+    m_spareCondition.wait(lock, [this]() { return !m_preparingSpare; });
+    // Another appender rolled while the lock was released.
+    if (m_offset + recordSize <= m_segment.size) {
+        return true;
+    }
+    if (!m_spareSegment) {
+        // The sync thread failed or has not run yet.
+        try {
+            m_spareSegment = openSegment(m_segment.sequence + 1U);
+        } catch (std::exception const &e) {
+            std::cerr << std::format("Failed to roll the journal: {:s}.\n", e.what());
+            return false;
+        }
+    }
+
+    m_retiredSegments.push_back(m_segment);
+    m_segment = *m_spareSegment;
+    m_spareSegment.reset();
+    m_offset = 0U;
+    m_syncedOffset = 0U;
+
+    wakeSyncThread();
+    return true;
+}
+
+std::vector<std::uint64_t> GameJournal::takeUnusedSegmentsLocked() {
+    std::uint64_t oldestNeeded = m_segment.sequence;
+    for (auto [game, sequence] : m_gameSegments) {
+        oldestNeeded = std::min(oldestNeeded, sequence);
+    }
+
+    std::vector<std::uint64_t> unused;
+    for (; m_oldestSegment < oldestNeeded; ++m_oldestSegment) {
+        unused.push_back(m_oldestSegment);
+    }
+    return unused;
+}
+
+std::vector<GameJournal::RecoveredGame> GameJournal::takeRecoveredGames() {
+    return std::move(m_recoveredGames);
+}
+
+void GameJournal::completeRecovery() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        syncLocked(true);
+    }
+
+    for (std::uint64_t sequence : m_recoveredSegments) {
+        std::error_code ec;
+        std::filesystem::remove(getSegmentPath(sequence), ec);
+    }
+    m_recoveredSegments.clear();
+}
+
+void GameJournal::gameCreated(GameId game,
+                              std::string_view player1Username,
+                              std::string_view player1DisplayName,
+                              std::string_view player2Username,
+                              std::string_view player2DisplayName,
+                              std::chrono::system_clock::time_point startTime) {
+    PayloadWriter payload;
+    payload.write(game);
+    payload.write(toUnixMilliseconds(startTime));
+    payload.writeString(player1Username);
+    payload.writeString(player1DisplayName);
+    payload.writeString(player2Username);
+    payload.writeString(player2DisplayName);
+    append(RecordType::GameCreated, payload.getData());
+}
+
+void GameJournal::moveMade(GameId game, std::uint32_t columnIdx) {
+    // Hot path, no allocation.
+    std::array<std::byte, sizeof(GameId) + 1U> payload;
+    std::memcpy(payload.data(), &game, sizeof(game));
+    payload.back() = std::byte(columnIdx);
+    append(RecordType::Move, payload);
+}
+
+void GameJournal::gameEnded(GameId game) {
+    std::array<std::byte, sizeof(GameId)> payload;
+    std::memcpy(payload.data(), &game, sizeof(game));
+    append(RecordType::GameEnd, payload);
+}
+
+void GameJournal::syncLocked(bool wait) {
+    if (m_syncedOffset == m_offset) {
+        return;
+    }
+
+    // msync needs a page aligned start.
+    static std::size_t const pageSize = std::size_t(::sysconf(_SC_PAGESIZE));
+    std::size_t begin = m_syncedOffset / pageSize * pageSize;
+    if (::msync(m_segment.data + begin, m_offset - begin, wait ? MS_SYNC : MS_ASYNC) != 0) {
+        std::cerr << std::format("Failed to sync journal segment {:d}: {:s}.\n",
+                                 m_segment.sequence,
+                                 std::strerror(errno));
+        return;
+    }
+    m_syncedOffset = m_offset;
+}
+
+void GameJournal::runSyncThread(std::stop_token stopToken) {
+    while (!stopToken.stop_requested()) {
+        prepareSpareSegment();
+
+        std::vector<Segment> retired;
+        std::vector<std::uint64_t> unused;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            syncLocked(false);
+            retired.swap(m_retiredSegments);
+            unused = takeUnusedSegmentsLocked();
+        }
+
+        // File system work is done without blocking appends.
+        for (Segment &segment : retired) {
+            ::msync(segment.data, segment.size, MS_ASYNC);
+            closeSegment(segment);
+        }
+        for (std::uint64_t sequence : unused) {
+            std::error_code ec;
+            std::filesystem::remove(getSegmentPath(sequence), ec);
+            if (ec) {
+                std::cerr << std::format("Failed to delete journal segment {:d}: {:s}.\n",
+                                         sequence,
+                                         ec.message());
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(m_syncMutex);
+        m_syncCondition.wait_for(
+            lock, stopToken, m_params.syncInterval, [this]() { return m_syncRequested; });
+        m_syncRequested = false;
+    }
+}
+
+void GameJournal::prepareSpareSegment() {
+    std::uint64_t sequence = 0U;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_spareSegment || m_preparingSpare) {
+            return;
+        }
+        m_preparingSpare = true;
+        sequence = m_segment.sequence + 1U;
+    }
+
+    std::optional<Segment> spare;
+    try {
+        spare = openSegment(sequence);
+    } catch (std::exception const &e) {
+        std::cerr << std::format("Failed to prepare journal segment: {:s}.\n", e.what());
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_spareSegment = spare;
+        m_preparingSpare = false;
+    }
+    m_spareCondition.notify_all();
+}
+
+void GameJournal::wakeSyncThread() {
+    {
+        std::lock_guard<std::mutex> lock(m_syncMutex);
+        m_syncRequested = true;
+    }
+    m_syncCondition.notify_all();
+}
@@ -0,0 +1,156 @@
+#ifndef GAME_JOURNAL_H
+#define GAME_JOURNAL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <server/MoveSequence.h>
+
+// Append-only journal of game events in pre-allocated, memory mapped segment files. Appending
+// a record is a memcpy into the mapping, so it survives a crash of the process right away.
+// Mapped pages are flushed asynchronously (msync) every sync interval, which bounds the loss
+// on a crash of the machine. Every record carries a CRC, torn records at the end of a segment
+// are detected and ignored on recovery.
+//
+// The next segment is created and the previous one flushed and closed by the sync thread, so
+// moving on to a new segment only swaps mappings under the append lock. Segments that only
+// contain finished games are deleted by the sync thread as well.
+//
+// On startup, all segments are scanned and games that were still in progress are handed out
+// for recovery. A new segment then starts with a checkpoint record, which makes a later
+// recovery ignore everything before it.
+class GameJournal {
+  public:
+    using GameId = std::uint64_t;
+
+    struct Params {
+        std::filesystem::path directory = "journal";
+        std::size_t segmentSize = std::size_t(64U) << 20U;
+        std::chrono::milliseconds syncInterval{100};
+    };
+
+    // Game that was in progress when the journal was last written.
+    struct RecoveredGame {
+        std::string player1Username;
+        std::string player1DisplayName;
+        std::string player2Username;
+        std::string player2DisplayName;
+        std::chrono::system_clock::time_point startTime{};
+        MoveSequence moves;
+    };
+
+    // Scans existing segments. Throws if the directory can not be used.
+    explicit GameJournal(Params params);
+    ~GameJournal();
+
+    GameJournal(GameJournal const &) = delete;
+    GameJournal &operator=(GameJournal const &) = delete;
+
+    // Games found by the startup scan. Callers recreate them, journal them again under their
+    // new ids and call completeRecovery.
+    std::vector<RecoveredGame> takeRecoveredGames();
+    // Flushes the journal synchronously and deletes the segments written before startup.
+    void completeRecovery();
+
+    // Safe to call from any thread. Records of one game must be appended in order, which the
+    // game lock guarantees. Never throw, a record is dropped and reported if no segment can be
+    // created for it.
+    void gameCreated(GameId game,
+                     std::string_view player1Username,
+                     std::string_view player1DisplayName,
+                     std::string_view player2Username,
+                     std::string_view player2DisplayName,
+                     std::chrono::system_clock::time_point startTime);
+    void moveMade(GameId game, std::uint32_t columnIdx);
+    void gameEnded(GameId game);
+
+  private:
+    enum class RecordType : std::uint8_t {
+        Checkpoint = 1,
+        GameCreated = 2,
+        Move = 3,
+        GameEnd = 4,
+    };
+
+    // Precedes every payload. The CRC covers the rest of the header and the payload. A zero
+    // payload size marks the unused end of a segment.
+    struct RecordHeader {
+        std::uint32_t crc;
+        std::uint16_t payloadSize;
+        RecordType type;
+        std::uint8_t reserved;
+    };
+    static_assert(sizeof(RecordHeader) == 8U);
+
+    struct Segment {
+        std::uint64_t sequence = 0U;
+        int fd = -1;
+        std::byte *data = nullptr;
+        std::size_t size = 0U;
+    };
+
+    std::filesystem::path getSegmentPath(std::uint64_t sequence) const;
+    std::vector<std::uint64_t> listSegments() const;
+    void recoverSegment(std::uint64_t sequence,
+                        std::unordered_map<GameId, RecoveredGame> &games) const;
+
+    Segment openSegment(std::uint64_t sequence);
+    static void closeSegment(Segment &segment);
+
+    void append(RecordType type, std::span<std::byte const> payload);
+    // Makes room for a record of the given size. Returns false if the next segment can not
+    // be created.
+    bool rollSegmentLocked(std::unique_lock<std::mutex> &lock, std::size_t recordSize);
+    // Sequences of the segments that only contain finished games.
+    std::vector<std::uint64_t> takeUnusedSegmentsLocked();
+
+    void runSyncThread(std::stop_token stopToken);
+    // Creates the next segment ahead of time, outside of the append lock.
+    void prepareSpareSegment();
+    void wakeSyncThread();
+    void syncLocked(bool wait);
+
+  private:
+    Params m_params;
+
+    std::vector<RecoveredGame> m_recoveredGames;
+    // Segments written before startup, deleted once recovery is complete.
+    std::vector<std::uint64_t> m_recoveredSegments;
+
+    std::mutex m_mutex;
+    Segment m_segment;
+    std::size_t m_offset = 0U;
+    std::size_t m_syncedOffset = 0U;
+    // Segment of the first record of every game in progress. Segments before the oldest one
+    // are not needed for recovery anymore.
+    std::unordered_map<GameId, std::uint64_t> m_gameSegments;
+    std::uint64_t m_oldestSegment = 0U;
+
+    // Next segment, created by the sync thread. Appends wait for a running preparation
+    // instead of creating the segment a second time.
+    std::optional<Segment> m_spareSegment;
+    bool m_preparingSpare = false;
+    std::condition_variable m_spareCondition;
+    // Segments that were moved on from, flushed and closed by the sync thread.
+    std::vector<Segment> m_retiredSegments;
+
+    std::mutex m_syncMutex;
+    std::condition_variable_any m_syncCondition;
+    bool m_syncRequested = false;
+    // Declared last, so that it is stopped before the segment is unmapped.
+    std::jthread m_syncThread;
+};
+
+#endif
@@ -4,57 +4,292 @@
 
 #include <server/ConnectionMetadata.h>
 #include <server/ServerTypes.h>
+#include <server/ShardUtils.h>
 
+#include <algorithm>
+#include <chrono>
+#include <functional>
 #include <mutex>
-#include <string_view>
+#include <stdexcept>
+#include <thread>
 #include <utility>
 
-GameHdl GameManager::createGameInstance(IPlayer *player1, IPlayer *player2) {
-    auto game =
-        std::make_shared<GameInstance>(GameInstance{.player1 = player1, .player2 = player2});
+std::size_t GameManager::getFreeListIndex() {
+    thread_local std::size_t freeListIndex =
+        std::hash<std::thread::id>{}(std::this_thread::get_id()) % FreeListCount;
+    return freeListIndex;
+}
+
+auto GameManager::allocateSlot() -> SlotIndex {
+    std::size_t ownIndex = getFreeListIndex();
+    for (std::size_t i = 0; i < FreeListCount; ++i) {
+        auto &freeList = m_freeLists[(ownIndex + i) % FreeListCount];
+
+        // Other stripes are only checked opportunistically.
+        std::unique_lock<std::mutex> lock(freeList.mutex, std::defer_lock);
+        if (i == 0U) {
+            lock.lock();
+        } else if (!lock.try_lock()) {
+            continue;
+        }
+
+        if (!freeList.slots.empty()) {
+            SlotIndex index = freeList.slots.back();
+            freeList.slots.pop_back();
+            if (i != 0U) {
+                m_stolenSlotCount.fetch_add(1U, std::memory_order_relaxed);
+            }
+            return index;
+        }
+    }
 
-    auto mappedItem = std::make_pair(game.get(), std::move(game));
+    SlotIndex index = m_slotCount.fetch_add(1U, std::memory_order_relaxed);
+    if (index >= decltype(m_slots)::MaxSize) {
+        m_slotCount.fetch_sub(1U, std::memory_order_relaxed);
+        throw std::runtime_error("Too many active games.");
+    }
+    m_slots.ensureAllocated(index);
+    return index;
+}
 
-    std::lock_guard<std::mutex> lock(m_mutex);
-    auto [iter1, success1] = m_activeGames[player1->getConnection()].insert(mappedItem);
-    auto [iter2, success2] = m_activeGames[player2->getConnection()].insert(mappedItem);
+void GameManager::releaseSlot(SlotIndex index) {
+    auto &freeList = m_freeLists[getFreeListIndex()];
+    std::lock_guard<std::mutex> lock(freeList.mutex);
+    freeList.slots.push_back(index);
+}
 
-    return mappedItem.first;
+auto GameManager::getPoolStatistics() const -> PoolStatistics {
+    return PoolStatistics{
+        .capacity = std::min<std::size_t>(m_slotCount.load(std::memory_order_relaxed),
+                                          decltype(m_slots)::MaxSize),
+        .activeGames = m_activeGameCount.load(std::memory_order_relaxed),
+        .peakActiveGames = m_peakActiveGameCount.load(std::memory_order_relaxed),
+        .createdGames = m_createdGameCount.load(std::memory_order_relaxed),
+        .stolenSlots = m_stolenSlotCount.load(std::memory_order_relaxed),
+    };
 }
 
-bool GameManager::removeGameInstance(GameHdl game) {
-    auto hdl1 = game->player1->getConnection();
-    auto hdl2 = game->player2->getConnection();
+std::unique_lock<std::mutex>
+GameManager::initializeSlot(SlotIndex index, GamePlayer player1, GamePlayer player2) {
+    auto &slot = m_slots[index];
 
-    std::lock_guard<std::mutex> lock(m_mutex);
-    return bool(m_activeGames[hdl1].erase(game)) && bool(m_activeGames[hdl2].erase(game));
+    std::unique_lock<std::mutex> lock(slot.mutex);
+    assert(!slot.occupied);
+    slot.occupied = true;
+    // Resets the clocks and the flags of the previous game of the slot.
+    slot.instance = GameInstance{};
+    slot.instance.player1 = player1;
+    slot.instance.player2 = player2;
+    slot.instance.startTime = std::chrono::system_clock::now();
+    return lock;
 }
 
-auto GameManager::getGameId(GameHdl game) -> GameId { return std::size_t(game); }
+auto GameManager::getRegistryShard(ConnectionId connection) -> RegistryShard & {
+    return m_registryShards[getShardIndex(std::hash<ConnectionId>{}(connection),
+                                          RegistryShardCount)];
+}
 
-GameHdl GameManager::getGameFromId(GameId id) { return reinterpret_cast<GameHdl>(id); }
+void GameManager::linkLocked(RegistryShard &shard, ConnectionId connection, ListNode node) {
+    auto &slot = m_slots[node / 2U];
+    auto side = node % 2U;
 
-GamePtr GameManager::getGame(ConnectionId id, GameHdl gameHdl) {
-    std::lock_guard<std::mutex> lock(m_mutex);
+    auto [headIter, inserted] = shard.connectionGames.try_emplace(connection, InvalidNode);
+    ListNode head = headIter->second;
+
+    slot.prev[side] = InvalidNode;
+    slot.next[side] = head;
+    if (head != InvalidNode) {
+        m_slots[head / 2U].prev[head % 2U] = node;
+    }
+    headIter->second = node;
+}
 
-    auto games = m_activeGames.find(id);
+void GameManager::unlinkLocked(RegistryShard &shard, ConnectionId connection, ListNode node) {
+    auto &slot = m_slots[node / 2U];
+    auto side = node % 2U;
 
-    if (games != m_activeGames.end()) {
-        auto gameIter = games->second.find(gameHdl);
-        if (gameIter != games->second.end()) {
-            return gameIter->second;
+    ListNode prev = slot.prev[side];
+    ListNode next = slot.next[side];
+    if (prev != InvalidNode) {
+        m_slots[prev / 2U].next[prev % 2U] = next;
+    } else {
+        auto headIter = shard.connectionGames.find(connection);
+        assert(headIter != shard.connectionGames.end() && headIter->second == node);
+        if (next == InvalidNode) {
+            shard.connectionGames.erase(headIter);
+        } else {
+            headIter->second = next;
         }
     }
-    return nullptr;
+    if (next != InvalidNode) {
+        m_slots[next / 2U].prev[next % 2U] = prev;
+    }
+    slot.prev[side] = InvalidNode;
+    slot.next[side] = InvalidNode;
+}
+
+auto GameManager::createGameInstance(GamePlayer player1, GamePlayer player2) -> GameId {
+    std::pair<GamePlayer, GamePlayer> players{player1, player2};
+    return createGameInstances(std::span(&players, 1U)).front();
 }
 
-GameManager::GameMap *GameManager::getGames(ConnectionId connection) {
-    if (m_activeGames.contains(connection)) {
-        return &m_activeGames[connection];
+auto GameManager::createGameInstances(
+    std::span<std::pair<GamePlayer, GamePlayer> const> players) -> std::vector<GameId> {
+    std::vector<GameId> ids;
+    ids.reserve(players.size());
+
+    // New games stay locked until they are linked, so that nobody can end a game that is not
+    // in the per-connection lists yet.
+    std::vector<std::unique_lock<std::mutex>> slotLocks;
+    slotLocks.reserve(players.size());
+
+    for (auto [player1, player2] : players) {
+        SlotIndex index = allocateSlot();
+        slotLocks.push_back(initializeSlot(index, player1, player2));
+        ids.push_back(makeGameId(index, m_slots[index].generation));
+    }
+
+    m_createdGameCount.fetch_add(ids.size(), std::memory_order_relaxed);
+    std::size_t activeGames =
+        m_activeGameCount.fetch_add(ids.size(), std::memory_order_relaxed) + ids.size();
+    std::size_t peak = m_peakActiveGameCount.load(std::memory_order_relaxed);
+    while (peak < activeGames && !m_peakActiveGameCount.compare_exchange_weak(
+                                     peak, activeGames, std::memory_order_relaxed)) {
     }
-    return nullptr;
+
+    struct Link {
+        RegistryShard *shard;
+        ConnectionId connection;
+        ListNode node;
+    };
+    std::vector<Link> links;
+    links.reserve(2U * ids.size());
+    for (std::size_t i = 0; i < ids.size(); ++i) {
+        SlotIndex index = getSlotIndex(ids[i]);
+        ConnectionId connection1 = players[i].first.connection;
+        ConnectionId connection2 = players[i].second.connection;
+        links.push_back(Link{&getRegistryShard(connection1), connection1, index * 2U});
+        links.push_back(Link{&getRegistryShard(connection2), connection2, index * 2U + 1U});
+    }
+
+    // Group links by shard, so that every shard is locked once per batch.
+    std::sort(links.begin(), links.end(), [](Link const &a, Link const &b) {
+        return std::less<RegistryShard *>{}(a.shard, b.shard);
+    });
+    for (auto begin = links.begin(); begin != links.end();) {
+        RegistryShard *shard = begin->shard;
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        for (; begin != links.end() && begin->shard == shard; ++begin) {
+            linkLocked(*shard, begin->connection, begin->node);
+        }
+    }
+    return ids;
 }
 
-bool GameManager::removePlayer(ConnectionId connection) {
-    return bool(m_activeGames.erase(connection));
+void GameManager::removeGameInstance(LockedGame &&game) {
+    assert(game);
+    SlotIndex index = getSlotIndex(game.getId());
+    auto &slot = m_slots[index];
+
+    auto unlink = [this](ConnectionId connection, ListNode node) {
+        auto &shard = getRegistryShard(connection);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        unlinkLocked(shard, connection, node);
+    };
+    unlink(slot.instance.player1.connection, index * 2U);
+    unlink(slot.instance.player2.connection, index * 2U + 1U);
+
+    slot.occupied = false;
+    // Generation 0 is never used, so that id 0 is always invalid.
+    slot.generation = slot.generation == std::numeric_limits<std::uint32_t>::max()
+                          ? 1U
+                          : slot.generation + 1U;
+
+    game.m_lock.unlock();
+    game.m_game = nullptr;
+    releaseSlot(index);
+    m_activeGameCount.fetch_sub(1U, std::memory_order_relaxed);
+}
+
+bool GameManager::removeGameInstance(GameId id) {
+    SlotIndex index = getSlotIndex(id);
+    if (!isLocalGame(id) || !m_slots.isAllocated(index)) {
+        return false;
+    }
+
+    auto &slot = m_slots[index];
+    std::unique_lock<std::mutex> lock(slot.mutex);
+    if (!slot.occupied || slot.generation != getGeneration(id)) {
+        return false;
+    }
+    removeGameInstance(LockedGame(std::move(lock), &slot.instance, id));
+    return true;
+}
+
+auto GameManager::getGame(GameId id) -> LockedGame {
+    SlotIndex index = getSlotIndex(id);
+    if (!isLocalGame(id) || !m_slots.isAllocated(index)) {
+        return LockedGame();
+    }
+
+    auto &slot = m_slots[index];
+    std::unique_lock<std::mutex> lock(slot.mutex);
+    if (!slot.occupied || slot.generation != getGeneration(id)) {
+        return LockedGame();
+    }
+    return LockedGame(std::move(lock), &slot.instance, id);
+}
+
+auto GameManager::getGame(ConnectionId connection, GameId id) -> LockedGame {
+    LockedGame game = getGame(id);
+    if (!game) {
+        return game;
+    }
+
+    bool isPlayer1 = game->player1.connection == connection;
+    bool isPlayer2 = game->player2.connection == connection;
+    if (!isPlayer1 && !isPlayer2) {
+        return LockedGame();
+    }
+    return game;
+}
+
+void GameManager::setPlayerConnection(LockedGame &game,
+                                      PlayerId player,
+                                      ConnectionId connection) {
+    assert(game);
+    bool isPlayer1 = game->player1.id == player;
+    assert(isPlayer1 || game->player2.id == player);
+    GamePlayer &gamePlayer = isPlayer1 ? game->player1 : game->player2;
+    ListNode node = getSlotIndex(game.getId()) * 2U + (isPlayer1 ? 0U : 1U);
+
+    {
+        auto &shard = getRegistryShard(gamePlayer.connection);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        unlinkLocked(shard, gamePlayer.connection, node);
+    }
+    gamePlayer.connection = connection;
+
+    auto &shard = getRegistryShard(connection);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    linkLocked(shard, connection, node);
+}
+
+auto GameManager::getGames(ConnectionId connection) -> std::vector<GameId> {
+    std::vector<GameId> games;
+
+    auto &shard = getRegistryShard(connection);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto headIter = shard.connectionGames.find(connection);
+    if (headIter == shard.connectionGames.end()) {
+        return games;
+    }
+
+    for (ListNode node = headIter->second; node != InvalidNode;) {
+        auto &slot = m_slots[node / 2U];
+        // Generation is only modified with the game unlinked, so it can be read here.
+        games.push_back(makeGameId(node / 2U, slot.generation));
+        node = slot.next[node % 2U];
+    }
+    return games;
 }
@@ -1,39 +1,182 @@
 #ifndef GAME_MANAGER_H
 #define GAME_MANAGER_H
 
-#include <memory>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <limits>
 #include <mutex>
+#include <span>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
+#include <server/ChunkedArray.h>
 #include <server/ConnectFourGame.h>
 #include <server/ConnectionMetadata.h>
 #include <server/ServerTypes.h>
 
+// Games in progress are kept in a generational slot map. A game id encodes the slot index in
+// the lower and the slot generation in the upper 32 bits. Slots are reused after a game ends,
+// but with an incremented generation, so ids of finished games (or forged ids) are rejected
+// in O(1) without any map lookup. The bits above the slot index hold the shard tag of the
+// server that owns the game, so that other servers route requests for it without a lookup.
 class GameManager {
 
   public:
-    using GameId = std::size_t;
+    using GameId = std::uint64_t;
 
-    GameHdl createGameInstance(PlayerHdl player1, PlayerHdl player2);
-    bool removeGameInstance(GameHdl game);
-    bool removePlayer(ConnectionId connection);
+    // Tag zero is used by a server that runs on its own.
+    static constexpr std::uint32_t MaxShardTag = 63U;
 
-    GamePtr getGame(ConnectionId connection, GameHdl game);
-    PlayerPtr getOpponent(GameHdl Game, PlayerHdl player);
+    explicit GameManager(std::uint32_t shardTag = 0U) : m_shardTag(shardTag) {
+        assert(shardTag <= MaxShardTag);
+    }
 
-    using GameMap = std::map<GameHdl, GamePtr>;
-    GameMap *getGames(ConnectionId connection);
+    static std::uint32_t getShardTag(GameId id) {
+        return std::uint32_t(id >> ShardTagShift) & MaxShardTag;
+    }
 
-  public:
-    // These could just as well be standalone functions.
-    static GameId getGameId(GameHdl game);
-    static GameHdl getGameFromId(GameId id);
+    // Game locked for exclusive use. The slot can not be reused while the lock is held.
+    class LockedGame {
+      public:
+        LockedGame() = default;
+
+        explicit operator bool() const { return m_game != nullptr; }
+        GameInstance *operator->() const { return m_game; }
+        GameInstance &operator*() const { return *m_game; }
+
+        GameId getId() const { return m_id; }
+
+      private:
+        friend class GameManager;
+
+        LockedGame(std::unique_lock<std::mutex> lock, GameInstance *game, GameId id)
+            : m_lock(std::move(lock)), m_game(game), m_id(id) {}
+
+        std::unique_lock<std::mutex> m_lock;
+        GameInstance *m_game = nullptr;
+        GameId m_id = 0U;
+    };
+
+    GameId createGameInstance(GamePlayer player1, GamePlayer player2);
+    // Creates a game for every (player1, player2) pair while taking each registry shard lock
+    // at most once.
+    std::vector<GameId>
+    createGameInstances(std::span<std::pair<GamePlayer, GamePlayer> const> players);
+
+    bool removeGameInstance(GameId game);
+    // Removes a game that the caller has already locked.
+    void removeGameInstance(LockedGame &&game);
+
+    // Returns an empty LockedGame if the id is stale or the connection does not play in it.
+    LockedGame getGame(ConnectionId connection, GameId game);
+    // Returns an empty LockedGame if the id is stale. Meant for server side events, like game
+    // clocks, that are not tied to a connection.
+    LockedGame getGame(GameId game);
+
+    // Snapshot of the ids of the games that the connection plays in.
+    std::vector<GameId> getGames(ConnectionId connection);
+
+    // Moves the player to another connection, e.g. when a player of a recovered game logs in
+    // again.
+    void setPlayerConnection(LockedGame &game, PlayerId player, ConnectionId connection);
+
+    struct PoolStatistics {
+        // Slots handed out so far, free or in use.
+        std::size_t capacity = 0U;
+        std::size_t activeGames = 0U;
+        std::size_t peakActiveGames = 0U;
+        // Games created since start.
+        std::size_t createdGames = 0U;
+        // Allocations served from a free list of a different thread stripe.
+        std::size_t stolenSlots = 0U;
+    };
+    PoolStatistics getPoolStatistics() const;
 
   private:
-    std::mutex m_mutex;
+    using SlotIndex = std::uint32_t;
+    // Position of a player in the per-connection game lists: slot index * 2 + player index.
+    using ListNode = std::uint32_t;
+    static constexpr ListNode InvalidNode = std::numeric_limits<ListNode>::max();
+
+    struct GameSlot {
+        std::mutex mutex;
+        std::uint32_t generation = 1U;
+        bool occupied = false;
+        GameInstance instance;
+
+        // Intrusive per-connection game lists, one set of links per player. Guarded by the
+        // registry shard of the player's connection.
+        std::array<ListNode, 2> next{InvalidNode, InvalidNode};
+        std::array<ListNode, 2> prev{InvalidNode, InvalidNode};
+    };
+
+    // Slot indices are below the maximal slot count of 2^26.
+    static constexpr std::uint32_t ShardTagShift = 26U;
+
+    GameId makeGameId(SlotIndex index, std::uint32_t generation) const {
+        return (GameId(generation) << 32U) | (GameId(m_shardTag) << ShardTagShift) | index;
+    }
+    static SlotIndex getSlotIndex(GameId id) {
+        return SlotIndex(id & ((GameId(1U) << ShardTagShift) - 1U));
+    }
+    // Ids of other shards never name a local game.
+    bool isLocalGame(GameId id) const { return getShardTag(id) == m_shardTag; }
+    static std::uint32_t getGeneration(GameId id) { return std::uint32_t(id >> 32U); }
+
+    static constexpr std::size_t FreeListCount = 16U;
+
+    // Free slots are kept in per-thread-stripe lists, so that threads that create and end
+    // games at a high rate do not contend on a single free list.
+    struct alignas(64) FreeList {
+        std::mutex mutex;
+        std::vector<SlotIndex> slots;
+    };
+
+    static std::size_t getFreeListIndex();
+    SlotIndex allocateSlot();
+    void releaseSlot(SlotIndex index);
+    // Returns the lock of the initialized slot.
+    std::unique_lock<std::mutex>
+    initializeSlot(SlotIndex index, GamePlayer player1, GamePlayer player2);
+
+    static constexpr std::size_t RegistryShardCount = 32U;
+
+    // Game lists of the connections that hash into the shard. The links of a list are only
+    // touched under the mutex of the shard of its connection, so a game's two sets of links
+    // may be guarded by different shards.
+    struct alignas(64) RegistryShard {
+        std::mutex mutex;
+        // Head of the game list of every connection that plays at least one game. Entries
+        // are erased together with the last game of the connection.
+        std::unordered_map<ConnectionId, ListNode> connectionGames;
+    };
+
+    RegistryShard &getRegistryShard(ConnectionId connection);
+    void linkLocked(RegistryShard &shard, ConnectionId connection, ListNode node);
+    void unlinkLocked(RegistryShard &shard, ConnectionId connection, ListNode node);
+
+  private:
+    std::uint32_t m_shardTag;
+
+    // Contiguous, never moving slot storage. 1024 slots per chunk.
+    ChunkedArray<GameSlot, 1U << 10U, 1U << 16U> m_slots;
+    static_assert(decltype(m_slots)::MaxSize <= (std::size_t(1U) << ShardTagShift));
+
+    std::array<FreeList, FreeListCount> m_freeLists;
+    // Number of slots ever handed out.
+    std::atomic<SlotIndex> m_slotCount = 0U;
+
+    std::atomic<std::size_t> m_activeGameCount = 0U;
+    std::atomic<std::size_t> m_peakActiveGameCount = 0U;
+    std::atomic<std::size_t> m_createdGameCount = 0U;
+    std::atomic<std::size_t> m_stolenSlotCount = 0U;
 
-    // Games currently in progress.
-    std::unordered_map<ConnectionId, GameMap> m_activeGames;
+    // Lock order is slot mutex first, registry shard mutex second. At most one registry
+    // shard is locked at a time.
+    std::array<RegistryShard, RegistryShardCount> m_registryShards;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -4,8 +4,8 @@
 #include <server/Player.h>
 
 struct GameStat {
-    Player player1;
-    Player player2;
+    PlayerId player1;
+    PlayerId player2;
     std::uint32_t moveCount = 0;
-    std::optional<Player> winner = std::nullopt;
+    std::optional<PlayerId> winner = std::nullopt;
 };
\ No newline at end of file
@@ -0,0 +1,54 @@
+#ifndef I_TRANSPORT_H
+#define I_TRANSPORT_H
+
+#include <cstdint>
+#include <exception>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include <server/ConnectionId.h>
+
+// Moves bytes between clients and the server logic, so that the logic does not depend on a
+// particular network stack.
+class ITransport {
+  public:
+    // Receives inbound traffic on the transport's threads, so it should hand the work off
+    // quickly.
+    class Listener {
+      public:
+        virtual ~Listener() = default;
+
+        // Receive time is the monotonic time at which the transport got the frame.
+        virtual void onMessage(ConnectionId id,
+                               std::string payload,
+                               std::uint64_t receiveTime) = 0;
+        virtual void onConnectionClosed(ConnectionId id) = 0;
+    };
+
+    virtual ~ITransport() = default;
+
+    // Must be set before the transport runs.
+    virtual void setListener(Listener *listener) = 0;
+
+    // Sends a binary frame. Safe to call from any thread. Throws if the connection is unknown.
+    virtual void sendMessage(ConnectionId id, std::string_view payload) = 0;
+    // Sends the same binary frame to every connection, unknown connections are skipped.
+    // Transports that can share one encoded frame between connections override it.
+    virtual void broadcastMessage(std::span<ConnectionId const> ids,
+                                  std::string_view payload) {
+        for (ConnectionId id : ids) {
+            try {
+                sendMessage(id, payload);
+            } catch (std::exception const &) {
+                // Closed meanwhile.
+            }
+        }
+    }
+
+    // Blocks until stop is called.
+    virtual void run() = 0;
+    virtual void stop() = 0;
+};
+
+#endif
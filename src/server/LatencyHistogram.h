@@ -0,0 +1,91 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Lock-free log-linear histogram of latencies with microsecond resolution. Every power of two
+// range is split into SubBucketCount buckets, so percentiles are reported with a relative
+// error below 1 / SubBucketCount. Safe to record from any thread.
+class LatencyHistogram {
+  public:
+    void record(std::chrono::steady_clock::duration latency) {
+        auto micros = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+        std::uint64_t value = micros > 0 ? std::uint64_t(micros) : 0U;
+
+        m_buckets[getBucketIndex(value)].fetch_add(1U, std::memory_order_relaxed);
+        m_count.fetch_add(1U, std::memory_order_relaxed);
+        m_sum.fetch_add(value, std::memory_order_relaxed);
+
+        std::uint64_t max = m_max.load(std::memory_order_relaxed);
+        while (value > max &&
+               !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    std::uint64_t getCount() const { return m_count.load(std::memory_order_relaxed); }
+
+    std::chrono::microseconds getMean() const {
+        std::uint64_t count = getCount();
+        return std::chrono::microseconds(
+            count ? m_sum.load(std::memory_order_relaxed) / count : 0U);
+    }
+
+    std::chrono::microseconds getMax() const {
+        return std::chrono::microseconds(m_max.load(std::memory_order_relaxed));
+    }
+
+    // Upper bound of the bucket that holds the given percentile, in [0, 100].
+    std::chrono::microseconds getPercentile(double percentile) const {
+        std::uint64_t count = getCount();
+        if (count == 0U) {
+            return std::chrono::microseconds(0);
+        }
+        auto rank = std::uint64_t(percentile / 100.0 * double(count - 1U)) + 1U;
+
+        std::uint64_t seen = 0U;
+        for (std::size_t idx = 0U; idx < BucketCount; ++idx) {
+            seen += m_buckets[idx].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                return std::min(std::chrono::microseconds(getBucketUpperBound(idx)), getMax());
+            }
+        }
+        return getMax();
+    }
+
+  private:
+    constexpr static unsigned SubBucketBits = 5U;
+    constexpr static std::size_t SubBucketCount = std::size_t(1U) << SubBucketBits;
+    // Values below SubBucketCount are exact, then one row per remaining bit.
+    constexpr static std::size_t BucketCount = (64U - SubBucketBits + 1U) * SubBucketCount;
+
+    static std::size_t getBucketIndex(std::uint64_t value) {
+        if (value < SubBucketCount) {
+            return std::size_t(value);
+        }
+        unsigned shift = unsigned(std::bit_width(value)) - 1U - SubBucketBits;
+        return (shift + 1U) * SubBucketCount + std::size_t(value >> shift) - SubBucketCount;
+    }
+
+    static std::uint64_t getBucketUpperBound(std::size_t idx) {
+        if (idx < SubBucketCount) {
+            return idx;
+        }
+        unsigned shift = unsigned(idx / SubBucketCount) - 1U;
+        std::uint64_t top = idx % SubBucketCount + SubBucketCount;
+        return ((top + 1U) << shift) - 1U;
+    }
+
+  private:
+    std::array<std::atomic<std::uint64_t>, BucketCount> m_buckets{};
+    std::atomic<std::uint64_t> m_count = 0U;
+    std::atomic<std::uint64_t> m_sum = 0U;
+    std::atomic<std::uint64_t> m_max = 0U;
+};
+
+#endif
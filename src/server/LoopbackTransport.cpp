@@ -0,0 +1,35 @@
+#include "LoopbackTransport.h"
+
+#include <utility>
+
+#include <server/MonotonicTime.h>
+
+LoopbackTransport::LoopbackTransport(ReceiveCallback onReceive)
+    : m_onReceive(std::move(onReceive)) {}
+
+ConnectionId LoopbackTransport::connect() {
+    return m_nextConnectionId.fetch_add(1U, std::memory_order_relaxed);
+}
+
+void LoopbackTransport::sendToServer(ConnectionId id, std::string payload) {
+    m_listener->onMessage(id, std::move(payload), getMonotonicNanoseconds());
+}
+
+void LoopbackTransport::disconnect(ConnectionId id) { m_listener->onConnectionClosed(id); }
+
+void LoopbackTransport::sendMessage(ConnectionId id, std::string_view payload) {
+    m_onReceive(id, payload);
+}
+
+void LoopbackTransport::run() {
+    std::unique_lock<std::mutex> lock(m_runMutex);
+    m_runCondition.wait(lock, [this]() { return m_stopped; });
+}
+
+void LoopbackTransport::stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_runMutex);
+        m_stopped = true;
+    }
+    m_runCondition.notify_all();
+}
@@ -0,0 +1,47 @@
+#ifndef LOOPBACK_TRANSPORT_H
+#define LOOPBACK_TRANSPORT_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include <server/ITransport.h>
+
+// In-memory transport for driving the server logic without sockets. Simulated clients send
+// frames by calling the transport directly and all server responses go to one callback.
+// Connections are only ids, the transport keeps no state per connection, so millions of them
+// can be simulated in one process.
+class LoopbackTransport : public ITransport {
+  public:
+    // Called on the thread that sends the response.
+    using ReceiveCallback = std::function<void(ConnectionId id, std::string_view payload)>;
+
+    explicit LoopbackTransport(ReceiveCallback onReceive);
+
+    // Returns a fresh connection id. Safe to call from any thread.
+    ConnectionId connect();
+    // Delivers a frame to the listener on the calling thread.
+    void sendToServer(ConnectionId id, std::string payload);
+    void disconnect(ConnectionId id);
+
+    void setListener(Listener *listener) override { m_listener = listener; }
+    // Never throws, responses to closed connections are passed on as well.
+    void sendMessage(ConnectionId id, std::string_view payload) override;
+    void run() override;
+    void stop() override;
+
+  private:
+    ReceiveCallback m_onReceive;
+    Listener *m_listener = nullptr;
+    std::atomic<ConnectionId> m_nextConnectionId = 1U;
+
+    std::mutex m_runMutex;
+    std::condition_variable m_runCondition;
+    bool m_stopped = false;
+};
+
+#endif
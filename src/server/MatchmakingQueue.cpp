@@ -0,0 +1,202 @@
+#include "MatchmakingQueue.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <iterator>
+#include <mutex>
+
+namespace {
+std::uint32_t getRatingDiff(std::uint32_t a, std::uint32_t b) { return a > b ? a - b : b - a; }
+} // namespace
+
+std::uint32_t MatchmakingQueue::getRatingWindow(Clock::duration waitTime) const {
+    auto waitSeconds = std::chrono::duration_cast<std::chrono::seconds>(waitTime).count();
+    std::uint64_t window = m_params.initialRatingWindow +
+                           std::uint64_t(std::max<decltype(waitSeconds)>(waitSeconds, 0)) *
+                               m_params.ratingWindowGrowthPerSecond;
+    return std::uint32_t(std::min<std::uint64_t>(window, m_params.maxRatingWindow));
+}
+
+auto MatchmakingQueue::findOpponentLocked(PlayerId player,
+                                          std::uint32_t rating,
+                                          Clock::time_point now) -> Queue::iterator {
+    // Walk outwards from the player's rating, always visiting the closer of the two
+    // neighbours first. The first acceptable candidate is therefore the closest one.
+    auto up = m_queue.lower_bound(Key{.rating = rating, .sequence = 0U});
+    auto down = up;
+
+    while (true) {
+        bool hasUp = up != m_queue.end();
+        bool hasDown = down != m_queue.begin();
+        if (!hasUp && !hasDown) {
+            return m_queue.end();
+        }
+
+        std::uint32_t upDiff = hasUp ? getRatingDiff(rating, up->first.rating) : 0U;
+        std::uint32_t downDiff =
+            hasDown ? getRatingDiff(rating, std::prev(down)->first.rating) : 0U;
+
+        Queue::iterator candidate;
+        if (hasUp && (!hasDown || upDiff <= downDiff)) {
+            candidate = up++;
+        } else {
+            candidate = --down;
+        }
+
+        std::uint32_t ratingDiff = getRatingDiff(rating, candidate->first.rating);
+        if (ratingDiff > m_params.maxRatingWindow) {
+            // Every remaining candidate is even further away.
+            return m_queue.end();
+        }
+
+        if (candidate->second.player == player) {
+            continue;
+        }
+
+        // A newly arrived player accepts the initial window, the waiting candidate may
+        // accept more.
+        auto waitTime = now - candidate->second.enqueueTime;
+        if (ratingDiff <= std::max(m_params.initialRatingWindow, getRatingWindow(waitTime))) {
+            return candidate;
+        }
+    }
+}
+
+PlayerId MatchmakingQueue::matchOrEnqueue(PlayerId player,
+                                          std::uint32_t rating,
+                                          Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_positions.contains(player)) {
+        // Player is already waiting for an opponent.
+        return InvalidPlayerId;
+    }
+
+    auto opponentIter = findOpponentLocked(player, rating, now);
+    if (opponentIter == m_queue.end()) {
+        enqueueLocked(player, rating, now);
+        return InvalidPlayerId;
+    }
+
+    PlayerId opponent = opponentIter->second.player;
+    eraseLocked(opponentIter);
+    return opponent;
+}
+
+auto MatchmakingQueue::pairQueuedPlayers(Clock::time_point now)
+    -> std::vector<std::pair<PlayerId, PlayerId>> {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::vector<Queue::iterator> entries;
+    entries.reserve(m_queue.size());
+    for (auto iter = m_queue.begin(); iter != m_queue.end(); ++iter) {
+        entries.push_back(iter);
+    }
+
+    auto canPair = [&](Queue::iterator a, Queue::iterator b) {
+        auto longestWait = now - std::min(a->second.enqueueTime, b->second.enqueueTime);
+        return getRatingDiff(a->first.rating, b->first.rating) <= getRatingWindow(longestWait);
+    };
+
+    // Heuristic: only neighbours in rating order are paired, so dynamic programming over the
+    // sorted queue runs in O(n). With one window for everybody that is optimal, but windows
+    // grow with the wait time, so a long waiting player may be skipped for a distant partner
+    // (A=1000 with a wide window, B=1010, C=1020 and D=1200 new: A-D and B-C would be two
+    // pairs, this finds one). The left over players are retried in the next pass. best[i]
+    // describes the best neighbour pairing of the first i entries: the most pairs first, the
+    // smallest total rating difference second.
+    struct Solution {
+        std::size_t pairCount = 0U;
+        std::uint64_t ratingDiffSum = 0U;
+        bool pairsLast = false;
+
+        bool isBetterThan(Solution const &other) const {
+            if (pairCount != other.pairCount) {
+                return pairCount > other.pairCount;
+            }
+            return ratingDiffSum < other.ratingDiffSum;
+        }
+    };
+
+    std::vector<Solution> best(entries.size() + 1);
+    for (std::size_t i = 2; i <= entries.size(); ++i) {
+        best[i] = best[i - 1];
+        best[i].pairsLast = false;
+
+        auto a = entries[i - 2];
+        auto b = entries[i - 1];
+        if (!canPair(a, b)) {
+            continue;
+        }
+
+        Solution paired{.pairCount = best[i - 2].pairCount + 1,
+                        .ratingDiffSum = best[i - 2].ratingDiffSum +
+                                         getRatingDiff(a->first.rating, b->first.rating),
+                        .pairsLast = true};
+        if (paired.isBetterThan(best[i])) {
+            best[i] = paired;
+        }
+    }
+
+    std::vector<std::pair<PlayerId, PlayerId>> pairs;
+    pairs.reserve(best.back().pairCount);
+    for (std::size_t i = entries.size(); i >= 2;) {
+        if (!best[i].pairsLast) {
+            --i;
+            continue;
+        }
+        auto a = entries[i - 2];
+        auto b = entries[i - 1];
+        pairs.emplace_back(a->second.player, b->second.player);
+        eraseLocked(a);
+        eraseLocked(b);
+        i -= 2;
+    }
+    return pairs;
+}
+
+void MatchmakingQueue::eraseLocked(Queue::iterator iter) {
+    m_positions.erase(iter->second.player);
+    m_queue.erase(iter);
+}
+
+bool MatchmakingQueue::enqueueLocked(PlayerId player,
+                                     std::uint32_t rating,
+                                     Clock::time_point now) {
+    if (m_positions.contains(player)) {
+        return false;
+    }
+
+    auto [iter, success] = m_queue.emplace(
+        Key{.rating = rating, .sequence = m_nextSequence++},
+        Entry{.player = player, .enqueueTime = now});
+    assert(success);
+    m_positions.emplace(player, iter);
+    return true;
+}
+
+bool MatchmakingQueue::enqueue(PlayerId player, std::uint32_t rating, Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return enqueueLocked(player, rating, now);
+}
+
+bool MatchmakingQueue::remove(PlayerId player) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto positionIter = m_positions.find(player);
+    if (positionIter == m_positions.end()) {
+        return false;
+    }
+    eraseLocked(positionIter->second);
+    return true;
+}
+
+bool MatchmakingQueue::contains(PlayerId player) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_positions.contains(player);
+}
+
+std::size_t MatchmakingQueue::size() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_queue.size();
+}
@@ -0,0 +1,107 @@
+#ifndef MATCHMAKING_QUEUE_H
+#define MATCHMAKING_QUEUE_H
+
+#include <chrono>
+#include <compare>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <server/Player.h>
+
+// Players that are looking for a game, ordered by rating. Lookup of the closest rated
+// opponent and removal are O(log n). The rating difference that a waiting player accepts
+// grows with the time spent in the queue, so that players with uncommon ratings still get
+// matched eventually.
+class MatchmakingQueue {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    enum class Mode : std::uint8_t {
+        // Players are paired as soon as their new game request arrives.
+        Immediate = 0,
+        // Requests are accumulated and the whole queue is paired periodically.
+        Batched = 1
+    };
+
+    struct Params {
+        Mode mode = Mode::Immediate;
+        // Period of pairing passes in batched mode.
+        std::chrono::milliseconds batchInterval{200};
+        // Period of pairing passes in immediate mode. Waiting players are otherwise only
+        // checked against new arrivals, so two of them would never meet once their windows
+        // have grown.
+        std::chrono::milliseconds sweepInterval{1000};
+
+        // Rating difference accepted by a player that has just entered the queue.
+        std::uint32_t initialRatingWindow = 50;
+        // Growth of the accepted rating difference per second of waiting.
+        std::uint32_t ratingWindowGrowthPerSecond = 25;
+        // Upper bound of the accepted rating difference.
+        std::uint32_t maxRatingWindow = 400;
+    };
+
+    MatchmakingQueue(Params params) : m_params(params) {}
+
+    // Removes and returns the closest rated queued opponent that is acceptable for the
+    // player. If there is no such opponent, the player is queued and InvalidPlayerId is
+    // returned.
+    PlayerId matchOrEnqueue(PlayerId player,
+                            std::uint32_t rating,
+                            Clock::time_point now = Clock::now());
+
+    // Pairs queued players that are neighbours in rating order, so that as many of them as
+    // possible get an opponent within their rating windows and the total rating difference of
+    // the pairs is minimal. Not optimal over all pairings, since windows differ per player.
+    // Paired players are removed from the queue.
+    std::vector<std::pair<PlayerId, PlayerId>> pairQueuedPlayers(Clock::time_point now =
+                                                                      Clock::now());
+
+    Params const &getParams() const { return m_params; }
+    // Period of pairQueuedPlayers passes in the queue's mode.
+    std::chrono::milliseconds getPassInterval() const {
+        return m_params.mode == Mode::Batched ? m_params.batchInterval
+                                              : m_params.sweepInterval;
+    }
+
+    bool enqueue(PlayerId player, std::uint32_t rating, Clock::time_point now = Clock::now());
+    bool remove(PlayerId player);
+    bool contains(PlayerId player);
+    std::size_t size();
+
+    std::uint32_t getRatingWindow(Clock::duration waitTime) const;
+
+  private:
+    struct Key {
+        std::uint32_t rating;
+        // Insertion order, breaks ties between players with equal ratings.
+        std::uint64_t sequence;
+
+        auto operator<=>(Key const &) const = default;
+    };
+
+    struct Entry {
+        PlayerId player;
+        Clock::time_point enqueueTime;
+    };
+
+    using Queue = std::map<Key, Entry>;
+
+    bool enqueueLocked(PlayerId player, std::uint32_t rating, Clock::time_point now);
+    Queue::iterator
+    findOpponentLocked(PlayerId player, std::uint32_t rating, Clock::time_point now);
+    void eraseLocked(Queue::iterator iter);
+
+  private:
+    Params m_params;
+
+    std::mutex m_mutex;
+    Queue m_queue;
+    std::unordered_map<PlayerId, Queue::iterator> m_positions;
+    std::uint64_t m_nextSequence = 0U;
+};
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef MONOTONIC_TIME_H
+#define MONOTONIC_TIME_H
+
+#include <chrono>
+#include <cstdint>
+
+// Timestamps of latency probes. Only differences of times taken in the same process are
+// meaningful.
+inline std::uint64_t getMonotonicNanoseconds() {
+    return std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now().time_since_epoch())
+                             .count());
+}
+
+#endif
@@ -0,0 +1,36 @@
+#include "MoveSequence.h"
+
+std::vector<std::uint8_t> MoveSequence::toBytes() const {
+    std::vector<std::uint8_t> bytes(getByteCount(m_size));
+    for (std::uint32_t i = 0; i < m_size; ++i) {
+        std::uint32_t move = (*this)[i];
+        for (std::uint32_t bit = 0; bit < BitsPerMove; ++bit) {
+            if ((move >> bit) & 1U) {
+                std::uint32_t position = i * BitsPerMove + bit;
+                bytes[position / 8U] |= std::uint8_t(1U << (position % 8U));
+            }
+        }
+    }
+    return bytes;
+}
+
+std::optional<MoveSequence> MoveSequence::fromBytes(std::span<std::uint8_t const> bytes,
+                                                    std::uint32_t moveCount) {
+    if (moveCount > MaxMoveCount || bytes.size() != getByteCount(moveCount)) {
+        return std::nullopt;
+    }
+
+    MoveSequence moves;
+    for (std::uint32_t i = 0; i < moveCount; ++i) {
+        std::uint32_t move = 0U;
+        for (std::uint32_t bit = 0; bit < BitsPerMove; ++bit) {
+            std::uint32_t position = i * BitsPerMove + bit;
+            move |= std::uint32_t((bytes[position / 8U] >> (position % 8U)) & 1U) << bit;
+        }
+        if (move >= ColumnCount) {
+            return std::nullopt;
+        }
+        moves.push(move);
+    }
+    return moves;
+}
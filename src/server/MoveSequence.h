@@ -0,0 +1,58 @@
+#ifndef MOVE_SEQUENCE_H
+#define MOVE_SEQUENCE_H
+
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+// Columns of the moves of a game, packed with 3 bits per move. Player one makes the even
+// moves. 21 moves fit into a 64 bit word, so a full game of 42 moves takes two words in
+// memory and 16 bytes when stored.
+class MoveSequence {
+  public:
+    static constexpr std::uint32_t BitsPerMove = 3U;
+    // Board dimensions, checked against ConnectFourGame.
+    static constexpr std::uint32_t ColumnCount = 7U;
+    static constexpr std::uint32_t MaxMoveCount = 42U;
+
+    void push(std::uint32_t columnIdx) {
+        assert(m_size < MaxMoveCount);
+        assert(columnIdx < ColumnCount);
+        m_words[m_size / MovesPerWord] |= std::uint64_t(columnIdx)
+                                          << ((m_size % MovesPerWord) * BitsPerMove);
+        ++m_size;
+    }
+
+    std::uint32_t operator[](std::uint32_t idx) const {
+        assert(idx < m_size);
+        return std::uint32_t(m_words[idx / MovesPerWord] >>
+                             ((idx % MovesPerWord) * BitsPerMove)) &
+               MoveMask;
+    }
+
+    std::uint32_t size() const { return m_size; }
+
+    // Bit stream of the moves, (3 * size + 7) / 8 bytes. First move in the lowest bits.
+    std::vector<std::uint8_t> toBytes() const;
+    // Returns nullopt if the bytes do not hold moveCount valid moves.
+    static std::optional<MoveSequence> fromBytes(std::span<std::uint8_t const> bytes,
+                                                 std::uint32_t moveCount);
+
+    static constexpr std::size_t getByteCount(std::uint32_t moveCount) {
+        return (std::size_t(moveCount) * BitsPerMove + 7U) / 8U;
+    }
+
+    bool operator==(MoveSequence const &) const = default;
+
+  private:
+    static constexpr std::uint32_t MovesPerWord = 64U / BitsPerMove;
+    static constexpr std::uint32_t MoveMask = (1U << BitsPerMove) - 1U;
+
+    std::array<std::uint64_t, (MaxMoveCount + MovesPerWord - 1U) / MovesPerWord> m_words{};
+    std::uint8_t m_size = 0U;
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <atomic>
+#include <optional>
+#include <utility>
+
+// Unbounded lock-free multi producer, single consumer queue (Vyukov). Producers only swap the
+// head pointer, so push never blocks. The consumer may briefly see the queue as empty while a
+// producer is between its two steps, the element is then returned by a later pop.
+template <typename T>
+class MpscQueue {
+  public:
+    MpscQueue() : m_head(new Node()), m_tail(m_head.load(std::memory_order_relaxed)) {}
+    MpscQueue(MpscQueue const &) = delete;
+    MpscQueue &operator=(MpscQueue const &) = delete;
+
+    ~MpscQueue() {
+        while (m_tail) {
+            Node *next = m_tail->next.load(std::memory_order_relaxed);
+            delete m_tail;
+            m_tail = next;
+        }
+    }
+
+    // Safe to call from any thread.
+    void push(T value) {
+        Node *node = new Node();
+        node->value.emplace(std::move(value));
+        Node *prev = m_head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    // Consumer thread only.
+    std::optional<T> pop() {
+        Node *tail = m_tail;
+        Node *next = tail->next.load(std::memory_order_acquire);
+        if (!next) {
+            return std::nullopt;
+        }
+        // The popped node becomes the new stub.
+        std::optional<T> value = std::move(next->value);
+        next->value.reset();
+        m_tail = next;
+        delete tail;
+        return value;
+    }
+
+  private:
+    struct Node {
+        std::atomic<Node *> next = nullptr;
+        std::optional<T> value;
+    };
+
+    alignas(64) std::atomic<Node *> m_head;
+    alignas(64) Node *m_tail;
+};
+
+#endif
@@ -0,0 +1,121 @@
+#include "PersistenceWriter.h"
+
+#include <format>
+#include <iostream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+PersistenceWriter::PersistenceWriter(Params params)
+    : m_params(std::move(params)),
+      m_database(m_params.playersDatabasePath, m_params.gamesDatabasePath),
+      m_writerThread([this](std::stop_token stopToken) { run(stopToken); }) {}
+
+PersistenceWriter::~PersistenceWriter() {
+    m_writerThread.request_stop();
+    m_wakeCondition.notify_all();
+    m_writerThread.join();
+}
+
+void PersistenceWriter::persistPlayer(PlayerRecord record) { push(std::move(record)); }
+
+void PersistenceWriter::persistGame(GameRecord record) { push(std::move(record)); }
+
+void PersistenceWriter::push(Record record) {
+    m_queue.push(std::move(record));
+    std::size_t queued = m_queuedCount.fetch_add(1U, std::memory_order_release) + 1U;
+    // Only the producer that fills the batch wakes the writer.
+    if (queued == m_params.maxBatchSize) {
+        m_wakeCondition.notify_one();
+    }
+}
+
+auto PersistenceWriter::getStatistics() const -> Statistics {
+    return Statistics{
+        .committedRecords = m_committedRecordCount.load(std::memory_order_relaxed),
+        .committedBatches = m_committedBatchCount.load(std::memory_order_relaxed),
+        .retriedCommits = m_retriedCommitCount.load(std::memory_order_relaxed),
+        .droppedRecords = m_droppedRecordCount.load(std::memory_order_relaxed),
+    };
+}
+
+void PersistenceWriter::run(std::stop_token stopToken) {
+    while (!stopToken.stop_requested()) {
+        {
+            std::unique_lock<std::mutex> lock(m_wakeMutex);
+            m_wakeCondition.wait_for(lock, stopToken, m_params.flushInterval, [this]() {
+                return m_queuedCount.load(std::memory_order_acquire) >= m_params.maxBatchSize;
+            });
+        }
+        while (commitBatch()) {
+        }
+    }
+
+    // Records pushed before the stop are still committed.
+    while (commitBatch()) {
+    }
+}
+
+void PersistenceWriter::commitTransaction(std::vector<Record> const &batch) {
+    m_database.beginTransaction();
+    try {
+        for (auto const &record : batch) {
+            std::visit([this](auto const &r) { insertRecord(r); }, record);
+        }
+        m_database.commitTransaction();
+    } catch (...) {
+        m_database.rollbackTransaction();
+        throw;
+    }
+}
+
+void PersistenceWriter::insertRecord(PlayerRecord const &record) {
+    m_database.insertPlayer(record.username, record.displayName);
+}
+
+void PersistenceWriter::insertRecord(GameRecord const &record) {
+    m_database.insertGame(record);
+}
+
+bool PersistenceWriter::commitBatch() {
+    std::vector<Record> batch;
+    while (batch.size() < m_params.maxBatchSize) {
+        auto record = m_queue.pop();
+        if (!record) {
+            break;
+        }
+        batch.push_back(std::move(*record));
+    }
+    if (batch.empty()) {
+        return false;
+    }
+    m_queuedCount.fetch_sub(batch.size(), std::memory_order_relaxed);
+
+    // Records are only lost if every attempt fails. Player inserts ignore existing players
+    // and a failed transaction is rolled back, so a retry never duplicates anything.
+    auto delay = m_params.retryDelay;
+    for (std::size_t attempt = 1U;; ++attempt) {
+        try {
+            commitTransaction(batch);
+            break;
+        } catch (std::exception const &e) {
+            if (attempt >= m_params.maxCommitAttempts) {
+                std::cerr << std::format("Failed to persist {:d} records with error: {:s}.\n",
+                                         batch.size(),
+                                         e.what());
+                m_droppedRecordCount.fetch_add(batch.size(), std::memory_order_relaxed);
+                return true;
+            }
+            std::cerr << std::format("Retrying commit of {:d} records after error: {:s}.\n",
+                                     batch.size(),
+                                     e.what());
+        }
+        m_retriedCommitCount.fetch_add(1U, std::memory_order_relaxed);
+        std::this_thread::sleep_for(delay);
+        delay *= 2;
+    }
+
+    m_committedRecordCount.fetch_add(batch.size(), std::memory_order_relaxed);
+    m_committedBatchCount.fetch_add(1U, std::memory_order_relaxed);
+    return true;
+}
@@ -0,0 +1,92 @@
+#ifndef PERSISTENCE_WRITER_H
+#define PERSISTENCE_WRITER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <filesystem>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <variant>
+#include <vector>
+
+#include <server/Database.h>
+#include <server/MpscQueue.h>
+
+// Write-behind persistence. Request handlers hand records over through a lock-free queue and
+// a dedicated writer thread commits them in batched transactions, so that handlers never
+// wait for disk I/O and a single fsync is shared by the whole batch (group commit).
+class PersistenceWriter {
+  public:
+    struct Params {
+        std::filesystem::path playersDatabasePath = "players.db";
+        std::filesystem::path gamesDatabasePath = "games.db";
+        // Queued records are committed once the interval passes or a full batch is waiting,
+        // whichever comes first.
+        std::chrono::milliseconds flushInterval{100};
+        std::size_t maxBatchSize = 1024U;
+        // A batch that fails to commit, e.g. because another connection holds the write lock,
+        // is retried with doubling delays before its records are dropped.
+        std::size_t maxCommitAttempts = 6U;
+        std::chrono::milliseconds retryDelay{10};
+    };
+
+    struct Statistics {
+        std::size_t committedRecords = 0U;
+        std::size_t committedBatches = 0U;
+        // Failed commits that were tried again.
+        std::size_t retriedCommits = 0U;
+        // Records of batches that failed to commit in every attempt.
+        std::size_t droppedRecords = 0U;
+    };
+
+    explicit PersistenceWriter(Params params);
+    // Commits all queued records before returning.
+    ~PersistenceWriter();
+
+    PersistenceWriter(PersistenceWriter const &) = delete;
+    PersistenceWriter &operator=(PersistenceWriter const &) = delete;
+
+    // Never block. Safe to call from any thread.
+    void persistPlayer(PlayerRecord record);
+    void persistGame(GameRecord record);
+
+    Statistics getStatistics() const;
+
+  private:
+    using Record = std::variant<PlayerRecord, GameRecord>;
+
+    void push(Record record);
+    void run(std::stop_token stopToken);
+    // Returns false if the queue was empty.
+    bool commitBatch();
+    // Throws if the transaction fails, nothing of the batch is committed then.
+    void commitTransaction(std::vector<Record> const &batch);
+    void insertRecord(PlayerRecord const &record);
+    void insertRecord(GameRecord const &record);
+
+  private:
+    Params m_params;
+    // Only used by the writer thread.
+    Database m_database;
+
+    MpscQueue<Record> m_queue;
+    std::atomic<std::size_t> m_queuedCount = 0U;
+
+    // Only used to wake the writer early for a full batch. Producers do not take the mutex, a
+    // missed wake up delays the batch by at most one flush interval.
+    std::mutex m_wakeMutex;
+    std::condition_variable_any m_wakeCondition;
+
+    std::atomic<std::size_t> m_committedRecordCount = 0U;
+    std::atomic<std::size_t> m_committedBatchCount = 0U;
+    std::atomic<std::size_t> m_retriedCommitCount = 0U;
+    std::atomic<std::size_t> m_droppedRecordCount = 0U;
+
+    // Declared last, so that it is stopped before the queue and database go away.
+    std::jthread m_writerThread;
+};
+
+#endif
@@ -1,123 +1,156 @@
 #include "PlayerManager.h"
 
-#include <algorithm>
-#include <map>
-#include <memory>
 #include <mutex>
-#include <string>
+#include <shared_mutex>
+#include <string_view>
 
 #include <server/ConnectionMetadata.h>
 #include <server/Player.h>
-#include <server/RandomUtils.h>
-
-PlayerPtr PlayerManager::addPlayer(std::string const &userName,
-                                   std::string const &displayName,
-                                   ConnectionId id) {
-    std::shared_ptr<IPlayer> player = std::make_shared<Player>(Player::Params{
-        .username = userName,
-        .displayName = displayName,
-        .id = std::move(id),
-    });
-
-    std::lock_guard<std::recursive_mutex> lock(m_playersMutex);
-    // Insertion is not thread safe, so we have to ensure only one thread inserts a new player
-    // at a time.
-    auto [iter, success] = m_players.emplace(player.get(), player);
-    if (!success) {
-        return nullptr;
-    }
+#include <server/ShardUtils.h>
 
-    return iter->second;
+auto PlayerManager::getPlayerShard(PlayerKey const &key) -> PlayerShard & {
+    return m_playerShards[getShardIndex(PlayerKeyHash{}(key), ShardCount)];
+}
+
+auto PlayerManager::getActivePlayerShard(ConnectionId id) -> ActivePlayerShard & {
+    return m_activePlayerShards[getShardIndex(std::hash<ConnectionId>{}(id), ShardCount)];
 }
 
-PlayerPtr PlayerManager::findPlayer(std::string const &userName,
-                                    std::string const &displayName) {
-    std::lock_guard<std::recursive_mutex> lock(m_playersMutex);
-    auto iter = std::find_if(m_players.begin(), m_players.end(), [&](auto const &pair) {
-        return pair.first->getUsername() == userName &&
-               pair.first->getDisplayName() == displayName;
-    });
-    if (iter == m_players.end()) {
-        return nullptr;
+PlayerId PlayerManager::addPlayer(std::string_view userName,
+                                  std::string_view displayName,
+                                  ConnectionId id,
+                                  std::uint32_t rating) {
+    PlayerKey key{.username = userName, .displayName = displayName};
+    auto &shard = getPlayerShard(key);
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (shard.players.contains(key)) {
+        // Player with the same credentials already exists.
+        return InvalidPlayerId;
     }
-    return iter->second;
+
+    PlayerId player = m_players.add(userName, displayName, id, rating);
+
+    // Key the index with the stored names, the arguments may not outlive the call.
+    PlayerKey storedKey{.username = m_players.getUsername(player),
+                        .displayName = m_players.getDisplayName(player)};
+    shard.players.emplace(storedKey, player);
+    return player;
 }
 
-PlayerPtr PlayerManager::getPlayer(PlayerHdl player) {
+void PlayerManager::reservePlayers(std::size_t count) {
+    m_players.reserve(count);
+    for (auto &shard : m_playerShards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.players.reserve(count / ShardCount + 1U);
+    }
+}
 
-    std::lock_guard<std::recursive_mutex> lock(m_playersMutex);
-    auto playerIter = m_players.find(player);
+PlayerId PlayerManager::findPlayer(std::string_view userName, std::string_view displayName) {
+    PlayerKey key{.username = userName, .displayName = displayName};
+    auto &shard = getPlayerShard(key);
 
-    if (playerIter == m_players.end()) {
-        return nullptr;
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto iter = shard.players.find(key);
+    if (iter == shard.players.end()) {
+        return InvalidPlayerId;
     }
-    return playerIter->second;
+    return iter->second;
 }
 
-bool PlayerManager::addActivePlayer(PlayerHdl player) {
-    std::lock_guard<std::recursive_mutex> lock(m_activePlayersMutex);
-    auto id = player->getConnection();
-    auto [iter, success] = m_activePlayers.insert(std::make_pair(id, player));
+bool PlayerManager::addActivePlayer(PlayerId player) {
+    auto id = m_players.getConnection(player);
+    auto &shard = getActivePlayerShard(id);
+
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    auto [iter, success] = shard.players.insert(std::make_pair(id, player));
+    if (success) {
+        m_players.setStatus(player, PlayerStatus::Online);
+        m_activePlayerCount.fetch_add(1U, std::memory_order_relaxed);
+    }
     return success;
 }
 
-bool PlayerManager::removeActivePlayer(PlayerHdl player) {
-    std::lock_guard<std::recursive_mutex> lock(m_activePlayersMutex);
-    return bool(m_activePlayers.erase(player->getConnection()));
+bool PlayerManager::addActivePlayer(PlayerId player, ConnectionId id) {
+    removeActivePlayer(player);
+    m_players.setConnection(player, id);
+    return addActivePlayer(player);
 }
 
-PlayerPtr PlayerManager::getActivePlayer(ConnectionId id) {
-    std::lock_guard<std::recursive_mutex> lock(m_activePlayersMutex);
-    auto iter = m_activePlayers.find(id);
-    if (iter == m_activePlayers.end()) {
-        return nullptr;
-    }
+bool PlayerManager::removeActivePlayer(PlayerId player) {
+    auto id = m_players.getConnection(player);
+    auto &shard = getActivePlayerShard(id);
 
-    PlayerHdl playerHdl = iter->second;
-    auto playerIter = m_players.find(playerHdl);
-    if (playerIter == m_players.end()) {
-        return nullptr;
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    bool removed = bool(shard.players.erase(id));
+    if (removed) {
+        m_players.setStatus(player, PlayerStatus::Offline);
+        m_activePlayerCount.fetch_sub(1U, std::memory_order_relaxed);
     }
-
-    return playerIter->second;
+    return removed;
 }
 
-std::size_t PlayerManager::activePlayerCount() {
-    std::lock_guard<std::recursive_mutex> lock(m_activePlayersMutex);
-    return m_activePlayers.size();
+bool PlayerManager::tryLogin(PlayerId player, ConnectionId id) {
+    // Claiming the status first makes the check and the connection swap one step.
+    if (!m_players.exchangeStatus(player, PlayerStatus::Offline, PlayerStatus::Online)) {
+        return false;
+    }
+    m_players.setConnection(player, id);
+
+    auto &shard = getActivePlayerShard(id);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    auto [iter, success] = shard.players.insert(std::make_pair(id, player));
+    if (!success) {
+        // The connection is already logged in as another player.
+        m_players.setStatus(player, PlayerStatus::Offline);
+        return false;
+    }
+    m_activePlayerCount.fetch_add(1U, std::memory_order_relaxed);
+    return true;
 }
 
-PlayerPtr PlayerManager::selectOpponentForPlayer(PlayerHdl player) {
+PlayerId PlayerManager::removeActiveConnection(ConnectionId id) {
+    auto &shard = getActivePlayerShard(id);
 
-    std::uint32_t playerRating = player->getRating();
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    auto iter = shard.players.find(id);
+    if (iter == shard.players.end()) {
+        return InvalidPlayerId;
+    }
+    PlayerId player = iter->second;
+    shard.players.erase(iter);
+    m_players.setStatus(player, PlayerStatus::Offline);
+    m_activePlayerCount.fetch_sub(1U, std::memory_order_relaxed);
+    return player;
+}
 
-    PlayerHdl opponent;
-    while (true) {
-        std::lock_guard<std::recursive_mutex> lock(m_activePlayersMutex);
+PlayerId PlayerManager::getActivePlayer(ConnectionId id) {
+    auto &shard = getActivePlayerShard(id);
 
-        std::size_t nActivePlayers = activePlayerCount();
-        auto opponentIter = m_activePlayers.begin();
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    auto iter = shard.players.find(id);
+    if (iter == shard.players.end()) {
+        return InvalidPlayerId;
+    }
+    return iter->second;
+}
 
-        // Randomly select the opponent.
-        assert(nActivePlayers > 1);
-        std::size_t opponentIdx = getRandomInt(nActivePlayers - 1);
-        std::advance(opponentIter, opponentIdx);
+std::size_t PlayerManager::activePlayerCount() {
+    return m_activePlayerCount.load(std::memory_order_relaxed);
+}
 
-        opponent = opponentIter->second;
+PlayerId PlayerManager::selectOpponentForPlayer(PlayerId player) {
+    return m_matchmakingQueue.matchOrEnqueue(player, m_players.getRating(player));
+}
 
-        if (opponent == player) {
-            // Choose another palyer.
-            continue;
-        }
+bool PlayerManager::removeFromMatchmaking(PlayerId player) {
+    return m_matchmakingQueue.remove(player);
+}
 
-        std::size_t opponentRating = opponent->getRating();
-        std::uint32_t ratingDiff = playerRating > opponentRating
-                                       ? playerRating - opponentRating
-                                       : opponentRating - playerRating;
+bool PlayerManager::enqueueForMatchmaking(PlayerId player) {
+    return m_matchmakingQueue.enqueue(player, m_players.getRating(player));
+}
 
-        // We accept the player with the probability 1 / ( 1 + rating_diff^2).
-        if (getRandomUniformFloat() < (1.0F / (1.0F + ratingDiff * ratingDiff))) {
-            return m_players[opponent];
-        }
-    }
+std::vector<std::pair<PlayerId, PlayerId>> PlayerManager::pairQueuedPlayers() {
+    return m_matchmakingQueue.pairQueuedPlayers();
 }
@@ -1,43 +1,124 @@
 #ifndef PLAYER_MANAGER_H
 #define PLAYER_MANAGER_H
 
-#include <memory>
+#include <array>
+#include <atomic>
 #include <mutex>
-#include <string>
+#include <shared_mutex>
+#include <string_view>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
+#include <server/MatchmakingQueue.h>
 #include <server/Player.h>
+#include <server/PlayerTable.h>
 #include <server/ServerTypes.h>
 
 class PlayerManager {
   public:
-    PlayerPtr
-    addPlayer(std::string const &userName, std::string const &displayName, ConnectionId id);
+    PlayerManager(MatchmakingQueue::Params matchmakingParams = {})
+        : m_matchmakingQueue(matchmakingParams) {}
 
-    // clang-format off
-    PlayerPtr findPlayer(
-        std::string const &userName, std::string const &displayName);
-    // clang-format on
+    // Returns InvalidPlayerId if a player with the same credentials already exists.
+    PlayerId addPlayer(std::string_view userName,
+                       std::string_view displayName,
+                       ConnectionId id,
+                       std::uint32_t rating = DefaultPlayerRating);
 
-    PlayerPtr getPlayer(PlayerHdl player);
+    // Pre-sizes the player table and the credentials index before a bulk load.
+    void reservePlayers(std::size_t count);
 
-    bool addActivePlayer(PlayerHdl player);
-    bool removeActivePlayer(PlayerHdl player);
-    PlayerPtr getActivePlayer(ConnectionId id);
+    PlayerId findPlayer(std::string_view userName, std::string_view displayName);
+
+    bool addActivePlayer(PlayerId player);
+    // Replaces the active connection of the player, used for players of other shards.
+    bool addActivePlayer(PlayerId player, ConnectionId id);
+    bool removeActivePlayer(PlayerId player);
+    // Logs an offline player in on the connection. Returns false if the player is online,
+    // of concurrent logins of the same player only one succeeds.
+    bool tryLogin(PlayerId player, ConnectionId id);
+    // Detaches the player of a closed connection, returns InvalidPlayerId if there is none.
+    PlayerId removeActiveConnection(ConnectionId id);
+    // Only takes a shared lock of a single shard.
+    PlayerId getActivePlayer(ConnectionId id);
 
     std::size_t activePlayerCount();
 
-    PlayerPtr selectOpponentForPlayer(PlayerHdl player);
+    // Lock free accessors of the player table.
+    std::string_view getUsername(PlayerId player) const {
+        return m_players.getUsername(player);
+    }
+    std::string_view getDisplayName(PlayerId player) const {
+        return m_players.getDisplayName(player);
+    }
+    std::uint32_t getRating(PlayerId player) const { return m_players.getRating(player); }
+    PlayerStatus getStatus(PlayerId player) const { return m_players.getStatus(player); }
+    ConnectionId getConnection(PlayerId player) const {
+        return m_players.getConnection(player);
+    }
+
+    // Returns the closest rated player that is waiting for a game. If nobody suitable is
+    // waiting, the player is put into the matchmaking queue and InvalidPlayerId is returned.
+    PlayerId selectOpponentForPlayer(PlayerId player);
+    bool removeFromMatchmaking(PlayerId player);
+
+    // Batched matchmaking: players are only queued on request and paired in periodic passes.
+    bool enqueueForMatchmaking(PlayerId player);
+    std::vector<std::pair<PlayerId, PlayerId>> pairQueuedPlayers();
+
+    MatchmakingQueue::Params const &getMatchmakingParams() const {
+        return m_matchmakingQueue.getParams();
+    }
+    std::chrono::milliseconds getMatchmakingPassInterval() const {
+        return m_matchmakingQueue.getPassInterval();
+    }
+
+  private:
+    // Views into the names stored in the player table. Players are never removed, so the
+    // views stay valid for the lifetime of the manager.
+    struct PlayerKey {
+        std::string_view username;
+        std::string_view displayName;
+
+        bool operator==(PlayerKey const &) const = default;
+    };
+
+    struct PlayerKeyHash {
+        std::size_t operator()(PlayerKey const &key) const {
+            std::size_t h = std::hash<std::string_view>{}(key.username);
+            std::size_t displayNameHash = std::hash<std::string_view>{}(key.displayName);
+            return h ^ (displayNameHash + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2));
+        }
+    };
+
+    static constexpr std::size_t ShardCount = 32;
+
+    // Credentials index of registered players, sharded by credentials.
+    struct alignas(64) PlayerShard {
+        std::mutex mutex;
+        std::unordered_map<PlayerKey, PlayerId, PlayerKeyHash> players;
+    };
+
+    // Players with active connection, sharded by connection id.
+    struct alignas(64) ActivePlayerShard {
+        std::shared_mutex mutex;
+        std::unordered_map<ConnectionId, PlayerId> players;
+    };
+
+    PlayerShard &getPlayerShard(PlayerKey const &key);
+    ActivePlayerShard &getActivePlayerShard(ConnectionId id);
 
   private:
-    std::recursive_mutex m_playersMutex;
-    // Player are never removed from this map. Once registered, it's here forever.
-    std::unordered_map<PlayerHdl, PlayerPtr, std::hash<PlayerHdl>> m_players;
-
-    std::recursive_mutex m_activePlayersMutex;
-    // Players with active connection. IPlayer* pointer will always be valid, because this
-    // map is only a subset of the above.
-    std::unordered_map<ConnectionId, PlayerHdl> m_activePlayers;
+    // Players are never removed from the table. Once registered, they are here forever.
+    PlayerTable m_players;
+
+    std::array<PlayerShard, ShardCount> m_playerShards;
+    std::array<ActivePlayerShard, ShardCount> m_activePlayerShards;
+    std::atomic<std::size_t> m_activePlayerCount = 0U;
+
+    // Active players that are waiting for an opponent.
+    MatchmakingQueue m_matchmakingQueue;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,51 @@
+#include "PlayerTable.h"
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+
+void PlayerTable::reserve(std::size_t count) {
+    count = std::min<std::size_t>(count, ChunkedArray<PlayerStatus>::MaxSize);
+    m_names.reserve(count);
+    m_usernameSizes.reserve(count);
+    m_displayNameSizes.reserve(count);
+    m_ratings.reserve(count);
+    m_connections.reserve(count);
+    m_statuses.reserve(count);
+}
+
+PlayerId PlayerTable::add(std::string_view username,
+                          std::string_view displayName,
+                          ConnectionId connection,
+                          std::uint32_t rating) {
+    constexpr std::size_t MaxNameSize = std::numeric_limits<std::uint16_t>::max();
+    if (username.size() > MaxNameSize || displayName.size() > MaxNameSize) {
+        throw std::invalid_argument("Player name is too long.");
+    }
+    PlayerId id = m_nextId.fetch_add(1U, std::memory_order_relaxed);
+    if (id >= ChunkedArray<PlayerStatus>::MaxSize) {
+        throw std::runtime_error("Player table is full.");
+    }
+
+    m_names.ensureAllocated(id);
+    m_usernameSizes.ensureAllocated(id);
+    m_displayNameSizes.ensureAllocated(id);
+    m_ratings.ensureAllocated(id);
+    m_connections.ensureAllocated(id);
+    m_statuses.ensureAllocated(id);
+
+    {
+        auto &names = m_nameArenas[id % NameArenaCount];
+        std::lock_guard<std::mutex> lock(names.mutex);
+        m_names[id] = names.arena.store(username, displayName);
+    }
+    m_usernameSizes[id] = std::uint16_t(username.size());
+    m_displayNameSizes[id] = std::uint16_t(displayName.size());
+    m_ratings[id].store(rating, std::memory_order_relaxed);
+    m_connections[id].store(connection, std::memory_order_relaxed);
+    m_statuses[id].store(PlayerStatus::Offline, std::memory_order_relaxed);
+
+    return id;
+}
@@ -0,0 +1,92 @@
+#ifndef PLAYER_TABLE_H
+#define PLAYER_TABLE_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+
+#include <server/ChunkedArray.h>
+#include <server/ConnectionMetadata.h>
+#include <server/Player.h>
+#include <server/StringArena.h>
+
+// Registered players in struct-of-arrays layout. Every field lives in its own contiguous
+// array indexed by PlayerId, so scans over a single field (e.g. ratings) stream through
+// memory. Both names of a player are stored back to back in an arena, the credentials index
+// of the player manager is the only lookup. Players are never removed and rows never move,
+// which makes all reads lock free; hot fields are atomics so they can be updated
+// concurrently.
+class PlayerTable {
+  public:
+    // Thread safe. Name uniqueness is not checked here. The new row becomes visible to other
+    // threads through whatever synchronized index the returned id is published in.
+    PlayerId add(std::string_view username,
+                 std::string_view displayName,
+                 ConnectionId connection,
+                 std::uint32_t rating = DefaultPlayerRating);
+
+    // Allocates rows for count players up front, e.g. before a bulk load.
+    void reserve(std::size_t count);
+
+    std::size_t size() const { return m_nextId.load(std::memory_order_acquire); }
+
+    std::string_view getUsername(PlayerId id) const {
+        return std::string_view(m_names[id], m_usernameSizes[id]);
+    }
+    std::string_view getDisplayName(PlayerId id) const {
+        return std::string_view(m_names[id] + m_usernameSizes[id], m_displayNameSizes[id]);
+    }
+
+    std::uint32_t getRating(PlayerId id) const {
+        return m_ratings[id].load(std::memory_order_relaxed);
+    }
+    void setRating(PlayerId id, std::uint32_t rating) {
+        m_ratings[id].store(rating, std::memory_order_relaxed);
+    }
+
+    ConnectionId getConnection(PlayerId id) const {
+        return m_connections[id].load(std::memory_order_relaxed);
+    }
+    void setConnection(PlayerId id, ConnectionId connection) {
+        m_connections[id].store(connection, std::memory_order_relaxed);
+    }
+
+    PlayerStatus getStatus(PlayerId id) const {
+        return m_statuses[id].load(std::memory_order_relaxed);
+    }
+    void setStatus(PlayerId id, PlayerStatus status) {
+        m_statuses[id].store(status, std::memory_order_relaxed);
+    }
+    // Returns false if the status was not the expected one.
+    bool exchangeStatus(PlayerId id, PlayerStatus expected, PlayerStatus status) {
+        return m_statuses[id].compare_exchange_strong(
+            expected, status, std::memory_order_acq_rel);
+    }
+
+  private:
+    static constexpr std::size_t NameArenaCount = 32U;
+
+    // Arenas are picked by player id, so that concurrent adds rarely share a lock.
+    struct alignas(64) NameArena {
+        std::mutex mutex;
+        StringArena arena;
+    };
+
+  private:
+    std::array<NameArena, NameArenaCount> m_nameArenas;
+
+    // Username followed by the display name.
+    ChunkedArray<char const *> m_names;
+    ChunkedArray<std::uint16_t> m_usernameSizes;
+    ChunkedArray<std::uint16_t> m_displayNameSizes;
+    ChunkedArray<std::atomic<std::uint32_t>> m_ratings;
+    ChunkedArray<std::atomic<ConnectionId>> m_connections;
+    ChunkedArray<std::atomic<PlayerStatus>> m_statuses;
+
+    // Next free id. Ids are handed out with fetch_add, so concurrent adds never share a row.
+    std::atomic<PlayerId> m_nextId = 0U;
+};
+
+#endif
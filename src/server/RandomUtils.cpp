@@ -5,9 +5,9 @@
 
 namespace {
 
+// One generator per thread, callers run on thread pools.
 std::mt19937_64 &getGenerator() {
-    static std::random_device rd;
-    static std::mt19937_64 gen(rd());
+    thread_local std::mt19937_64 gen(std::random_device{}());
     return gen;
 }
 } // namespace
@@ -0,0 +1,214 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <latch>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <asio/co_spawn.hpp>
+#include <asio/detached.hpp>
+#include <asio/post.hpp>
+#include <asio/strand.hpp>
+#include <asio/thread_pool.hpp>
+
+#include <google/protobuf/descriptor.h>
+
+#include <game.pb.h>
+#include <server/FrameCapture.h>
+#include <server/LatencyHistogram.h>
+#include <server/LoopbackTransport.h>
+#include <server/MonotonicTime.h>
+#include <server/Server.h>
+
+namespace {
+// Larger than the number of request types.
+constexpr std::size_t MaxRequestTypeCount = 16U;
+
+void printUsage() {
+    std::cerr << "Usage:\n"
+                 "  replay <capture> [--paced] [--threads=<count>]\n"
+                 "By default frames are replayed as fast as the server logic accepts them,\n"
+                 "--paced keeps the original arrival times.\n";
+}
+
+// Responses are dropped, only counted.
+struct ResponseCounters {
+    std::atomic<std::size_t> messages = 0U;
+    std::atomic<std::size_t> bytes = 0U;
+};
+
+std::vector<CapturedRecord> readCapture(std::istream &in) {
+    FrameCaptureReader reader(in);
+    std::vector<CapturedRecord> records;
+    while (auto record = reader.read()) {
+        records.push_back(std::move(*record));
+    }
+    return records;
+}
+
+// Request type is decoded outside of the timed handler call, invalid frames are type zero.
+std::size_t getRequestType(std::string const &payload) {
+    game_proto::Request request;
+    if (!request.ParseFromString(payload)) {
+        return 0U;
+    }
+    return std::min(std::size_t(request.Request_case()), MaxRequestTypeCount - 1U);
+}
+
+std::string getRequestTypeName(std::size_t type) {
+    auto const *field = game_proto::Request::descriptor()->FindFieldByNumber(int(type));
+    return field ? field->name() : std::format("request_{:d}", type);
+}
+
+void printReport(std::size_t frameCount,
+                 std::chrono::steady_clock::duration elapsed,
+                 std::array<LatencyHistogram, MaxRequestTypeCount> const &handlers,
+                 ResponseCounters const &responses) {
+    double seconds = std::chrono::duration<double>(elapsed).count();
+    std::cout << std::format("Replayed {:d} frames in {:.3f} s, {:.0f} frames/s.\n",
+                             frameCount,
+                             seconds,
+                             seconds > 0.0 ? double(frameCount) / seconds : 0.0);
+    std::cout << std::format("Sent {:d} messages, {:d} bytes.\n\n",
+                             responses.messages.load(),
+                             responses.bytes.load());
+
+    std::cout << std::format("{:<30s}{:>10s}{:>10s}{:>10s}{:>10s}{:>10s}\n",
+                             "handler (us)",
+                             "count",
+                             "mean",
+                             "p50",
+                             "p99",
+                             "max");
+    for (std::size_t idx = 0U; idx < MaxRequestTypeCount; ++idx) {
+        LatencyHistogram const &histogram = handlers[idx];
+        if (histogram.getCount() == 0U) {
+            continue;
+        }
+        std::cout << std::format("{:<30s}{:>10d}{:>10d}{:>10d}{:>10d}{:>10d}\n",
+                                 getRequestTypeName(idx),
+                                 histogram.getCount(),
+                                 histogram.getMean().count(),
+                                 histogram.getPercentile(50.0).count(),
+                                 histogram.getPercentile(99.0).count(),
+                                 histogram.getMax().count());
+    }
+}
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printUsage();
+        return 1;
+    }
+
+    bool paced = false;
+    std::size_t threadCount = std::max(std::thread::hardware_concurrency(), 1U);
+    for (int i = 2; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        constexpr std::string_view ThreadsOption = "--threads=";
+        if (arg == "--paced") {
+            paced = true;
+        } else if (arg.starts_with(ThreadsOption)) {
+            std::string_view value = arg.substr(ThreadsOption.size());
+            char const *last = value.data() + value.size();
+            auto [end, ec] = std::from_chars(value.data(), last, threadCount);
+            if (ec != std::errc() || end != last || threadCount == 0U) {
+                printUsage();
+                return 1;
+            }
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+
+    std::vector<CapturedRecord> records;
+    try {
+        std::ifstream in(argv[1], std::ios::binary);
+        if (!in) {
+            std::cerr << std::format("Failed to open {:s}.\n", argv[1]);
+            return 1;
+        }
+        records = readCapture(in);
+    } catch (std::exception const &e) {
+        std::cerr << std::format("Failed to read capture with error: {:s}.\n", e.what());
+        return 1;
+    }
+
+    ResponseCounters responses;
+    LoopbackTransport transport([&responses](ConnectionId, std::string_view payload) {
+        responses.messages.fetch_add(1U, std::memory_order_relaxed);
+        responses.bytes.fetch_add(payload.size(), std::memory_order_relaxed);
+    });
+    std::array<LatencyHistogram, MaxRequestTypeCount> handlers;
+    std::size_t frameCount = 0U;
+    std::chrono::steady_clock::duration elapsed{};
+    {
+        // Same logic as the server, without persistence, so that disk I/O does not skew the
+        // handler times.
+        asio::thread_pool threadPool(threadCount);
+        ServerLogic logic(&transport, Server::Params{.maxTaskThreads = threadCount});
+        logic.start(threadPool.get_executor());
+
+        // Frames of one connection are handled in capture order, like the I/O thread of the
+        // server delivers them. Different connections run in parallel.
+        using Strand = asio::strand<asio::thread_pool::executor_type>;
+        std::unordered_map<std::uint32_t, Strand> strands;
+        // Background work of the logic never finishes, so completion is counted instead of
+        // joining the pool.
+        std::latch remaining(std::ptrdiff_t(records.size()));
+
+        // Handlers that suspend are timed including the wait.
+        auto handleFrame = [&](ConnectionId id, std::string payload) -> asio::awaitable<void> {
+            std::size_t type = getRequestType(payload);
+            std::uint64_t receiveTime = getMonotonicNanoseconds();
+            auto handlerStart = std::chrono::steady_clock::now();
+            co_await logic.decodeAndProcessRequest(id, std::move(payload), receiveTime);
+            handlers[type].record(std::chrono::steady_clock::now() - handlerStart);
+            remaining.count_down();
+        };
+
+        auto start = std::chrono::steady_clock::now();
+        for (CapturedRecord &record : records) {
+            if (paced) {
+                std::this_thread::sleep_until(start + record.time);
+            }
+            auto strand = strands.try_emplace(record.connection,
+                                              asio::make_strand(threadPool.get_executor()));
+            ConnectionId id = record.connection;
+
+            if (record.type == CapturedRecordType::Close) {
+                asio::post(strand.first->second, [&logic, &remaining, id]() {
+                    logic.onConnectionClosed(id);
+                    remaining.count_down();
+                });
+                strands.erase(strand.first);
+                continue;
+            }
+
+            ++frameCount;
+            asio::co_spawn(strand.first->second,
+                           handleFrame(id, std::move(record.payload)),
+                           asio::detached);
+        }
+        remaining.wait();
+        elapsed = std::chrono::steady_clock::now() - start;
+
+        threadPool.stop();
+        threadPool.join();
+    }
+
+    printReport(frameCount, elapsed, handlers, responses);
+    return 0;
+}
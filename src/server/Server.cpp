@@ -1,95 +1,118 @@
-#include <server/ConnectionMetadata.h>
-#include <server/Server.h>
+#include <exception>
+#include <format>
+#include <iostream>
+#include <string>
 
-// clang-format off
-Server::Server(Params params) : 
-    Server::server<websocketpp::config::asio>(), 
-    m_logic(std::make_unique<ServerLogic>(this)),
-    m_threadPool(params.maxTaskThreads) {
-    // clang-format on
+#include <asio/co_spawn.hpp>
+#include <asio/detached.hpp>
 
-    auto _1 = std::placeholders::_1;
-    auto _2 = std::placeholders::_2;
+#include <server/MonotonicTime.h>
+#include <server/Server.h>
+#include <server/WebsocketTransport.h>
 
-    this->set_message_handler(std::bind(&Server::onMessage, this, _1, _2));
-    this->set_open_handler(std::bind(&Server::onConnectionOpened, this, _1));
-    this->set_close_handler(std::bind(&Server::onConnectionClosed, this, _1));
+Server::Server(Params params)
+    : Server(params, std::make_unique<WebsocketTransport>(params.port)) {}
 
-    this->set_access_channels(websocketpp::log::alevel::all);
-    this->set_error_channels(websocketpp::log::elevel::all);
+Server::Server(Params params, std::unique_ptr<ITransport> transport)
+    : m_transport(makeTransport(params, std::move(transport))),
+      m_cluster(params.cluster ? static_cast<ClusterNode *>(m_transport.get()) : nullptr),
+      m_threadPool(params.maxTaskThreads), m_admission(params.admission),
+      m_logic(std::make_unique<ServerLogic>(m_transport.get(), params, m_cluster)) {
 
-    this->init_asio();
+    if (params.frameCapture) {
+        m_frameRecorder = std::make_unique<FrameRecorder>(*params.frameCapture);
+    }
 
-    std::cout << "Listening on port " << params.port << std::endl;
-    this->listen(params.port);
-    this->start_accept();
+    if (m_cluster) {
+        m_cluster->setGameCreatedHandler([this](cluster_proto::CreateGame const &game) {
+            asio::post(m_threadPool.get_executor(), [self = shared_from_this(), game]() {
+                self->m_logic->onClusterGameCreated(game);
+            });
+        });
+    }
+    m_transport->setListener(this);
+    m_logic->start(m_threadPool.get_executor());
 }
 
-ConnectionPtr Server::getConnectionPtr(ConnectionHdl hdl) { return get_con_from_hdl(hdl); }
-
-void Server::onMessage(ConnectionHdl hdl, MessagePtr msg) {
-
-    // According to documentation, connection pointers can only be used within handler methods:
-    // https://docs.websocketpp.org/md_tutorials_utility_client_utility_client.html
-    // Although, this is a handler method, further execution is deffered to asio thread pool.
-    // According to this: https://github.com/zaphoyd/websocketpp/issues/62, it is possible to
-    // send connection pointer to asio thread (from thread pool) and use it from there. This is
-    // what we do.
-
-    ConnectionPtr ptr = getConnectionPtr(hdl);
-    asio::post(m_threadPool.get_executor(),
-               [self = shared_from_this(), msg = std::move(msg), id = getConnectionId(ptr)]() {
-                   self->m_logic->decodeAndProcessRequest(id, std::move(msg));
-               });
+std::unique_ptr<ITransport> Server::makeTransport(Params const &params,
+                                                  std::unique_ptr<ITransport> transport) {
+    if (!params.cluster) {
+        return transport;
+    }
+    return std::make_unique<ClusterNode>(*params.cluster, std::move(transport));
 }
 
-void Server::onConnectionClosed(ConnectionHdl hdl) {
-
-    auto ptr = getConnectionPtr(hdl);
-    auto id = getConnectionId(ptr);
-
-    auto connection = m_connections.find(id);
-    if (connection != m_connections.end()) {
-        connection->second.setStatus(ConnectionMetadata::Status::Disconnected);
-    } else {
-        std::cerr << "Connection that is supposed to be closed, not found!";
+Server::~Server() {
+    // Forwarded requests must not arrive while the server is destroyed.
+    if (m_cluster) {
+        m_cluster->disconnect();
     }
-
-    asio::post(m_threadPool.get_executor(),
-               [self = shared_from_this(), id = getConnectionId(ptr)]() {
-                   self->m_logic->onConnectionClosed(id);
-               });
+    // Background work of the logic must not run while it is destroyed.
+    m_threadPool.stop();
+    m_threadPool.join();
 }
 
-void Server::onConnectionOpened(ConnectionHdl hdl) {
-
-    auto connectionPtr = getConnectionPtr(hdl);
-    auto connectionId = getConnectionId(connectionPtr);
+void Server::onMessage(ConnectionId id, std::string payload, std::uint64_t receiveTime) {
+    if (m_frameRecorder) {
+        m_frameRecorder->recordFrame(id, payload);
+    }
 
-    auto connection = m_connections.find(connectionId);
-    if (connection != m_connections.end()) {
-        // TODO(implement proper handling of such case).
-        std::cerr << "Connection that is supposed to be opened, already exists!"
-                     "Not add new connection to the list";
+    // Checked before anything is queued, so that rejected requests cost the pool nothing.
+    auto decision = m_admission.admit(id, payload);
+    if (decision != AdmissionControl::Decision::Admitted) {
+        return sendRejection(id, decision);
     }
 
-    auto uri = connectionPtr->get_uri();
+    // The handler keeps the server alive until it completes.
+    asio::co_spawn(
+        m_threadPool,
+        [self = shared_from_this(), id, payload = std::move(payload), receiveTime]() mutable
+        -> asio::awaitable<void> {
+            co_await self->m_logic->decodeAndProcessRequest(
+                id, std::move(payload), receiveTime);
+            self->m_admission.release();
+        },
+        asio::detached);
+}
 
-    auto [iter, success] = m_connections.emplace(std::make_pair(
-        connectionId, ConnectionMetadata(hdl, ConnectionMetadata::Status::Connected, uri)));
-    if (!success) {
-        std::cerr << "Failed to establish connection to: " << uri->get_port() << std::endl;
+void Server::sendRejection(ConnectionId id, AdmissionControl::Decision decision) {
+    // Encoded once, rejections are sent on the I/O thread.
+    auto encode = [](game_proto::ErrorCode errorCode, char const *msg) {
+        game_proto::Response response;
+        response.mutable_error()->set_error_code(errorCode);
+        response.mutable_error()->set_msg(msg);
+        return response.SerializeAsString();
+    };
+    static std::string const rateLimited =
+        encode(game_proto::ErrorCode::RateLimited, "Too many requests, request was dropped.");
+    static std::string const overloaded = encode(game_proto::ErrorCode::ServerOverloaded,
+                                                 "Server is overloaded, request was dropped.");
+
+    std::string const *payload = nullptr;
+    switch (decision) {
+    case AdmissionControl::Decision::RateLimited:
+        payload = &rateLimited;
+        break;
+    case AdmissionControl::Decision::Overloaded:
+        payload = &overloaded;
+        break;
+    default:
         return;
     }
 
-    std::cout << std::format("Connection opened to: {:d}.", uri->get_port()) << std::endl;
+    try {
+        m_transport->sendMessage(id, *payload);
+    } catch (std::exception const &e) {
+        std::cerr << std::format("Failed to send rejection with error: {:s}.\n", e.what());
+    }
 }
 
-ConnectionMetadata::Status Server::getConnectionStatus(ConnectionId id) const {
-    auto iter = m_connections.find(id);
-    if (iter != m_connections.end()) {
-        return iter->second.getStatus();
+void Server::onConnectionClosed(ConnectionId id) {
+    m_admission.removeConnection(id);
+    if (m_frameRecorder) {
+        m_frameRecorder->recordClose(id);
     }
-    // If connection is not found in the list of connections, then it's disconnected.
-    return ConnectionMetadata::Status::Disconnected;
+    asio::post(m_threadPool.get_executor(), [self = shared_from_this(), id]() {
+        self->m_logic->onConnectionClosed(id);
+    });
 }
@@ -5,57 +5,101 @@
 #define ASIO_STANDALONE
 #endif
 
+#include <chrono>
 #include <functional>
 #include <iostream>
 #include <memory>
 #include <mutex>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
 
+#include <asio/awaitable.hpp>
 #include <asio/post.hpp>
+#include <asio/steady_timer.hpp>
 #include <asio/thread_pool.hpp>
 
-#include <websocketpp/config/asio_no_tls.hpp>
-#include <websocketpp/server.hpp>
-
 #include <game.pb.h>
+#include <server/AdmissionControl.h>
+#include <server/ClusterNode.h>
 #include <server/ConnectFourGame.h>
-#include <server/ConnectionMetadata.h>
+#include <server/ConnectionId.h>
+#include <server/DatabasePool.h>
+#include <server/FrameCapture.h>
+#include <server/GameJournal.h>
 #include <server/GameManager.h>
+#include <server/ITransport.h>
+#include <server/MatchmakingQueue.h>
+#include <server/MonotonicTime.h>
+#include <server/PersistenceWriter.h>
 #include <server/Player.h>
 #include <server/PlayerManager.h>
 #include <server/ServerTypes.h>
+#include <server/SpectatorRegistry.h>
+#include <server/TimingWheel.h>
 
 #pragma optimize("", off)
 
 class ServerLogic;
-class Server : virtual public ServerType, public std::enable_shared_from_this<Server> {
+// Must be owned by a shared_ptr, queued requests keep the server alive.
+class Server : public ITransport::Listener, public std::enable_shared_from_this<Server> {
 
   public:
     struct Params {
+        // Only used by the websocket transport.
         std::uint32_t port = 9000;
         std::size_t maxTaskThreads = 10;
+        MatchmakingQueue::Params matchmaking = {};
+        TimeControl timeControl = {};
+        // Players and finished games are only stored if set.
+        std::optional<PersistenceWriter::Params> persistence = std::nullopt;
+        // Games in progress are journaled and recovered on restart only if set.
+        std::optional<GameJournal::Params> journal = std::nullopt;
+        // Inbound frames are captured for the replay tool only if set.
+        std::optional<FrameRecorder::Params> frameCapture = std::nullopt;
+        AdmissionControl::Params admission = {};
+        // Interval of the statistics line in the server log. Zero disables it.
+        std::chrono::seconds statisticsInterval{60};
+        // Runs the server as a shard of a cluster that shares matchmaking through a broker
+        // only if set.
+        std::optional<ClusterNode::Params> cluster = std::nullopt;
     };
 
-    Server(Params params);
+    // Serves websocket clients on the port given in the params.
+    explicit Server(Params params);
+    Server(Params params, std::unique_ptr<ITransport> transport);
+    // Drops queued requests.
+    ~Server() override;
 
-    ConnectionMetadata::Status getConnectionStatus(ConnectionId id) const;
+    // Blocks until stop is called.
+    void run() { m_transport->run(); }
+    void stop() { m_transport->stop(); }
 
-    void sendMessage(ConnectionId id, auto &&...args) {
-        ConnectionHdl hdl = m_connections.at(id).getHdl();
-        // Send is a base class ServerType method.
-        this->send(hdl, std::forward<decltype(args)>(args)...);
-    }
+    void onMessage(ConnectionId id, std::string payload, std::uint64_t receiveTime) override;
+    void onConnectionClosed(ConnectionId id) override;
 
   private:
-    void onMessage(ConnectionHdl hdl, MessagePtr msg);
-    void onConnectionClosed(ConnectionHdl hdl);
-    void onConnectionOpened(ConnectionHdl hdl);
-    ConnectionPtr getConnectionPtr(ConnectionHdl hdl);
+    // Wraps the transport in a cluster node if the server is a shard.
+    static std::unique_ptr<ITransport> makeTransport(Params const &params,
+                                                     std::unique_ptr<ITransport> transport);
+
+    // Tells the client why its request was dropped.
+    void sendRejection(ConnectionId id, AdmissionControl::Decision decision);
 
   private:
+    // Declared first, so that it outlives the logic that sends through it.
+    std::unique_ptr<ITransport> m_transport;
+    // The transport, if the server is a shard.
+    ClusterNode *m_cluster = nullptr;
+
     asio::thread_pool m_threadPool;
+    AdmissionControl m_admission;
 
-    // Unordered map can not have weak_ptr as a key, so we need additional mapping.
-    std::unordered_map<ConnectionId, ConnectionMetadata> m_connections;
+    std::unique_ptr<FrameRecorder> m_frameRecorder;
 
     // pimpl-like implementation of logic.
     friend class SeverLogic;
@@ -66,15 +110,55 @@ class ServerLogic {
   public:
     using GameId = GameManager::GameId;
 
-    ServerLogic(Server *parentPtr) : m_server(parentPtr) {}
+    // Games of a shard carry the shard in their ids, the cluster node routes by them.
+    ServerLogic(ITransport *transport,
+                Server::Params const &params,
+                ClusterNode *cluster = nullptr)
+        : m_playerManager(params.matchmaking),
+          m_gameManager(params.cluster ? params.cluster->shard + 1U : 0U),
+          m_transport(transport), m_cluster(cluster), m_timeControl(params.timeControl),
+          m_timingWheel(params.timeControl.tick),
+          m_statisticsInterval(params.statisticsInterval) {
+        if (params.persistence) {
+            m_databasePool = std::make_unique<DatabasePool>(DatabasePool::Params{
+                .playersDatabasePath = params.persistence->playersDatabasePath,
+                .gamesDatabasePath = params.persistence->gamesDatabasePath,
+                .maxConnections = params.maxTaskThreads,
+            });
+            m_databaseThreads.emplace(params.maxTaskThreads);
+            loadPlayers();
+            m_persistence = std::make_unique<PersistenceWriter>(*params.persistence);
+        }
+        if (params.journal) {
+            m_journal = std::make_unique<GameJournal>(*params.journal);
+        }
+    }
+
+    // Recovers journaled games and starts periodic background work (matchmaking passes,
+    // game clocks, statistics). Produced work is executed on the given executor.
+    void start(asio::thread_pool::executor_type executor);
 
-    void decodeAndProcessRequest(ConnectionId id, MessagePtr msg);
+    // Receive time is the monotonic time at which the I/O thread got the frame. The handler
+    // is suspended, not blocked, while it waits for the database, so it may resume on another
+    // thread of the executor it was spawned on.
+    asio::awaitable<void> decodeAndProcessRequest(ConnectionId id,
+                                                  std::string payload,
+                                                  std::uint64_t receiveTime);
 
     void onConnectionClosed(ConnectionId id);
 
+    // Starts a game that the broker placed on this shard. Players of other shards are added
+    // with their tagged connections.
+    void onClusterGameCreated(cluster_proto::CreateGame const &game);
+
   private:
-    void processProtoRequest(ConnectionId id, game_proto::Request const &request);
+    asio::awaitable<void> processProtoRequest(ConnectionId id,
+                                              game_proto::Request const &request);
     void sendProtoMessage(ConnectionId id, google::protobuf::Message const &message);
+    void sendSerializedMessage(ConnectionId id, std::string const &payload);
+    // Encodes the message once, the transport shares the frame between spectators.
+    void broadcastToSpectators(SpectatorRegistry::Subscribers const &spectators,
+                               google::protobuf::Message const &message);
 
     void sendErrorResponse(ConnectionId id,
                            std::string const &error,
@@ -85,21 +169,90 @@ class ServerLogic {
 
     void sendSuccessResponse(ConnectionId id);
 
-    void sendGameEndResponse(PlayerHdl p, GameId gameId, game_proto::GameEnd result);
+    // The opponent's column is passed when its move ended the game.
+    void sendGameEndResponse(ConnectionId connection,
+                             GameId gameId,
+                             game_proto::GameEnd result,
+                             std::optional<std::uint32_t> opponentColumnIdx = std::nullopt);
+    void sendNewGameResponses(GameId gameId,
+                              GamePlayer const &player1,
+                              GamePlayer const &player2);
 
-    void processRegistrationRequest(ConnectionId id,
-                                    game_proto::RegistrationRequest const &request);
+    asio::awaitable<void> processRegistrationRequest(
+        ConnectionId id, game_proto::RegistrationRequest const &request);
 
     void processNewGameRequest(ConnectionId id, game_proto::NewGameRequest const &request);
     void processMoveRequest(ConnectionId id, game_proto::MoveRequest const &request);
     void processMessageRequest(ConnectionId id, game_proto::MessageRequest const &request);
+    void processSpectateRequest(ConnectionId id, game_proto::SpectateRequest const &request);
+    void processStopSpectatingRequest(ConnectionId id,
+                                      game_proto::StopSpectatingRequest const &request);
 
-    PlayerPtr getOpponent(GameHdl Game, PlayerHdl player);
+    GamePlayer getGamePlayer(PlayerId player) const;
+    // Finds or adds the player and makes the connection its active one.
+    GamePlayer addClusterPlayer(cluster_proto::ClusterPlayer const &player);
+
+    // Runs the query with a pooled connection on the database threads and resumes the
+    // calling coroutine with its result, so handler threads never wait for the database.
+    template <typename Query>
+    asio::awaitable<std::invoke_result_t<Query, Database &>> runQuery(Query query);
+
+    // Restores all stored players with a single scan into pre-sized tables.
+    void loadPlayers();
+
+    asio::awaitable<void> runMatchmakingLoop();
+    asio::awaitable<void> runStatisticsLoop();
+    void logStatistics();
+    void runMatchmakingPass();
+
+    // Starts the clock of a newly created game and journals the game.
+    void startGame(GameId gameId);
+    // Recreates the games that were in progress when the journal was last written, games
+    // that had already ended are dropped. Their players have no connection, the clock only
+    // starts once both logged in again, and the games are cancelled if they do not return
+    // within the game time.
+    void recoverJournaledGames();
+    // Moves the player's recovered games to the connection the player logged in with.
+    void resumeRecoveredGames(PlayerId player, ConnectionId id);
+    void forgetRecoveredGame(GameManager::LockedGame const &game);
+    // Arms the deadline timer of the player to move. The game must be locked.
+    void armMoveDeadline(GameManager::LockedGame &game,
+                         std::chrono::steady_clock::time_point now);
+    void runTimerThread(std::stop_token stopToken,
+                        asio::thread_pool::executor_type executor);
+    void onMoveDeadline(GameId gameId, TimingWheel::TimerId timer);
+    // Player to move forfeits the game. Recovered games, whose players did not return, are
+    // cancelled instead.
+    void endGameOnTime(GameManager::LockedGame &&game);
+    // Stops the clock, notifies spectators and removes the game. Players are notified by the
+    // caller.
+    void endGame(GameManager::LockedGame &&game, game_proto::GameEnd player1Result);
 
   private:
     PlayerManager m_playerManager;
     GameManager m_gameManager;
-    Server *m_server;
+    SpectatorRegistry m_spectators;
+    ITransport *m_transport;
+    // Matchmaking is done by the broker if set.
+    ClusterNode *m_cluster;
+
+    TimeControl m_timeControl;
+    TimingWheel m_timingWheel;
+    std::chrono::seconds m_statisticsInterval;
+
+    // Read queries, writes go through m_persistence.
+    std::unique_ptr<DatabasePool> m_databasePool;
+    // Blocking queries run here. Declared after the pool, so that its threads are joined
+    // before the connections are closed.
+    std::optional<asio::thread_pool> m_databaseThreads;
+    std::unique_ptr<PersistenceWriter> m_persistence;
+    std::unique_ptr<GameJournal> m_journal;
+    // Recovered games that still wait for a player, by player.
+    std::mutex m_recoveredGamesMutex;
+    std::unordered_map<PlayerId, std::vector<GameId>> m_recoveredGames;
+
+    // Advances the timing wheel. Declared last, so that it is stopped first.
+    std::jthread m_timerThread;
 };
 
 #endif
\ No newline at end of file
@@ -1,15 +1,24 @@
 
 
+#include <algorithm>
+#include <chrono>
 #include <format>
 #include <iterator>
 #include <mutex>
 #include <optional>
 #include <random>
 #include <stdexcept>
+#include <type_traits>
+#include <utility>
 
-#include <websocketpp/frame.hpp>
+#include <asio/co_spawn.hpp>
+#include <asio/detached.hpp>
+#include <asio/steady_timer.hpp>
+#include <asio/this_coro.hpp>
+#include <asio/use_awaitable.hpp>
 
 #include <game.pb.h>
+#include <server/ClusterTypes.h>
 #include <server/Player.h>
 #include <server/RandomUtils.h>
 #include <server/Server.h>
@@ -18,6 +27,50 @@
 
 #pragma optimize("", off)
 
+namespace {
+// Trace of the request handled by this thread. Responses to its connection echo it, no
+// connection is set while no traced request is being handled.
+struct RequestTrace {
+    ConnectionId connection = 0U;
+    game_proto::Trace trace;
+};
+thread_local RequestTrace tRequestTrace;
+
+class RequestTraceScope {
+  public:
+    RequestTraceScope(ConnectionId id,
+                      game_proto::Request const &request,
+                      std::uint64_t receiveTime,
+                      std::uint64_t dequeueTime) {
+        if (!request.has_trace()) {
+            return;
+        }
+        tRequestTrace.connection = id;
+        tRequestTrace.trace = request.trace();
+        tRequestTrace.trace.set_server_receive_time(receiveTime);
+        tRequestTrace.trace.set_server_dequeue_time(dequeueTime);
+    }
+    ~RequestTraceScope() { tRequestTrace.connection = 0U; }
+
+    RequestTraceScope(RequestTraceScope const &) = delete;
+    RequestTraceScope &operator=(RequestTraceScope const &) = delete;
+};
+
+// The trace is thread local, so it is taken off the thread while the handler is suspended and
+// put on the thread that resumes it.
+class SuspendedTrace {
+  public:
+    SuspendedTrace() : m_trace(std::exchange(tRequestTrace, RequestTrace{})) {}
+    ~SuspendedTrace() { tRequestTrace = std::move(m_trace); }
+
+    SuspendedTrace(SuspendedTrace const &) = delete;
+    SuspendedTrace &operator=(SuspendedTrace const &) = delete;
+
+  private:
+    RequestTrace m_trace;
+};
+} // namespace
+
 std::optional<std::string>
 ServerLogic::validateUserCredentials(game_proto::UserCredentials const &credentials) {
 
@@ -49,24 +102,37 @@ ServerLogic::validateUserCredentials(game_proto::UserCredentials const &credenti
 }
 
 void ServerLogic::sendProtoMessage(ConnectionId id, google::protobuf::Message const &message) {
+    if (tRequestTrace.connection == 0U || tRequestTrace.connection != id) {
+        return sendSerializedMessage(id, message.SerializeAsString());
+    }
 
-    // The standard guarantees this, but let's assert anyway.
-    static_assert(sizeof(char) == 1U, "char must be 1 byte");
-    auto messageSize = message.ByteSizeLong();
-    std::vector<char> payload(messageSize);
+    // Serialized messages concatenate as a merge, the trace is appended to the response
+    // without copying it.
+    std::string payload = message.SerializeAsString();
+    game_proto::Response traceResponse;
+    *traceResponse.mutable_trace() = tRequestTrace.trace;
+    traceResponse.mutable_trace()->set_server_send_time(getMonotonicNanoseconds());
+    traceResponse.AppendToString(&payload);
+    sendSerializedMessage(id, payload);
+}
 
-    message.SerializeToArray(payload.data(), messageSize);
+void ServerLogic::sendSerializedMessage(ConnectionId id, std::string const &payload) {
+    // Players of recovered games have no connection until they log in again.
+    if (id == 0U) {
+        return;
+    }
     try {
-        m_server->sendMessage(id,
-                              static_cast<void const *>(payload.data()),
-                              messageSize,
-                              websocketpp::frame::opcode::value::binary);
-
+        m_transport->sendMessage(id, payload);
     } catch (std::exception const &e) {
         std::cerr << std::format("Failed to send proto message with error: {:s}.\n", e.what());
     }
 }
 
+void ServerLogic::broadcastToSpectators(SpectatorRegistry::Subscribers const &spectators,
+                                        google::protobuf::Message const &message) {
+    m_transport->broadcastMessage(spectators, message.SerializeAsString());
+}
+
 void ServerLogic::sendErrorResponse(ConnectionId id,
                                     std::string const &error,
                                     std::optional<game_proto::ErrorCode> errorCode) {
@@ -84,18 +150,22 @@ void ServerLogic::sendSuccessResponse(ConnectionId id) {
     sendProtoMessage(id, successResponse);
 }
 
-void ServerLogic::decodeAndProcessRequest(ConnectionId id, MessagePtr msg) {
-
-    std::string payload = msg->get_payload();
+asio::awaitable<void> ServerLogic::decodeAndProcessRequest(ConnectionId id,
+                                                           std::string payload,
+                                                           std::uint64_t receiveTime) {
+    std::uint64_t dequeueTime = getMonotonicNanoseconds();
 
     game_proto::Request request;
     if (!request.ParseFromString(payload)) {
-        return sendErrorResponse(
-            id, "Failed to parse request. Please ensure that the request is valid.");
+        sendErrorResponse(id,
+                          "Failed to parse request. Please ensure that the request is valid.");
+        co_return;
     }
 
+    RequestTraceScope traceScope(id, request, receiveTime, dequeueTime);
+
     try {
-        processProtoRequest(id, request);
+        co_await processProtoRequest(id, request);
     } catch (GameException const &gameException) {
         sendErrorResponse(id, gameException.what());
     } catch (std::exception const &e) {
@@ -106,16 +176,40 @@ void ServerLogic::decodeAndProcessRequest(ConnectionId id, MessagePtr msg) {
     }
 }
 
-void ServerLogic::processProtoRequest(ConnectionId id, game_proto::Request const &request) {
+asio::awaitable<void> ServerLogic::processProtoRequest(ConnectionId id,
+                                                       game_proto::Request const &request) {
 
+    // Only handlers that wait for I/O are coroutines, the others complete without suspending
+    // and do not pay for a coroutine frame.
     if (request.has_registration_request()) {
-        return processRegistrationRequest(id, request.registration_request());
+        co_await processRegistrationRequest(id, request.registration_request());
     } else if (request.has_new_game_request()) {
-        return processNewGameRequest(id, request.new_game_request());
+        processNewGameRequest(id, request.new_game_request());
     } else if (request.has_move_request()) {
-        return processMoveRequest(id, request.move_request());
+        processMoveRequest(id, request.move_request());
+    } else if (request.has_message_request()) {
+        processMessageRequest(id, request.message_request());
+    } else if (request.has_spectate_request()) {
+        processSpectateRequest(id, request.spectate_request());
+    } else if (request.has_stop_spectating_request()) {
+        processStopSpectatingRequest(id, request.stop_spectating_request());
+    } else {
+        assert(false);
     }
-    assert(false);
+}
+
+template <typename Query>
+asio::awaitable<std::invoke_result_t<Query, Database &>> ServerLogic::runQuery(Query query) {
+    using Result = std::invoke_result_t<Query, Database &>;
+    SuspendedTrace suspendedTrace;
+    co_return co_await asio::co_spawn(
+        m_databaseThreads->get_executor(),
+        [this, query = std::move(query)]() -> asio::awaitable<Result> {
+            // Never blocks, there are as many database threads as connections.
+            auto database = m_databasePool->acquire();
+            co_return query(*database);
+        },
+        asio::use_awaitable);
 }
 
 std::optional<std::string>
@@ -132,29 +226,58 @@ validateUserCredentials(game_proto::UserCredentials const &credentials) {
     return std::nullopt;
 }
 
-void ServerLogic::processRegistrationRequest(ConnectionId id,
-                                             game_proto::RegistrationRequest const &request) {
+asio::awaitable<void>
+ServerLogic::processRegistrationRequest(ConnectionId id,
+                                        game_proto::RegistrationRequest const &request) {
 
     auto const &credentials = request.user_credentials();
     if (auto error = validateUserCredentials(credentials)) {
         sendErrorResponse(id, *error);
+        co_return;
     }
 
     auto const &username = credentials.username();
     auto const &displayName = credentials.display_name();
-    PlayerPtr player = m_playerManager.findPlayer(username, displayName);
-    if (player) {
-        // TODO: We should add a login functionality that will handle cases where the same
-        // player logs in again and continues playing.
-        return sendErrorResponse(id, "Player already exists.");
+    PlayerId player = m_playerManager.findPlayer(username, displayName);
+    if (player == InvalidPlayerId && m_databasePool) {
+        // Players stored since the start, e.g. by another server sharing the database, are
+        // only in the database.
+        auto stored = co_await runQuery([&username, &displayName](Database &database) {
+            return database.findPlayer(username, displayName);
+        });
+        if (stored) {
+            // Players have no connection until they log in again.
+            player = m_playerManager.addPlayer(username, displayName, 0U, stored->rating);
+        }
+    }
+    if (player != InvalidPlayerId) {
+        // Known credentials log the player in again on the new connection.
+        if (!m_playerManager.tryLogin(player, id)) {
+            sendErrorResponse(id, "Player is already logged in.");
+            co_return;
+        }
+        std::cout << std::format("User {:s} logged in again.\n", username);
+
+        game_proto::Response response;
+        response.mutable_registration_success_response();
+        sendProtoMessage(id, response);
+        resumeRecoveredGames(player, id);
+        co_return;
     }
     player = m_playerManager.addPlayer(username, displayName, id);
-    if (!player) {
-        return sendErrorResponse(id, "Could not add player.");
+    if (player == InvalidPlayerId) {
+        sendErrorResponse(id, "Could not add player.");
+        co_return;
+    }
+
+    if (m_persistence) {
+        m_persistence->persistPlayer(
+            PlayerRecord{.username = username, .displayName = displayName});
     }
 
-    if (!m_playerManager.addActivePlayer(player.get())) {
-        return sendErrorResponse(id, "Could not add active player.");
+    if (!m_playerManager.addActivePlayer(player)) {
+        sendErrorResponse(id, "Could not add active player.");
+        co_return;
     }
     std::cout << std::format("Registered new user with username {:s} and display name {:s}.\n",
                              username,
@@ -170,104 +293,571 @@ void ServerLogic::processNewGameRequest(ConnectionId id,
 
     std::cout << "Received new game request.\n";
 
-    PlayerPtr player = m_playerManager.getActivePlayer(id);
+    PlayerId player = m_playerManager.getActivePlayer(id);
+    if (player == InvalidPlayerId) {
+        return sendErrorResponse(id, "Player is not registered.");
+    }
 
-    std::size_t activePlayerCount = m_playerManager.activePlayerCount();
+    if (m_cluster) {
+        // The broker pairs the players of all shards and places the game on a shard. Without
+        // a broker connection, the player is matched with players of this shard.
+        cluster_proto::ClusterPlayer clusterPlayer;
+        clusterPlayer.set_username(std::string(m_playerManager.getUsername(player)));
+        clusterPlayer.set_display_name(std::string(m_playerManager.getDisplayName(player)));
+        clusterPlayer.set_rating(m_playerManager.getRating(player));
+        clusterPlayer.set_connection(makeClusterConnection(m_cluster->getShard(), id));
+        if (m_cluster->requestMatch(clusterPlayer)) {
+            return;
+        }
+    }
 
-    if (activePlayerCount < 2) {
-        return sendErrorResponse(id, "Not enough players.");
+    if (m_playerManager.getMatchmakingParams().mode == MatchmakingQueue::Mode::Batched) {
+        // Player will be paired in the next matchmaking pass.
+        if (!m_playerManager.enqueueForMatchmaking(player)) {
+            return sendErrorResponse(id, "Player is already waiting for a game.");
+        }
+        return;
     }
 
-    // select opponent
-    auto opponent = m_playerManager.selectOpponentForPlayer(player.get());
+    // The player either gets the closest rated waiting opponent or waits in the matchmaking
+    // queue until a suitable opponent sends its own request.
+    PlayerId opponent = m_playerManager.selectOpponentForPlayer(player);
+    if (opponent == InvalidPlayerId) {
+        std::cout << std::format("{:s} is waiting for an opponent.\n",
+                                 m_playerManager.getUsername(player));
+        return;
+    }
 
     // Choose first move player. First player always starts.
-    GameHdl gameInstance = nullptr;
-    bool playerStarts = getRandomBool();
-    if (playerStarts) {
-        gameInstance = m_gameManager.createGameInstance(player.get(), opponent.get());
-    } else {
-        gameInstance = m_gameManager.createGameInstance(opponent.get(), player.get());
+    GamePlayer player1 = getGamePlayer(player);
+    GamePlayer player2 = getGamePlayer(opponent);
+    if (getRandomBool()) {
+        std::swap(player1, player2);
     }
 
-    auto gameId = GameManager::getGameId(gameInstance);
+    GameId gameId = m_gameManager.createGameInstance(player1, player2);
+    startGame(gameId);
+    sendNewGameResponses(gameId, player1, player2);
+}
+
+void ServerLogic::sendNewGameResponses(GameId gameId,
+                                       GamePlayer const &player1,
+                                       GamePlayer const &player2) {
 
-    auto prepareResponse = [gameInstance](bool startGame, PlayerHdl opponent) {
+    auto prepareResponse = [this, gameId](bool startGame, PlayerId opponent) {
         game_proto::Response response;
         auto &newGameResponse = *response.mutable_new_game_response();
-        newGameResponse.set_opponent_display_name(opponent->getDisplayName());
+        newGameResponse.set_opponent_display_name(
+            std::string(m_playerManager.getDisplayName(opponent)));
         newGameResponse.set_make_first_move(startGame);
-        newGameResponse.set_opponent_rating(opponent->getRating());
-        newGameResponse.set_game_id(GameManager::getGameId(gameInstance));
+        newGameResponse.set_opponent_rating(m_playerManager.getRating(opponent));
+        newGameResponse.set_game_id(gameId);
         return response;
     };
 
-    sendProtoMessage(player->getConnection(), prepareResponse(playerStarts, opponent.get()));
-    sendProtoMessage(opponent->getConnection(), prepareResponse(!playerStarts, player.get()));
+    // Player one always starts the game.
+    sendProtoMessage(player1.connection, prepareResponse(true, player2.id));
+    sendProtoMessage(player2.connection, prepareResponse(false, player1.id));
 }
 
-void ServerLogic::sendGameEndResponse(PlayerHdl p, GameId gameId, game_proto::GameEnd result) {
-    // Reponse for the winner.
-    game_proto::Response response;
-    game_proto::GameEndResponse &end_response = *response.mutable_game_end_response();
-    end_response.set_game_id(gameId);
-    end_response.set_game_end(result);
-    sendProtoMessage(p->getConnection(), response);
-};
+GamePlayer ServerLogic::getGamePlayer(PlayerId player) const {
+    return GamePlayer{.id = player, .connection = m_playerManager.getConnection(player)};
+}
+
+GamePlayer ServerLogic::addClusterPlayer(cluster_proto::ClusterPlayer const &clusterPlayer) {
+    ConnectionId connection = clusterPlayer.connection();
+    if (getConnectionShard(connection) == m_cluster->getShard()) {
+        connection = getLocalConnection(connection);
+    }
+
+    PlayerId player =
+        m_playerManager.findPlayer(clusterPlayer.username(), clusterPlayer.display_name());
+    if (player == InvalidPlayerId) {
+        // Players of other shards are only registered on their own shard.
+        player = m_playerManager.addPlayer(clusterPlayer.username(),
+                                           clusterPlayer.display_name(),
+                                           connection,
+                                           clusterPlayer.rating());
+        if (player == InvalidPlayerId) {
+            // Added concurrently by another game of the player.
+            player = m_playerManager.findPlayer(clusterPlayer.username(),
+                                                clusterPlayer.display_name());
+        }
+    }
+    if (m_playerManager.getActivePlayer(connection) != player) {
+        m_playerManager.addActivePlayer(player, connection);
+    }
+    return GamePlayer{.id = player, .connection = connection};
+}
+
+void ServerLogic::onClusterGameCreated(cluster_proto::CreateGame const &game) {
+    // Player one always starts the game, the broker has chosen the first mover.
+    GamePlayer player1 = addClusterPlayer(game.player1());
+    GamePlayer player2 = addClusterPlayer(game.player2());
+
+    GameId gameId = m_gameManager.createGameInstance(player1, player2);
+    startGame(gameId);
+    sendNewGameResponses(gameId, player1, player2);
+}
+
+void ServerLogic::loadPlayers() {
+    auto start = std::chrono::steady_clock::now();
+
+    auto database = m_databasePool->acquire();
+    m_playerManager.reservePlayers(database->getPlayerCount());
+
+    std::size_t count = 0U;
+    database->forEachPlayer(
+        [this, &count](std::string_view username, std::string_view displayName, auto rating) {
+            // Players have no connection until they log in again.
+            PlayerId player = m_playerManager.addPlayer(username, displayName, 0U, rating);
+            if (player != InvalidPlayerId) {
+                ++count;
+            }
+        });
+
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+    std::cout << std::format("Loaded {:d} players in {:d} ms.\n", count, duration.count());
+}
+
+void ServerLogic::start(asio::thread_pool::executor_type executor) {
+    recoverJournaledGames();
+
+    m_timerThread = std::jthread([this, executor](std::stop_token stopToken) {
+        runTimerThread(stopToken, executor);
+    });
+
+    // Shards only match locally while the broker is not connected.
+    asio::co_spawn(executor, runMatchmakingLoop(), asio::detached);
+    if (m_statisticsInterval.count() > 0) {
+        asio::co_spawn(executor, runStatisticsLoop(), asio::detached);
+    }
+}
+
+asio::awaitable<void> ServerLogic::runMatchmakingLoop() {
+    // The pending wait is destroyed with the executor when the server shuts down.
+    asio::steady_timer timer(co_await asio::this_coro::executor);
+    while (true) {
+        timer.expires_after(m_playerManager.getMatchmakingPassInterval());
+        co_await timer.async_wait(asio::use_awaitable);
+        runMatchmakingPass();
+    }
+}
+
+asio::awaitable<void> ServerLogic::runStatisticsLoop() {
+    asio::steady_timer timer(co_await asio::this_coro::executor);
+    while (true) {
+        timer.expires_after(m_statisticsInterval);
+        co_await timer.async_wait(asio::use_awaitable);
+        logStatistics();
+    }
+}
 
-PlayerPtr ServerLogic::getOpponent(GameHdl game, PlayerHdl player) {
-    assert(game->player1 == player || game->player2 == player);
-    ConnectionId connection = player->getConnection();
-    GamePtr gamePtr = m_gameManager.getGame(connection, game);
+void ServerLogic::logStatistics() {
+    GameManager::PoolStatistics pool = m_gameManager.getPoolStatistics();
+    std::cout << std::format("Games: {:d} active, {:d} peak, {:d} created, {:d} slots, "
+                             "{:d} stolen slots. Players: {:d} active.\n",
+                             pool.activeGames,
+                             pool.peakActiveGames,
+                             pool.createdGames,
+                             pool.capacity,
+                             pool.stolenSlots,
+                             m_playerManager.activePlayerCount());
+
+    if (m_persistence) {
+        PersistenceWriter::Statistics persistence = m_persistence->getStatistics();
+        std::cout << std::format("Persistence: {:d} records in {:d} batches committed, "
+                                 "{:d} commits retried, {:d} records dropped.\n",
+                                 persistence.committedRecords,
+                                 persistence.committedBatches,
+                                 persistence.retriedCommits,
+                                 persistence.droppedRecords);
+    }
+}
+
+void ServerLogic::runMatchmakingPass() {
+    auto pairs = m_playerManager.pairQueuedPlayers();
+    if (pairs.empty()) {
+        return;
+    }
+
+    // Choose first move player. First player always starts.
+    std::vector<std::pair<GamePlayer, GamePlayer>> gamePlayers;
+    gamePlayers.reserve(pairs.size());
+    for (auto [player, opponent] : pairs) {
+        if (getRandomBool()) {
+            std::swap(player, opponent);
+        }
+        gamePlayers.emplace_back(getGamePlayer(player), getGamePlayer(opponent));
+    }
+
+    auto gameIds = m_gameManager.createGameInstances(gamePlayers);
+    for (std::size_t i = 0; i < gameIds.size(); ++i) {
+        startGame(gameIds[i]);
+        sendNewGameResponses(gameIds[i], gamePlayers[i].first, gamePlayers[i].second);
+    }
+}
+
+void ServerLogic::startGame(GameId gameId) {
+    GameManager::LockedGame game = m_gameManager.getGame(gameId);
     if (!game) {
-        return nullptr;
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    game->remainingTime.fill(m_timeControl.gameTime);
+    game->turnStart = now;
+    if (game->recovered) {
+        // The players have as long as a game lasts to log in again.
+        game->deadlineTimer = m_timingWheel.schedule(now + m_timeControl.gameTime, gameId);
+    } else {
+        armMoveDeadline(game, now);
+    }
+
+    if (m_journal) {
+        m_journal->gameCreated(gameId,
+                               m_playerManager.getUsername(game->player1.id),
+                               m_playerManager.getDisplayName(game->player1.id),
+                               m_playerManager.getUsername(game->player2.id),
+                               m_playerManager.getDisplayName(game->player2.id),
+                               game->startTime);
+        // Only recovered games start with moves.
+        MoveSequence const &moves = game->game.getMoves();
+        for (std::uint32_t i = 0; i < moves.size(); ++i) {
+            m_journal->moveMade(gameId, moves[i]);
+        }
+    }
+}
+
+void ServerLogic::recoverJournaledGames() {
+    if (!m_journal) {
+        return;
+    }
+
+    auto getPlayer = [this](std::string const &username, std::string const &displayName) {
+        PlayerId player = m_playerManager.findPlayer(username, displayName);
+        if (player == InvalidPlayerId) {
+            player = m_playerManager.addPlayer(username, displayName, 0U);
+        }
+        return GamePlayer{.id = player, .connection = 0U};
+    };
+
+    auto recoveredGames = m_journal->takeRecoveredGames();
+    std::size_t recoveredCount = 0U;
+    for (auto const &recovered : recoveredGames) {
+        GamePlayer player1 =
+            getPlayer(recovered.player1Username, recovered.player1DisplayName);
+        GamePlayer player2 =
+            getPlayer(recovered.player2Username, recovered.player2DisplayName);
+        GameId gameId = m_gameManager.createGameInstance(player1, player2);
+
+        bool finished = false;
+        try {
+            GameManager::LockedGame game = m_gameManager.getGame(gameId);
+            game->startTime = recovered.startTime;
+            game->recovered = true;
+            for (std::uint32_t i = 0; i < recovered.moves.size(); ++i) {
+                game->insertCoin(recovered.moves[i], game->getPlayerToMove().id);
+            }
+            // The server stopped after the last move, but before the end was journaled.
+            std::size_t moveCount = recovered.moves.size();
+            finished = game->game.isFull() ||
+                       (moveCount > 0U &&
+                        game->game.checkIfWin(recovered.moves[moveCount - 1U]));
+        } catch (std::exception const &e) {
+            std::cerr << std::format("Dropping recovered game with error: {:s}.\n", e.what());
+            m_gameManager.removeGameInstance(gameId);
+            continue;
+        }
+        if (finished) {
+            m_gameManager.removeGameInstance(gameId);
+            continue;
+        }
+        startGame(gameId);
+        {
+            std::lock_guard<std::mutex> lock(m_recoveredGamesMutex);
+            m_recoveredGames[player1.id].push_back(gameId);
+            m_recoveredGames[player2.id].push_back(gameId);
+        }
+        ++recoveredCount;
+    }
+
+    m_journal->completeRecovery();
+    std::cout << std::format("Recovered {:d} of {:d} journaled games.\n",
+                             recoveredCount,
+                             recoveredGames.size());
+}
+
+void ServerLogic::resumeRecoveredGames(PlayerId player, ConnectionId id) {
+    std::vector<GameId> gameIds;
+    {
+        std::lock_guard<std::mutex> lock(m_recoveredGamesMutex);
+        auto iter = m_recoveredGames.find(player);
+        if (iter == m_recoveredGames.end()) {
+            return;
+        }
+        gameIds = std::move(iter->second);
+        m_recoveredGames.erase(iter);
+    }
+
+    for (GameId gameId : gameIds) {
+        GameManager::LockedGame game = m_gameManager.getGame(gameId);
+        // Cancelled in the meantime.
+        if (!game || !game->recovered) {
+            continue;
+        }
+        m_gameManager.setPlayerConnection(game, player, id);
+
+        PlayerId opponent = game->getOpponent(player).id;
+        MoveSequence const &moves = game->game.getMoves();
+        game_proto::Response response;
+        auto &newGameResponse = *response.mutable_new_game_response();
+        newGameResponse.set_game_id(gameId);
+        newGameResponse.set_make_first_move(player == game->player1.id);
+        newGameResponse.set_opponent_display_name(
+            std::string(m_playerManager.getDisplayName(opponent)));
+        newGameResponse.set_opponent_rating(m_playerManager.getRating(opponent));
+        newGameResponse.set_resumed(true);
+        for (std::uint32_t i = 0; i < moves.size(); ++i) {
+            newGameResponse.add_moves(moves[i]);
+        }
+        sendProtoMessage(id, response);
+
+        if (game->player1.connection == 0U || game->player2.connection == 0U) {
+            continue;
+        }
+
+        // Both players are back, the clock of the player to move starts.
+        game->recovered = false;
+        m_timingWheel.cancel(game->deadlineTimer);
+        auto now = std::chrono::steady_clock::now();
+        game->turnStart = now;
+        armMoveDeadline(game, now);
+
+        game_proto::Response movesResponse;
+        auto &available = *movesResponse.mutable_available_games_response();
+        available.set_game_id(gameId);
+        std::vector<std::uint32_t> availableColumns = game->game.getAvailableColumns();
+        available.mutable_column_idx()->Add(availableColumns.begin(), availableColumns.end());
+        sendProtoMessage(game->getPlayerToMove().connection, movesResponse);
+    }
+}
+
+void ServerLogic::forgetRecoveredGame(GameManager::LockedGame const &game) {
+    std::lock_guard<std::mutex> lock(m_recoveredGamesMutex);
+    for (PlayerId player : {game->player1.id, game->player2.id}) {
+        auto iter = m_recoveredGames.find(player);
+        if (iter == m_recoveredGames.end()) {
+            continue;
+        }
+        std::erase(iter->second, game.getId());
+        if (iter->second.empty()) {
+            m_recoveredGames.erase(iter);
+        }
+    }
+}
+
+void ServerLogic::armMoveDeadline(GameManager::LockedGame &game,
+                                  std::chrono::steady_clock::time_point now) {
+    auto const &remaining = game->remainingTime[game->isPlayer1ToMove() ? 0U : 1U];
+    auto deadline = now + std::min<std::chrono::steady_clock::duration>(m_timeControl.moveTime,
+                                                                       remaining);
+    game->deadlineTimer = m_timingWheel.schedule(deadline, game.getId());
+}
+
+void ServerLogic::runTimerThread(std::stop_token stopToken,
+                                 asio::thread_pool::executor_type executor) {
+    std::vector<TimingWheel::ExpiredTimer> expired;
+    auto nextTick = std::chrono::steady_clock::now();
+    while (!stopToken.stop_requested()) {
+        nextTick += m_timingWheel.getTickDuration();
+        std::this_thread::sleep_until(nextTick);
+
+        expired.clear();
+        m_timingWheel.advance(std::chrono::steady_clock::now(), expired);
+        // Games are locked on the thread pool, so that the timer thread never waits for them.
+        for (auto const &timer : expired) {
+            asio::post(executor, [this, timer]() { onMoveDeadline(timer.payload, timer.id); });
+        }
+    }
+}
+
+void ServerLogic::onMoveDeadline(GameId gameId, TimingWheel::TimerId timer) {
+    GameManager::LockedGame game = m_gameManager.getGame(gameId);
+    // The game has ended or the player has moved in the meantime.
+    if (!game || game->deadlineTimer != timer) {
+        return;
+    }
+    endGameOnTime(std::move(game));
+}
+
+void ServerLogic::endGameOnTime(GameManager::LockedGame &&game) {
+    if (game->recovered) {
+        // A player did not return, so nobody could move and the result would be made up.
+        std::cout << std::format("Cancelled recovered game {:} on time.\n", game.getId());
+        sendGameEndResponse(
+            game->player1.connection, game.getId(), game_proto::GameEnd::Cancelled);
+        sendGameEndResponse(
+            game->player2.connection, game.getId(), game_proto::GameEnd::Cancelled);
+        return endGame(std::move(game), game_proto::GameEnd::Cancelled);
+    }
+
+    GamePlayer const &loser = game->getPlayerToMove();
+    GamePlayer const &winner = game->getOpponent(loser.id);
+
+    std::cout << std::format("{:s} lost game {:} on time.\n",
+                             m_playerManager.getUsername(loser.id),
+                             game.getId());
+    sendGameEndResponse(loser.connection, game.getId(), game_proto::GameEnd::Loss);
+    sendGameEndResponse(winner.connection, game.getId(), game_proto::GameEnd::Win);
+
+    bool player1Lost = game->isPlayer1ToMove();
+    endGame(std::move(game),
+            player1Lost ? game_proto::GameEnd::Loss : game_proto::GameEnd::Win);
+}
+
+void ServerLogic::endGame(GameManager::LockedGame &&game, game_proto::GameEnd player1Result) {
+    GameId gameId = game.getId();
+    m_timingWheel.cancel(game->deadlineTimer);
+    if (game->recovered) {
+        forgetRecoveredGame(game);
+    }
+
+    if (m_persistence && player1Result != game_proto::GameEnd::Cancelled) {
+        GameResult result = GameResult::Draw;
+        if (player1Result == game_proto::GameEnd::Win) {
+            result = GameResult::Player1Win;
+        } else if (player1Result == game_proto::GameEnd::Loss) {
+            result = GameResult::Player2Win;
+        }
+        m_persistence->persistGame(GameRecord{
+            .player1Username = std::string(m_playerManager.getUsername(game->player1.id)),
+            .player1DisplayName =
+                std::string(m_playerManager.getDisplayName(game->player1.id)),
+            .player2Username = std::string(m_playerManager.getUsername(game->player2.id)),
+            .player2DisplayName =
+                std::string(m_playerManager.getDisplayName(game->player2.id)),
+            .result = result,
+            .moves = game->game.getMoves(),
+            .startTime = game->startTime,
+            .endTime = std::chrono::system_clock::now(),
+        });
     }
 
-    auto opponentHandle = game->player1 == player ? game->player2 : game->player1;
+    if (m_journal) {
+        m_journal->gameEnded(gameId);
+    }
+
+    // Taken under the game lock, so nobody can subscribe after the snapshot.
+    auto spectators = m_spectators.removeGame(gameId);
+    m_gameManager.removeGameInstance(std::move(game));
 
-    return m_playerManager.getPlayer(opponentHandle);
+    if (spectators) {
+        game_proto::Response response;
+        auto &endResponse = *response.mutable_spectated_game_end_response();
+        endResponse.set_game_id(gameId);
+        endResponse.set_player1_result(player1Result);
+        broadcastToSpectators(*spectators, response);
+    }
 }
 
+void ServerLogic::sendGameEndResponse(ConnectionId connection,
+                                      GameId gameId,
+                                      game_proto::GameEnd result,
+                                      std::optional<std::uint32_t> opponentColumnIdx) {
+    // Reponse for the winner.
+    game_proto::Response response;
+    game_proto::GameEndResponse &end_response = *response.mutable_game_end_response();
+    end_response.set_game_id(gameId);
+    end_response.set_game_end(result);
+    if (opponentColumnIdx) {
+        end_response.set_opponent_column_idx(*opponentColumnIdx);
+    }
+    sendProtoMessage(connection, response);
+};
+
 void ServerLogic::processMoveRequest(ConnectionId id, game_proto::MoveRequest const &request) {
 
-    GameHdl gameInstance = GameManager::getGameFromId(request.game_id());
-    GamePtr gamePtr = m_gameManager.getGame(id, gameInstance);
+    // The game stays locked until the move is processed.
+    GameManager::LockedGame gamePtr = m_gameManager.getGame(id, request.game_id());
     if (!gamePtr) {
         return sendErrorResponse(
             id, std::format("Game with id {:} is not active.", request.game_id()));
     }
 
-    PlayerPtr player = m_playerManager.getActivePlayer(id);
+    if (gamePtr->recovered) {
+        return sendErrorResponse(id, "Waiting for the opponent to log in again.");
+    }
+    PlayerId player = m_playerManager.getActivePlayer(id);
+    if (gamePtr->getPlayerToMove().id != player) {
+        return sendErrorResponse(id, "It is not your turn.");
+    }
+
+    // A move that arrives after the deadline, but before the timer has fired, loses as well.
+    auto now = std::chrono::steady_clock::now();
+    auto &remaining = gamePtr->remainingTime[gamePtr->isPlayer1ToMove() ? 0U : 1U];
+    auto elapsed = now - gamePtr->turnStart;
+    if (elapsed >= std::min<std::chrono::steady_clock::duration>(m_timeControl.moveTime,
+                                                                 remaining)) {
+        return endGameOnTime(std::move(gamePtr));
+    }
+
     std::uint32_t columnIdx = request.column_idx();
+    gamePtr->insertCoin(columnIdx, player);
+    if (m_journal) {
+        m_journal->moveMade(request.game_id(), columnIdx);
+    }
 
-    gamePtr->insertCoin(columnIdx, player.get());
+    m_timingWheel.cancel(gamePtr->deadlineTimer);
+    remaining -= elapsed;
+
+    // Sent under the game lock, so that spectators receive the moves in order.
+    if (auto spectators = m_spectators.getSubscribers(request.game_id())) {
+        game_proto::Response update;
+        auto &moveResponse = *update.mutable_spectator_move_response();
+        moveResponse.set_game_id(request.game_id());
+        moveResponse.set_column_idx(columnIdx);
+        moveResponse.set_move_idx(gamePtr->game.getMoveCount() - 1U);
+        broadcastToSpectators(*spectators, update);
+    }
 
     auto &game = gamePtr->game;
     bool hasWon = game.checkIfWin(columnIdx);
     bool gameEnd = game.isFull() || hasWon;
 
-    PlayerPtr opponent = getOpponent(gameInstance, player.get());
-    assert(opponent);
+    GamePlayer const &opponent = gamePtr->getOpponent(player);
     game_proto::Response response;
     if (gameEnd) {
-        sendGameEndResponse(player.get(),
+        sendGameEndResponse(id,
                             request.game_id(),
                             hasWon ? game_proto::GameEnd::Win : game_proto::GameEnd::Draw);
-        sendGameEndResponse(opponent.get(),
+        sendGameEndResponse(opponent.connection,
                             request.game_id(),
-                            hasWon ? game_proto::GameEnd::Loss : game_proto::GameEnd::Draw);
+                            hasWon ? game_proto::GameEnd::Loss : game_proto::GameEnd::Draw,
+                            columnIdx);
 
-        m_gameManager.removeGameInstance(gameInstance);
+        game_proto::GameEnd player1Result = game_proto::GameEnd::Draw;
+        if (hasWon) {
+            player1Result = player == gamePtr->player1.id ? game_proto::GameEnd::Win
+                                                          : game_proto::GameEnd::Loss;
+        }
+        endGame(std::move(gamePtr), player1Result);
     } else {
         // If the player, that made the move, has not won, then we send available moves to
         // the other player, so that he makes the next move.
         game_proto::AvailableMovesResponse &rsp = *response.mutable_available_games_response();
 
         rsp.set_game_id(request.game_id());
-        *rsp.mutable_column_idx() = google::protobuf::RepeatedField<uint32_t>(
-            game.getAvailableColumns().begin(), game.getAvailableColumns().end());
+        std::vector<std::uint32_t> availableColumns = game.getAvailableColumns();
+        rsp.mutable_column_idx()->Add(availableColumns.begin(), availableColumns.end());
+        rsp.set_opponent_column_idx(columnIdx);
+        rsp.set_move_idx(game.getMoveCount() - 1U);
+
+        gamePtr->turnStart = now;
+        armMoveDeadline(gamePtr, now);
 
-        sendProtoMessage(opponent->getConnection(), response);
+        sendProtoMessage(opponent.connection, response);
     }
 }
 
@@ -275,44 +865,88 @@ void ServerLogic::processMessageRequest(ConnectionId id,
                                         game_proto::MessageRequest const &request) {
     auto const &gameId = request.game_id();
 
-    GameHdl gameInstance = GameManager::getGameFromId(gameId);
-
-    GamePtr game = m_gameManager.getGame(id, gameInstance);
+    GameManager::LockedGame game = m_gameManager.getGame(id, gameId);
     if (!game) {
         return sendErrorResponse(
             id, std::format("Message request refused. Game is not active. Game {:}.", gameId));
     }
 
-    PlayerPtr sender = m_playerManager.getActivePlayer(id);
-    PlayerHdl receiver =
-        sender.get() == gameInstance->player1 ? gameInstance->player2 : gameInstance->player1;
+    PlayerId sender = m_playerManager.getActivePlayer(id);
+    GamePlayer const &receiver = game->getOpponent(sender);
 
     game_proto::Response response;
     response.mutable_message_response()->set_game_id(gameId);
-    response.mutable_message_response()->set_sender_display_name(sender->getDisplayName());
+    response.mutable_message_response()->set_sender_display_name(
+        std::string(m_playerManager.getDisplayName(sender)));
     response.mutable_message_response()->set_message(request.message());
-    sendProtoMessage(receiver->getConnection(), response);
+    sendProtoMessage(receiver.connection, response);
 }
 
-void ServerLogic::onConnectionClosed(ConnectionId id) {
-    auto games = m_gameManager.getGames(id);
+void ServerLogic::processSpectateRequest(ConnectionId id,
+                                         game_proto::SpectateRequest const &request) {
+    GameId gameId = request.game_id();
 
-    if (!games) {
-        m_gameManager.removePlayer(id);
+    // Subscribed under the game lock, so that the board snapshot precedes all move updates.
+    GameManager::LockedGame game = m_gameManager.getGame(gameId);
+    if (!game) {
+        return sendErrorResponse(id, std::format("Game with id {:} is not active.", gameId));
+    }
+    switch (m_spectators.subscribe(gameId, id)) {
+    case SpectatorRegistry::SubscribeResult::AlreadySubscribed:
+        return sendErrorResponse(id, std::format("Already spectating game {:}.", gameId));
+    case SpectatorRegistry::SubscribeResult::ConnectionClosed:
         return;
+    case SpectatorRegistry::SubscribeResult::Subscribed:
+        break;
     }
 
-    PlayerPtr player = m_playerManager.getActivePlayer(id);
-    assert(player != nullptr);
+    game_proto::Response response;
+    auto &spectateResponse = *response.mutable_spectate_response();
+    spectateResponse.set_game_id(gameId);
+    spectateResponse.set_player1_display_name(
+        std::string(m_playerManager.getDisplayName(game->player1.id)));
+    spectateResponse.set_player2_display_name(
+        std::string(m_playerManager.getDisplayName(game->player2.id)));
+    for (std::uint32_t row = 0; row < ConnectFourGame::RowCount; ++row) {
+        for (std::uint32_t column = 0; column < ConnectFourGame::ColumnCount; ++column) {
+            spectateResponse.add_board(static_cast<std::uint32_t>(game->game(row, column)));
+        }
+    }
+    spectateResponse.set_move_count(game->game.getMoveCount());
+    sendProtoMessage(id, response);
+}
 
-    for (auto &item : *games) {
+void ServerLogic::processStopSpectatingRequest(
+    ConnectionId id, game_proto::StopSpectatingRequest const &request) {
+    if (!m_spectators.unsubscribe(request.game_id(), id)) {
+        return sendErrorResponse(
+            id, std::format("Not spectating game {:}.", request.game_id()));
+    }
+    sendSuccessResponse(id);
+}
 
-        auto *gameInstance = item.first;
-        auto opponent = getOpponent(gameInstance, player.get());
+void ServerLogic::onConnectionClosed(ConnectionId id) {
+    m_spectators.removeConnection(id);
 
-        sendGameEndResponse(
-            opponent.get(), GameManager::getGameId(gameInstance), game_proto::GameEnd::Win);
-        m_gameManager.removeGameInstance(gameInstance);
+    // The player goes offline, so that the id of a later connection does not resolve to it.
+    PlayerId player = m_playerManager.removeActiveConnection(id);
+    if (player == InvalidPlayerId) {
+        return;
+    }
+    m_playerManager.removeFromMatchmaking(player);
+
+    // Games that end concurrently are simply missing when we try to lock them.
+    for (GameId gameId : m_gameManager.getGames(id)) {
+        GameManager::LockedGame game = m_gameManager.getGame(id, gameId);
+        if (!game) {
+            continue;
+        }
+
+        GamePlayer const &opponent = game->getOpponent(player);
+        sendGameEndResponse(opponent.connection, gameId, game_proto::GameEnd::Win);
+
+        bool player1Left = player == game->player1.id;
+        endGame(std::move(game),
+                player1Left ? game_proto::GameEnd::Loss : game_proto::GameEnd::Win);
     }
-    m_gameManager.removePlayer(id);
 }
\ No newline at end of file
@@ -0,0 +1,12 @@
+#ifndef SHARD_UTILS_H
+#define SHARD_UTILS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Spreads pointer-like ids (aligned, so low bits are zero) and string hashes over the shards.
+inline std::size_t getShardIndex(std::size_t hash, std::size_t shardCount) {
+    return std::size_t((std::uint64_t(hash) * 0x9e3779b97f4a7c15ULL) >> 32U) % shardCount;
+}
+
+#endif
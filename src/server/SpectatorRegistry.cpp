@@ -0,0 +1,157 @@
+#include "SpectatorRegistry.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <mutex>
+
+#include <server/ShardUtils.h>
+
+auto SpectatorRegistry::getGameShard(GameId game) -> GameShard & {
+    return m_gameShards[getShardIndex(std::hash<GameId>{}(game), ShardCount)];
+}
+
+auto SpectatorRegistry::getConnectionShard(ConnectionId connection) -> ConnectionShard & {
+    return m_connectionShards[getShardIndex(std::hash<ConnectionId>{}(connection),
+                                            ShardCount)];
+}
+
+auto SpectatorRegistry::subscribe(GameId game, ConnectionId connection) -> SubscribeResult {
+    // Held throughout, so that removeConnection either sees the subscription or happened
+    // before and left its mark.
+    auto &connectionShard = getConnectionShard(connection);
+    std::lock_guard<std::mutex> connectionLock(connectionShard.mutex);
+    if (connectionShard.closed.contains(connection)) {
+        return SubscribeResult::ConnectionClosed;
+    }
+
+    {
+        auto &shard = getGameShard(game);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        auto &subscribers = shard.games[game];
+        if (subscribers && std::ranges::find(*subscribers, connection) != subscribers->end()) {
+            return SubscribeResult::AlreadySubscribed;
+        }
+
+        // Readers may still hold the old snapshot, so it is copied instead of modified.
+        auto updated = subscribers ? std::make_shared<Subscribers>(*subscribers)
+                                   : std::make_shared<Subscribers>();
+        updated->push_back(connection);
+        subscribers = std::move(updated);
+    }
+
+    connectionShard.games[connection].push_back(game);
+    return SubscribeResult::Subscribed;
+}
+
+bool SpectatorRegistry::removeSubscriber(GameId game, ConnectionId connection) {
+    auto &shard = getGameShard(game);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto iter = shard.games.find(game);
+    if (iter == shard.games.end()) {
+        return false;
+    }
+    auto const &subscribers = *iter->second;
+    auto position = std::ranges::find(subscribers, connection);
+    if (position == subscribers.end()) {
+        return false;
+    }
+
+    if (subscribers.size() == 1U) {
+        shard.games.erase(iter);
+        return true;
+    }
+    auto updated = std::make_shared<Subscribers>();
+    updated->reserve(subscribers.size() - 1U);
+    updated->insert(updated->end(), subscribers.begin(), position);
+    updated->insert(updated->end(), position + 1, subscribers.end());
+    iter->second = std::move(updated);
+    return true;
+}
+
+bool SpectatorRegistry::removeWatchedGame(ConnectionId connection, GameId game) {
+    auto &shard = getConnectionShard(connection);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto iter = shard.games.find(connection);
+    if (iter == shard.games.end()) {
+        return false;
+    }
+    auto &games = iter->second;
+    auto position = std::ranges::find(games, game);
+    if (position == games.end()) {
+        return false;
+    }
+
+    // Order does not matter.
+    *position = games.back();
+    games.pop_back();
+    if (games.empty()) {
+        shard.games.erase(iter);
+    }
+    return true;
+}
+
+bool SpectatorRegistry::unsubscribe(GameId game, ConnectionId connection) {
+    if (!removeSubscriber(game, connection)) {
+        return false;
+    }
+    removeWatchedGame(connection, game);
+    return true;
+}
+
+void SpectatorRegistry::removeConnection(ConnectionId connection) {
+    std::vector<GameId> games;
+    {
+        auto &shard = getConnectionShard(connection);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        auto now = std::chrono::steady_clock::now();
+        std::erase_if(shard.closed, [now](auto const &entry) {
+            return now - entry.second > ClosedRetention;
+        });
+        shard.closed[connection] = now;
+
+        auto iter = shard.games.find(connection);
+        if (iter == shard.games.end()) {
+            return;
+        }
+        games = std::move(iter->second);
+        shard.games.erase(iter);
+    }
+
+    for (GameId game : games) {
+        removeSubscriber(game, connection);
+    }
+}
+
+auto SpectatorRegistry::removeGame(GameId game) -> SubscribersPtr {
+    SubscribersPtr subscribers;
+    {
+        auto &shard = getGameShard(game);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto iter = shard.games.find(game);
+        if (iter == shard.games.end()) {
+            return nullptr;
+        }
+        subscribers = std::move(iter->second);
+        shard.games.erase(iter);
+    }
+
+    for (ConnectionId connection : *subscribers) {
+        removeWatchedGame(connection, game);
+    }
+    return subscribers;
+}
+
+auto SpectatorRegistry::getSubscribers(GameId game) -> SubscribersPtr {
+    auto &shard = getGameShard(game);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto iter = shard.games.find(game);
+    if (iter == shard.games.end()) {
+        return nullptr;
+    }
+    return iter->second;
+}
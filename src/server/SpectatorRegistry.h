@@ -0,0 +1,74 @@
+#ifndef SPECTATOR_REGISTRY_H
+#define SPECTATOR_REGISTRY_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <server/ConnectionMetadata.h>
+#include <server/ServerTypes.h>
+
+// Spectators of active games. Subscriber lists are immutable snapshots that are replaced on
+// every subscribe and unsubscribe, so that a fan-out iterates its snapshot without holding
+// any lock, while viewers keep joining and leaving.
+class SpectatorRegistry {
+  public:
+    using GameId = std::uint64_t;
+    using Subscribers = std::vector<ConnectionId>;
+    using SubscribersPtr = std::shared_ptr<Subscribers const>;
+
+    enum class SubscribeResult { Subscribed, AlreadySubscribed, ConnectionClosed };
+
+    // Must not race with removeGame of the same game, callers hold the game lock for both. May
+    // race with removeConnection, requests of a connection still run after it closed.
+    SubscribeResult subscribe(GameId game, ConnectionId connection);
+    bool unsubscribe(GameId game, ConnectionId connection);
+
+    // Drops all subscriptions of a closed connection and refuses new ones for a while.
+    void removeConnection(ConnectionId connection);
+    // Drops the subscriber list of an ended game and returns its last snapshot.
+    SubscribersPtr removeGame(GameId game);
+
+    // Returns nullptr if nobody watches the game.
+    SubscribersPtr getSubscribers(GameId game);
+
+  private:
+    static constexpr std::size_t ShardCount = 32U;
+    // Outlasts the requests a connection has in flight when it closes. Connection ids may be
+    // reused afterwards.
+    static constexpr std::chrono::seconds ClosedRetention{10};
+
+    // Subscriber lists, sharded by game id.
+    struct alignas(64) GameShard {
+        std::mutex mutex;
+        std::unordered_map<GameId, SubscribersPtr> games;
+    };
+
+    // Watched games of every spectating connection, sharded by connection id. Needed to clean
+    // up after closed connections.
+    struct alignas(64) ConnectionShard {
+        std::mutex mutex;
+        std::unordered_map<ConnectionId, std::vector<GameId>> games;
+        // Close times of recently closed connections.
+        std::unordered_map<ConnectionId, std::chrono::steady_clock::time_point> closed;
+    };
+
+    GameShard &getGameShard(GameId game);
+    ConnectionShard &getConnectionShard(ConnectionId connection);
+
+    // Both return false if nothing changed.
+    bool removeSubscriber(GameId game, ConnectionId connection);
+    bool removeWatchedGame(ConnectionId connection, GameId game);
+
+  private:
+    // Subscribe takes a game shard mutex while holding a connection shard mutex, so that it
+    // can not interleave with removeConnection. No other shard mutexes are nested.
+    std::array<GameShard, ShardCount> m_gameShards;
+    std::array<ConnectionShard, ShardCount> m_connectionShards;
+};
+
+#endif
@@ -0,0 +1,88 @@
+#include "StatementCache.h"
+
+#include <format>
+#include <stdexcept>
+
+StatementCache::Statement::Statement(Statement &&other) noexcept
+    : m_cache(other.m_cache), m_statement(other.m_statement), m_cached(other.m_cached) {
+    other.m_statement = nullptr;
+}
+
+StatementCache::Statement::~Statement() {
+    if (m_statement) {
+        m_cache->release(m_statement, m_cached);
+    }
+}
+
+StatementCache::StatementCache(sqlite3 *db, std::size_t capacity)
+    : m_db(db), m_capacity(capacity) {}
+
+StatementCache::~StatementCache() {
+    for (auto &entry : m_entries) {
+        sqlite3_finalize(entry.statement);
+    }
+}
+
+sqlite3_stmt *StatementCache::prepare(std::string const &sql) {
+    sqlite3_stmt *statement = nullptr;
+    int status = sqlite3_prepare_v3(
+        m_db, sql.data(), int(sql.size()), SQLITE_PREPARE_PERSISTENT, &statement, nullptr);
+    if (status != SQLITE_OK) {
+        throw std::runtime_error(std::format(
+            "Failed to prepare sql statement. Error: {:s}", sqlite3_errmsg(m_db)));
+    }
+    return statement;
+}
+
+auto StatementCache::acquire(std::string const &sql) -> Statement {
+    auto iter = m_index.find(sql);
+    if (iter != m_index.end()) {
+        auto entry = iter->second;
+        if (entry->inUse) {
+            return Statement(this, prepare(sql), false);
+        }
+        m_entries.splice(m_entries.begin(), m_entries, entry);
+        entry->inUse = true;
+        m_inUse.emplace(entry->statement, entry);
+        return Statement(this, entry->statement, true);
+    }
+
+    sqlite3_stmt *statement = prepare(sql);
+    m_entries.push_front(Entry{.sql = sql, .statement = statement, .inUse = true});
+    m_index.emplace(m_entries.front().sql, m_entries.begin());
+    m_inUse.emplace(statement, m_entries.begin());
+    evict();
+    return Statement(this, statement, true);
+}
+
+void StatementCache::release(sqlite3_stmt *statement, bool cached) {
+    if (!cached) {
+        sqlite3_finalize(statement);
+        return;
+    }
+
+    // Bindings may point to caller memory that is about to go away.
+    sqlite3_reset(statement);
+    sqlite3_clear_bindings(statement);
+
+    auto iter = m_inUse.find(statement);
+    if (iter != m_inUse.end()) {
+        iter->second->inUse = false;
+        m_inUse.erase(iter);
+    }
+    evict();
+}
+
+void StatementCache::evict() {
+    // Least recently used statements that are not in use go first.
+    auto entry = m_entries.end();
+    while (m_entries.size() > m_capacity && entry != m_entries.begin()) {
+        --entry;
+        if (entry->inUse) {
+            continue;
+        }
+        sqlite3_finalize(entry->statement);
+        m_index.erase(entry->sql);
+        entry = m_entries.erase(entry);
+    }
+}
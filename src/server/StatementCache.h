@@ -0,0 +1,72 @@
+#ifndef STATEMENT_CACHE_H
+#define STATEMENT_CACHE_H
+
+#include <sqlite3.h>
+
+#include <cstddef>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// LRU cache of the prepared statements of one connection, keyed by SQL text. Statements are
+// handed out as RAII handles that reset them on release. Statements in use are never
+// evicted; if a statement is requested while it is in use, a temporary one is prepared and
+// finalized on release. Like the connection, the cache must only be used by one thread at a
+// time.
+class StatementCache {
+  public:
+    class Statement {
+      public:
+        Statement(Statement &&other) noexcept;
+        Statement &operator=(Statement &&) = delete;
+        ~Statement();
+
+        sqlite3_stmt *get() const { return m_statement; }
+        operator sqlite3_stmt *() const { return m_statement; }
+
+      private:
+        friend class StatementCache;
+        Statement(StatementCache *cache, sqlite3_stmt *statement, bool cached)
+            : m_cache(cache), m_statement(statement), m_cached(cached) {}
+
+        StatementCache *m_cache;
+        sqlite3_stmt *m_statement;
+        bool m_cached;
+    };
+
+    StatementCache(sqlite3 *db, std::size_t capacity);
+    // Finalizes all statements. Statement handles must not outlive the cache.
+    ~StatementCache();
+
+    StatementCache(StatementCache const &) = delete;
+    StatementCache &operator=(StatementCache const &) = delete;
+
+    // Throws if the statement can not be prepared.
+    Statement acquire(std::string const &sql);
+
+    std::size_t size() const { return m_entries.size(); }
+
+  private:
+    struct Entry {
+        std::string sql;
+        sqlite3_stmt *statement = nullptr;
+        bool inUse = false;
+    };
+    using EntryList = std::list<Entry>;
+
+    sqlite3_stmt *prepare(std::string const &sql);
+    void release(sqlite3_stmt *statement, bool cached);
+    void evict();
+
+  private:
+    sqlite3 *m_db;
+    std::size_t m_capacity;
+    // Most recently used first.
+    EntryList m_entries;
+    // Keys are views into the sql of the entries.
+    std::unordered_map<std::string_view, EntryList::iterator> m_index;
+    std::unordered_map<sqlite3_stmt *, EntryList::iterator> m_inUse;
+};
+
+#endif
@@ -0,0 +1,26 @@
+#include "StringArena.h"
+
+#include <cstring>
+
+char *StringArena::allocate(std::size_t size) {
+    if (size > BlockSize) {
+        // Too large to share a block, give it its own.
+        return m_blocks.emplace_back(std::make_unique<char[]>(size)).get();
+    }
+
+    if (!m_currentBlock || m_blockOffset + size > BlockSize) {
+        m_currentBlock = m_blocks.emplace_back(std::make_unique<char[]>(BlockSize)).get();
+        m_blockOffset = 0U;
+    }
+
+    char *data = m_currentBlock + m_blockOffset;
+    m_blockOffset += size;
+    return data;
+}
+
+char const *StringArena::store(std::string_view first, std::string_view second) {
+    char *data = allocate(first.size() + second.size());
+    std::memcpy(data, first.data(), first.size());
+    std::memcpy(data + first.size(), second.data(), second.size());
+    return data;
+}
@@ -0,0 +1,28 @@
+#ifndef STRING_ARENA_H
+#define STRING_ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Append-only string storage. Strings are copied back to back into large blocks that are
+// never freed or moved, so stored strings stay valid for the lifetime of the arena. Strings
+// are not deduplicated, lookups are up to the owner. Not thread safe.
+class StringArena {
+  public:
+    // Returns the copy of the strings, stored back to back.
+    char const *store(std::string_view first, std::string_view second);
+
+  private:
+    static constexpr std::size_t BlockSize = 1U << 16U;
+
+    char *allocate(std::size_t size);
+
+  private:
+    std::vector<std::unique_ptr<char[]>> m_blocks;
+    char *m_currentBlock = nullptr;
+    std::size_t m_blockOffset = 0U;
+};
+
+#endif
@@ -0,0 +1,168 @@
+#include "TimingWheel.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+TimingWheel::TimingWheel(Clock::duration tickDuration, Clock::time_point start)
+    : m_tickDuration(tickDuration), m_start(start) {
+    if (m_tickDuration <= Clock::duration::zero()) {
+        throw std::invalid_argument("Timing wheel tick duration must be positive.");
+    }
+    m_buckets.fill(InvalidIndex);
+}
+
+std::uint64_t TimingWheel::getTick(Clock::time_point time) const {
+    if (time <= m_start) {
+        return 0U;
+    }
+    return std::uint64_t((time - m_start) / m_tickDuration);
+}
+
+std::uint32_t TimingWheel::getBucket(std::uint64_t expiryTick) const {
+    // Level is chosen by the distance to the current tick, bucket by the bits of the expiry
+    // tick of that level. A level is cascaded exactly when the current tick reaches the start
+    // of the bucket's range.
+    std::uint64_t delta = expiryTick - m_currentTick;
+    std::uint32_t level = 0U;
+    while (level + 1U < LevelCount &&
+           delta >= (std::uint64_t(1U) << (LevelBits * (level + 1U)))) {
+        ++level;
+    }
+    auto bucket = std::uint32_t((expiryTick >> (LevelBits * level)) & (BucketsPerLevel - 1U));
+    return level * BucketsPerLevel + bucket;
+}
+
+void TimingWheel::insertLocked(TimerIndex index) {
+    auto &timer = m_timers[index];
+    timer.bucket = getBucket(timer.expiryTick);
+
+    TimerIndex head = m_buckets[timer.bucket];
+    timer.prev = InvalidIndex;
+    timer.next = head;
+    if (head != InvalidIndex) {
+        m_timers[head].prev = index;
+    }
+    m_buckets[timer.bucket] = index;
+}
+
+void TimingWheel::unlinkLocked(TimerIndex index) {
+    auto &timer = m_timers[index];
+    if (timer.prev != InvalidIndex) {
+        m_timers[timer.prev].next = timer.next;
+    } else {
+        m_buckets[timer.bucket] = timer.next;
+    }
+    if (timer.next != InvalidIndex) {
+        m_timers[timer.next].prev = timer.prev;
+    }
+    timer.prev = InvalidIndex;
+    timer.next = InvalidIndex;
+}
+
+void TimingWheel::releaseLocked(TimerIndex index) {
+    auto &timer = m_timers[index];
+    timer.active = false;
+    // Generation 0 is never used, so that id 0 is always invalid.
+    timer.generation = timer.generation == std::numeric_limits<std::uint32_t>::max()
+                           ? 1U
+                           : timer.generation + 1U;
+    m_freeTimers.push_back(index);
+    --m_activeCount;
+}
+
+auto TimingWheel::schedule(Clock::time_point deadline, std::uint64_t payload) -> TimerId {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Ticks up to the current one are already processed.
+    std::uint64_t expiryTick = std::max(getTick(deadline), m_currentTick + 1U);
+    expiryTick = std::min(expiryTick, m_currentTick + MaxTickDelta);
+
+    TimerIndex index;
+    if (!m_freeTimers.empty()) {
+        index = m_freeTimers.back();
+        m_freeTimers.pop_back();
+    } else {
+        if (m_timers.size() >= InvalidIndex) {
+            throw std::runtime_error("Too many timers.");
+        }
+        index = TimerIndex(m_timers.size());
+        m_timers.emplace_back();
+    }
+
+    auto &timer = m_timers[index];
+    timer.expiryTick = expiryTick;
+    timer.payload = payload;
+    timer.active = true;
+    insertLocked(index);
+    ++m_activeCount;
+
+    return (TimerId(timer.generation) << 32U) | index;
+}
+
+bool TimingWheel::cancel(TimerId id) {
+    auto index = TimerIndex(id & 0xFFFFFFFFU);
+    auto generation = std::uint32_t(id >> 32U);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (index >= m_timers.size()) {
+        return false;
+    }
+    auto &timer = m_timers[index];
+    if (!timer.active || timer.generation != generation) {
+        return false;
+    }
+    unlinkLocked(index);
+    releaseLocked(index);
+    return true;
+}
+
+void TimingWheel::cascadeLocked(std::uint32_t level) {
+    auto bucket =
+        std::uint32_t((m_currentTick >> (LevelBits * level)) & (BucketsPerLevel - 1U));
+    TimerIndex index = m_buckets[level * BucketsPerLevel + bucket];
+    m_buckets[level * BucketsPerLevel + bucket] = InvalidIndex;
+
+    while (index != InvalidIndex) {
+        TimerIndex next = m_timers[index].next;
+        insertLocked(index);
+        index = next;
+    }
+}
+
+void TimingWheel::advance(Clock::time_point now, std::vector<ExpiredTimer> &expired) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::uint64_t nowTick = getTick(now);
+    while (m_currentTick < nowTick) {
+        ++m_currentTick;
+
+        // When a lower level wraps around, the next bucket of the level above is due.
+        for (std::uint32_t level = 1U; level < LevelCount; ++level) {
+            if ((m_currentTick & ((std::uint64_t(1U) << (LevelBits * level)) - 1U)) != 0U) {
+                break;
+            }
+            cascadeLocked(level);
+        }
+
+        auto &bucket = m_buckets[m_currentTick & (BucketsPerLevel - 1U)];
+        TimerIndex index = bucket;
+        bucket = InvalidIndex;
+        while (index != InvalidIndex) {
+            auto &timer = m_timers[index];
+            TimerIndex next = timer.next;
+            expired.push_back(ExpiredTimer{
+                .id = (TimerId(timer.generation) << 32U) | index,
+                .payload = timer.payload,
+            });
+            timer.prev = InvalidIndex;
+            timer.next = InvalidIndex;
+            releaseLocked(index);
+            index = next;
+        }
+    }
+}
+
+std::size_t TimingWheel::size() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_activeCount;
+}
@@ -0,0 +1,84 @@
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+// Hierarchical timing wheel. Timers are kept in intrusive lists in 4 levels of 256 buckets.
+// Level 0 has one bucket per tick, every higher level covers 256 times the range of the level
+// below. Schedule and cancel are O(1). Timers of higher levels are moved (cascaded) to lower
+// levels when the wheel below wraps around. Thread safe. Meant to be advanced by a single
+// timer thread.
+class TimingWheel {
+  public:
+    using Clock = std::chrono::steady_clock;
+    // Timer slot index in the lower, slot generation in the upper 32 bits.
+    using TimerId = std::uint64_t;
+    static constexpr TimerId InvalidTimerId = 0U;
+
+    struct ExpiredTimer {
+        TimerId id;
+        std::uint64_t payload;
+    };
+
+    TimingWheel(Clock::duration tickDuration, Clock::time_point start = Clock::now());
+
+    // Payload is returned back when the timer expires. Deadlines in the past expire on the
+    // next advance.
+    TimerId schedule(Clock::time_point deadline, std::uint64_t payload);
+    // Returns false if the timer already expired or was cancelled.
+    bool cancel(TimerId id);
+
+    // Moves the wheel to now and appends all timers that expired on the way.
+    void advance(Clock::time_point now, std::vector<ExpiredTimer> &expired);
+
+    Clock::duration getTickDuration() const { return m_tickDuration; }
+    std::size_t size();
+
+  private:
+    static constexpr std::uint32_t LevelBits = 8U;
+    static constexpr std::uint32_t BucketsPerLevel = 1U << LevelBits;
+    static constexpr std::uint32_t LevelCount = 4U;
+    // Deadlines further away are clamped.
+    static constexpr std::uint64_t MaxTickDelta =
+        (std::uint64_t(1U) << (LevelBits * LevelCount)) - 1U;
+
+    using TimerIndex = std::uint32_t;
+    static constexpr TimerIndex InvalidIndex = std::numeric_limits<TimerIndex>::max();
+
+    struct Timer {
+        std::uint64_t expiryTick = 0U;
+        std::uint64_t payload = 0U;
+        TimerIndex next = InvalidIndex;
+        TimerIndex prev = InvalidIndex;
+        std::uint32_t generation = 1U;
+        std::uint32_t bucket = 0U;
+        bool active = false;
+    };
+
+    std::uint64_t getTick(Clock::time_point time) const;
+    std::uint32_t getBucket(std::uint64_t expiryTick) const;
+
+    void insertLocked(TimerIndex index);
+    void unlinkLocked(TimerIndex index);
+    void releaseLocked(TimerIndex index);
+    void cascadeLocked(std::uint32_t level);
+
+  private:
+    Clock::duration m_tickDuration;
+    Clock::time_point m_start;
+
+    std::mutex m_mutex;
+    // Last tick that has been processed.
+    std::uint64_t m_currentTick = 0U;
+    std::vector<Timer> m_timers;
+    std::vector<TimerIndex> m_freeTimers;
+    std::array<TimerIndex, LevelCount * BucketsPerLevel> m_buckets;
+    std::size_t m_activeCount = 0U;
+};
+
+#endif
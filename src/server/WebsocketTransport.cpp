@@ -0,0 +1,137 @@
+#include "WebsocketTransport.h"
+
+#include <format>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <shared_mutex>
+#include <utility>
+
+#include <server/MonotonicTime.h>
+
+// clang-format off
+WebsocketTransport::WebsocketTransport(std::uint32_t port) : 
+    WebsocketTransport::server<websocketpp::config::asio>() {
+    // clang-format on
+
+    auto _1 = std::placeholders::_1;
+    auto _2 = std::placeholders::_2;
+
+    this->set_message_handler(std::bind(&WebsocketTransport::onMessage, this, _1, _2));
+    this->set_open_handler(std::bind(&WebsocketTransport::onConnectionOpened, this, _1));
+    this->set_close_handler(std::bind(&WebsocketTransport::onConnectionClosed, this, _1));
+
+    this->set_access_channels(websocketpp::log::alevel::all);
+    this->set_error_channels(websocketpp::log::elevel::all);
+
+    this->init_asio();
+
+    std::cout << "Listening on port " << port << std::endl;
+    this->listen(port);
+    this->start_accept();
+}
+
+ConnectionPtr WebsocketTransport::getConnectionPtr(ConnectionHdl hdl) {
+    return get_con_from_hdl(hdl);
+}
+
+void WebsocketTransport::onMessage(ConnectionHdl hdl, MessagePtr msg) {
+    std::uint64_t receiveTime = getMonotonicNanoseconds();
+    ConnectionPtr ptr = getConnectionPtr(hdl);
+    // The message is not used after the handler returns, so its payload is moved out instead
+    // of being copied.
+    m_listener->onMessage(
+        getConnectionId(ptr), std::move(msg->get_raw_payload()), receiveTime);
+}
+
+void WebsocketTransport::onConnectionClosed(ConnectionHdl hdl) {
+
+    auto ptr = getConnectionPtr(hdl);
+    auto id = getConnectionId(ptr);
+
+    {
+        std::unique_lock<std::shared_mutex> lock(m_connectionsMutex);
+        auto connection = m_connections.find(id);
+        if (connection != m_connections.end()) {
+            connection->second.setStatus(ConnectionMetadata::Status::Disconnected);
+        } else {
+            std::cerr << "Connection that is supposed to be closed, not found!";
+        }
+    }
+
+    m_listener->onConnectionClosed(id);
+}
+
+void WebsocketTransport::onConnectionOpened(ConnectionHdl hdl) {
+
+    auto connectionPtr = getConnectionPtr(hdl);
+    auto connectionId = getConnectionId(connectionPtr);
+
+    auto uri = connectionPtr->get_uri();
+
+    std::unique_lock<std::shared_mutex> lock(m_connectionsMutex);
+    auto connection = m_connections.find(connectionId);
+    if (connection != m_connections.end()) {
+        // TODO(implement proper handling of such case).
+        std::cerr << "Connection that is supposed to be opened, already exists!"
+                     "Not add new connection to the list";
+    }
+
+    auto [iter, success] = m_connections.emplace(std::make_pair(
+        connectionId, ConnectionMetadata(hdl, ConnectionMetadata::Status::Connected, uri)));
+    lock.unlock();
+    if (!success) {
+        std::cerr << "Failed to establish connection to: " << uri->get_port() << std::endl;
+        return;
+    }
+
+    std::cout << std::format("Connection opened to: {:d}.", uri->get_port()) << std::endl;
+}
+
+void WebsocketTransport::broadcastMessage(std::span<ConnectionId const> ids,
+                                          std::string_view payload) {
+    std::vector<ConnectionHdl> hdls;
+    hdls.reserve(ids.size());
+    {
+        std::shared_lock<std::shared_mutex> lock(m_connectionsMutex);
+        for (ConnectionId id : ids) {
+            auto iter = m_connections.find(id);
+            if (iter != m_connections.end()) {
+                hdls.push_back(iter->second.getHdl());
+            }
+        }
+    }
+
+    MessagePtr message;
+    for (ConnectionHdl const &hdl : hdls) {
+        websocketpp::lib::error_code ec;
+        ConnectionPtr connection = this->get_con_from_hdl(hdl, ec);
+        if (ec) {
+            continue;
+        }
+        if (!message) {
+            // A server frame is not masked, so the encoded frame is the same for every
+            // connection. Prepared messages are written as they are.
+            message = connection->get_message(websocketpp::frame::opcode::binary,
+                                              payload.size());
+            websocketpp::frame::basic_header header(
+                websocketpp::frame::opcode::binary, payload.size(), true, false);
+            websocketpp::frame::extended_header extendedHeader(payload.size());
+            message->set_header(websocketpp::frame::prepare_header(header, extendedHeader));
+            message->set_payload(payload.data(), payload.size());
+            message->set_prepared(true);
+        }
+        // Fails if the connection is closing meanwhile.
+        this->send(hdl, message, ec);
+    }
+}
+
+ConnectionMetadata::Status WebsocketTransport::getConnectionStatus(ConnectionId id) const {
+    std::shared_lock<std::shared_mutex> lock(m_connectionsMutex);
+    auto iter = m_connections.find(id);
+    if (iter != m_connections.end()) {
+        return iter->second.getStatus();
+    }
+    // If connection is not found in the list of connections, then it's disconnected.
+    return ConnectionMetadata::Status::Disconnected;
+}
@@ -0,0 +1,68 @@
+#ifndef WEBSOCKET_TRANSPORT_H
+#define WEBSOCKET_TRANSPORT_H
+
+#ifndef ASIO_STANDALONE
+#define ASIO_STANDALONE
+#endif
+
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <websocketpp/config/asio_no_tls.hpp>
+#include <websocketpp/server.hpp>
+
+#include <server/ConnectionMetadata.h>
+#include <server/ITransport.h>
+#include <server/ServerTypes.h>
+
+// Websocket front end. Frames are received on the thread that runs the transport.
+class WebsocketTransport : virtual public ServerType, public ITransport {
+  public:
+    // Starts listening, connections are accepted once the transport runs.
+    explicit WebsocketTransport(std::uint32_t port);
+
+    void setListener(Listener *listener) override { m_listener = listener; }
+
+    void sendMessage(ConnectionId id, std::string_view payload) override {
+        ConnectionHdl hdl;
+        {
+            std::shared_lock<std::shared_mutex> lock(m_connectionsMutex);
+            hdl = m_connections.at(id).getHdl();
+        }
+        // Send is a base class ServerType method.
+        this->send(hdl,
+                   static_cast<void const *>(payload.data()),
+                   payload.size(),
+                   websocketpp::frame::opcode::value::binary);
+    }
+
+    // Encodes the frame once and queues the same message on every connection.
+    void broadcastMessage(std::span<ConnectionId const> ids,
+                          std::string_view payload) override;
+
+    void run() override { ServerType::run(); }
+    void stop() override { ServerType::stop(); }
+
+    ConnectionMetadata::Status getConnectionStatus(ConnectionId id) const;
+
+  private:
+    void onMessage(ConnectionHdl hdl, MessagePtr msg);
+    void onConnectionClosed(ConnectionHdl hdl);
+    void onConnectionOpened(ConnectionHdl hdl);
+    ConnectionPtr getConnectionPtr(ConnectionHdl hdl);
+
+  private:
+    Listener *m_listener = nullptr;
+
+    // Senders of other threads look up connections while the transport thread opens them.
+    mutable std::shared_mutex m_connectionsMutex;
+    // Unordered map can not have weak_ptr as a key, so we need additional mapping.
+    std::unordered_map<ConnectionId, ConnectionMetadata> m_connections;
+};
+
+#endif
@@ -1,9 +1,72 @@
 #include "Server.h"
 
+#include <charconv>
+#include <format>
+#include <iostream>
 #include <memory>
+#include <string_view>
+
+namespace {
+void printUsage(char const *program) {
+    std::cerr << std::format("Usage: {:s} [--capture=<file>] [--port=<port>]\n"
+                             "       [--shard=<index> [--broker=<endpoint>]]\n"
+                             "A shard shares matchmaking with the other shards of the broker, "
+                             "the broker\nendpoint is tcp://<address>:<port> or "
+                             "unix://<path>.\n",
+                             program);
+}
+
+template <typename T>
+bool parseNumber(std::string_view text, T &value) {
+    char const *last = text.data() + text.size();
+    auto [end, ec] = std::from_chars(text.data(), last, value);
+    return ec == std::errc() && end == last;
+}
+} // namespace
 
 int main(int argc, char **argv) {
-    auto server = std::make_shared<Server>(Server::Params{.port = 6359, .maxTaskThreads = 10});
+    Server::Params params{.port = 6359, .maxTaskThreads = 10};
+    params.persistence = PersistenceWriter::Params{};
+    params.journal = GameJournal::Params{};
+    // Every registration creates a stored player.
+    params.admission.requestTypes[game_proto::Request::kRegistrationRequest] = {
+        .requestsPerSecond = 1.0, .burst = 5.0};
+
+    constexpr std::string_view CaptureOption = "--capture=";
+    constexpr std::string_view PortOption = "--port=";
+    constexpr std::string_view ShardOption = "--shard=";
+    constexpr std::string_view BrokerOption = "--broker=";
+    ClusterNode::Params cluster;
+    bool isShard = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        bool valid = true;
+        if (arg.starts_with(CaptureOption)) {
+            params.frameCapture =
+                FrameRecorder::Params{.path = arg.substr(CaptureOption.size())};
+        } else if (arg.starts_with(PortOption)) {
+            valid = parseNumber(arg.substr(PortOption.size()), params.port);
+        } else if (arg.starts_with(ShardOption)) {
+            valid = parseNumber(arg.substr(ShardOption.size()), cluster.shard);
+            isShard = true;
+        } else if (arg.starts_with(BrokerOption)) {
+            cluster.brokerEndpoint = arg.substr(BrokerOption.size());
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (isShard) {
+        // Shards share the databases, games in progress are journaled per shard.
+        params.journal->directory = std::format("journal-{:d}", cluster.shard);
+        params.cluster = cluster;
+    }
+
+    auto server = std::make_shared<Server>(params);
     server->run();
     return 0;
-}
\ No newline at end of file
+}